@@ -25,36 +25,81 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define __CPT_GLOBALS_H__
 
 #include <inttypes.h>
+#include <stdbool.h>
 
-// Number of "concurrent" workers to run. In the cooperative single-task mode this means the count of
-// Parallel sub-fsms. In the preemptive one it will be the number of tasks. For the preemptive test,
-// it's also possible to specify multi-core in cpt_preempt.h
-// TODO: figure out a way to have the cooperative test running in multi-core
+// Number of "concurrent" workers to run. In the cooperative mode this means the count of parallel sub-fsms,
+// stepped by the scheduler task(s). In the preemptive one it will be the number of tasks. Can be changed per run
+// via cpt_config, up to CPT_MAX_CONCURRENCY_COUNT.
+// The cooperative test can run several schedulers with work stealing, see CPT_SCHEDULER_COUNT
 #define CPT_CONCURRENCY_COUNT (2)
 
-// Report system status more often if set to 0
-#define CPT_FREQUENT_SYSTEM_STATUS_REPORT (0)
+// Upper bound for the number of workers in a run, used to size the per-worker structures
+#define CPT_MAX_CONCURRENCY_COUNT (16)
+
+// Number of scheduler tasks of the engines multiplexing their workers on a few tasks (coop, proto), 0 for one per core.
+// With more than one, the cooperative schedulers steal fsms from each other. Can be changed per run via cpt_config,
+// up to CPT_MAX_SCHEDULER_COUNT
+#define CPT_SCHEDULER_COUNT (0)
+#define CPT_MAX_SCHEDULER_COUNT (8)
+
+// Priority of the worker tasks. 1 is the same priority as main. It allows for full CPU utilization
+#define CPT_TASK_PRIO (1)
+
+// How worker tasks are distributed across cores, see cpt_affinity below
+#define CPT_AFFINITY (CPT_AFFINITY_ROUND_ROBIN)
+
+// Lock protecting the job in the preemptive test, see cpt_lock_type below. Can be changed per run via cpt_config
+#define CPT_LOCK_TYPE (CPT_LOCK_COUNTING_SEMAPHORE)
 
+// How the preemptive tasks run the job, see cpt_job_backend below. Can be changed per run via cpt_config
+#define CPT_JOB_BACKEND (CPT_JOB_BACKEND_LOCKED)
 
-/*** the api to be used for the test is resolved at compile-time after defining cpt_type ***/
-// cpt_type will define what type is going to be used in the test (preemptive or cooperative)
-#define cpt_type cpt_preempt
+// Job iterations run per lock acquisition (or per yield, for the lock-free backends). Can be changed per run via cpt_config
+#define CPT_BATCH_SIZE (1)
 
-// There's no need to change the lines below (they're used to generate the symbols to use for the cpt_type api)
-#define __CPT_METHOD(type, CPT_METHOD) type ## _ ## CPT_METHOD
-#define CPT_METHOD(...) __CPT_METHOD(__VA_ARGS__)
+// Work done by each job iteration, see cpt_workload below. Can be changed per run via cpt_config
+#define CPT_WORKLOAD (CPT_WORKLOAD_COUNTER)
 
-// Compile-time solution for class abstraction
-#define cpt_init CPT_METHOD(cpt_type, init)
-#define cpt_uninit CPT_METHOD(cpt_type, uninit)
-#define cpt_run_job CPT_METHOD(cpt_type, run_job)
-#define cpt_wait_for_state_change CPT_METHOD(cpt_type, wait_for_state_change)
+// Units of work run by each iteration inside the critical section (under the job lock) and outside of it. What a
+// unit is depends on the workload, see cpt_workload below. Can be changed per run via cpt_config
+#define CPT_CRITICAL_SIZE (16)
+#define CPT_PRIVATE_SIZE (0)
 
-/*** Generic definitions to be used by any implementation of the cpt_type api ***/
+// Cache line size for the external memory (flash, PSRAM) cache on ESP32. Internal SRAM is not cached.
+// Host builds (see cpt_platform.h) assume x86-64 and most ARM64 cores
+#if defined(ESP_PLATFORM)
+#define CPT_CACHE_LINE_SIZE (32)
+#else
+#define CPT_CACHE_LINE_SIZE (64)
+#endif
+
+// Layout of the per-task state, see cpt_layout below. Can be changed per run via cpt_config
+#define CPT_LAYOUT (CPT_LAYOUT_PACKED)
+
+// How requests reach the owner task of the actor engine, see cpt_transport below. Can be changed per run via cpt_config
+#define CPT_TRANSPORT (CPT_TRANSPORT_QUEUE)
+
+// What producers and consumers of the pipe engine hand items over, see cpt_channel below. Can be changed per run via cpt_config
+#define CPT_CHANNEL (CPT_CHANNEL_RING_MPMC)
+
+// How workers wait for the job lock and yield after each batch, see cpt_yield_policy below. Can be changed per run via
+// cpt_config
+#define CPT_YIELD_POLICY (CPT_YIELD_BASELINE)
+
+// Roles and priorities of the workers, see cpt_scenario below. Can be changed per run via cpt_config
+#define CPT_SCENARIO (CPT_SCENARIO_UNIFORM)
+
+// Report system status more often if set to 0
+#define CPT_FREQUENT_SYSTEM_STATUS_REPORT (0)
+
+/*** Generic definitions to be used by any engine (see cpt_engine.h) ***/
 
 // Use this in *_wait_for_state_change to disable timeout
 #define CPT_WAIT_FOREVER (0)
 
+// Number of elements in a static array
+#define CPT_ARRAY_SIZE(array) (sizeof(array) / sizeof((array)[0]))
+
 /// @brief test state, useful for state signal handling
 typedef enum
 {
@@ -66,4 +111,131 @@ typedef enum
     CPT_STATE_COUNT
 } cpt_state;
 
+/// @brief strategies available to protect a shared resource, see cpt_lock.h
+typedef enum
+{
+    CPT_LOCK_COUNTING_SEMAPHORE = 0, // FreeRTOS counting semaphore with a single token, no priority inheritance
+    CPT_LOCK_MUTEX,                  // FreeRTOS mutex, with priority inheritance
+    CPT_LOCK_BINARY_SEMAPHORE,       // FreeRTOS binary semaphore
+    CPT_LOCK_CRITICAL_SECTION,       // portMUX spinlock via taskENTER_CRITICAL, disables interrupts on the holder's core
+    CPT_LOCK_TICKET,                 // FIFO spinlock on C11 atomics
+    CPT_LOCK_MCS,                    // MCS queue lock, each waiter spins on its own node
+    CPT_LOCK_PRIORITY_CEILING,       // Counting semaphore taken at a ceiling priority, holders can't be preempted by other users
+    CPT_LOCK_TYPE_COUNT
+} cpt_lock_type;
+
+/// @brief ways of running a job shared across workers, see cpt_job.h
+typedef enum
+{
+    CPT_JOB_BACKEND_LOCKED = 0, // cpt_job_run under the job lock
+    CPT_JOB_BACKEND_ATOMIC32,   // cpt_job_run_atomic32, the job lock is not used
+    CPT_JOB_BACKEND_ATOMIC64,   // cpt_job_run_atomic64, the job lock is not used
+    CPT_JOB_BACKEND_COUNT
+} cpt_job_backend;
+
+/// @brief work done by a job iteration, on top of incrementing the job counter. See cpt_job.h
+typedef enum
+{
+    CPT_WORKLOAD_COUNTER = 0, // Nothing but the counter increment, the critical and private sizes are ignored
+    CPT_WORKLOAD_CRC,         // Compute bound: CRC32 over a buffer. A unit is a byte
+    CPT_WORKLOAD_STRIDED,     // Memory bound: strided read-modify-write walk over a large buffer. A unit is an access
+    CPT_WORKLOAD_PING_PONG,   // Updates to a structure shared by all workers, bouncing between cores. A unit is a write
+    CPT_WORKLOAD_COUNT
+} cpt_workload;
+
+/// @brief memory layouts for the state shared by worker tasks
+typedef enum
+{
+    CPT_LAYOUT_PACKED = 0, // Contiguous: per-task and shared fields sit next to each other, falsely sharing lines
+    CPT_LAYOUT_PADDED,     // Each task slot, and the hot and cold shared fields, are aligned and padded to a line
+    CPT_LAYOUT_COUNT
+} cpt_layout;
+
+/// @brief channels workers use to send requests to the owner of the job, in the actor engine
+typedef enum
+{
+    CPT_TRANSPORT_QUEUE = 0,     // A FreeRTOS queue shared by all workers
+    CPT_TRANSPORT_STREAM_BUFFER, // A FreeRTOS stream buffer. It only supports a single writer, so workers serialize on a mutex
+    CPT_TRANSPORT_NOTIFICATION,  // A mailbox per worker, signaled by setting the worker's bit in the owner's notification value
+    CPT_TRANSPORT_COUNT
+} cpt_transport;
+
+/// @brief channels between producers and consumers, in the pipe engine
+typedef enum
+{
+    CPT_CHANNEL_QUEUE = 0,  // A FreeRTOS queue
+    CPT_CHANNEL_RING_SPSC,  // A lock-free single producer single consumer ring, requires exactly two workers
+    CPT_CHANNEL_RING_MPMC,  // A lock-free bounded multi producer multi consumer ring
+    CPT_CHANNEL_COUNT
+} cpt_channel;
+
+/// @brief how a worker waits when it finds the job lock taken, and what it does after each batch. See cpt_backoff.h
+typedef enum
+{
+    CPT_YIELD_BASELINE = 0,     // Waits as the lock type does (semaphores block, spinlocks spin), yields after each batch
+    CPT_YIELD_NEVER,            // Spins on the lock, never yields
+    CPT_YIELD_EVERY_N,          // Yields every CPT_BACKOFF_YIELD_INTERVAL failed attempts, and batches
+    CPT_YIELD_DELAY,            // Sleeps a tick (vTaskDelay(1)) after each failed attempt, and batch
+    CPT_YIELD_BACKOFF,          // Busy waits for exponentially longer after each failed attempt, and after contended batches
+    CPT_YIELD_SPIN_THEN_BLOCK,  // Spins CPT_BACKOFF_SPIN_LIMIT attempts then blocks, yields after contended batches
+    CPT_YIELD_POLICY_COUNT
+} cpt_yield_policy;
+
+/// @brief roles and priorities given to the workers, in the preemptive engine. See cpt_preempt.h
+typedef enum
+{
+    CPT_SCENARIO_UNIFORM = 0,        // All workers run the job, at the same priority
+    CPT_SCENARIO_PRIORITY_INVERSION, // A latency critical worker, medium priority CPU hogs and low priority lock holders
+    CPT_SCENARIO_COUNT
+} cpt_scenario;
+
+/// @brief policies to pin worker tasks to cores
+typedef enum
+{
+    CPT_AFFINITY_CORE_0 = 0,   // All workers on core 0
+    CPT_AFFINITY_ROUND_ROBIN,  // Worker i on core i % number of cores
+    CPT_AFFINITY_NONE,         // Not pinned (tskNO_AFFINITY), the scheduler picks the core
+    CPT_AFFINITY_COUNT
+} cpt_affinity;
+
+/// @brief Runtime parameters for a test run. Implementations ignore the fields that don't apply to them
+typedef struct
+{
+    uint8_t concurrency; // Number of workers, 1 to CPT_MAX_CONCURRENCY_COUNT
+    uint8_t priority; // Priority of the worker tasks
+    cpt_affinity affinity; // Core placement of the worker tasks
+    cpt_lock_type lock_type; // Lock protecting the job
+    cpt_job_backend job_backend; // Locked or lock-free job runs
+    uint16_t batch_size; // Job iterations per lock acquisition. When adaptive, the upper bound for the batch size
+    bool adaptive_batch; // Adapt the batch size to the contention observed on the lock
+    cpt_workload workload; // Work done by each job iteration
+    uint16_t critical_size; // Units of work per iteration inside the critical section
+    uint16_t private_size; // Units of work per iteration outside of the critical section
+    cpt_layout layout; // Memory layout of the state shared by worker tasks
+    cpt_transport transport; // How workers send requests to the job owner, for engines passing messages
+    cpt_channel channel; // How producers hand items to consumers, for the pipe engine
+    cpt_scenario scenario; // Roles and priorities of the workers, priority being the lowest one
+    cpt_yield_policy yield_policy; // How workers wait for the job lock and yield between batches
+    uint8_t scheduler_count; // Scheduler tasks, for engines multiplexing workers on them. 0 for one per core
+} cpt_config;
+
+// Initializer for a cpt_config using the compile-time defaults
+#define CPT_CONFIG_DEFAULT { \
+    .concurrency = CPT_CONCURRENCY_COUNT, \
+    .priority = CPT_TASK_PRIO, \
+    .affinity = CPT_AFFINITY, \
+    .lock_type = CPT_LOCK_TYPE, \
+    .job_backend = CPT_JOB_BACKEND, \
+    .batch_size = CPT_BATCH_SIZE, \
+    .adaptive_batch = false, \
+    .workload = CPT_WORKLOAD, \
+    .critical_size = CPT_CRITICAL_SIZE, \
+    .private_size = CPT_PRIVATE_SIZE, \
+    .layout = CPT_LAYOUT, \
+    .transport = CPT_TRANSPORT, \
+    .channel = CPT_CHANNEL, \
+    .scenario = CPT_SCENARIO, \
+    .yield_policy = CPT_YIELD_POLICY, \
+    .scheduler_count = CPT_SCHEDULER_COUNT }
+
 #endif //__CPT_GLOBALS_H__
\ No newline at end of file
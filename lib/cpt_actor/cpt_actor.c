@@ -0,0 +1,493 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpt_globals.h"
+#include "cpt_actor.h"
+#include "cpt_utils.h"
+#include "cpt_stats.h"
+#include "esp_check.h"
+
+#define TAG "actor"
+
+static void cpt_actor_worker_function(void * parameters);
+static void cpt_actor_owner_function(void * parameters);
+
+/// @brief change the state for this object and notify waiting task (if set)
+/// @param new_state the state to set this cpt_actor object to
+/// @return esp_ok in case of success
+static esp_err_t cpt_actor_set_state(cpt_actor * actor, cpt_state new_state)
+{
+    ESP_LOGD(TAG, "Changing state from %d to %d", atomic_load(&actor->state), new_state);
+    // Set the state first
+    atomic_store(&actor->state, new_state);
+
+    // Then read the handle
+    volatile TaskHandle_t waiting_task_handle = atomic_load(&actor->waiting_task_handle);
+
+    // Notify task if necessary
+    if (waiting_task_handle != NULL)
+    {
+        xTaskNotifyGive(waiting_task_handle);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t cpt_actor_wait_for_state_change(cpt_actor * actor, uint32_t max_wait_ms, cpt_state expected_state)
+{
+    TaskHandle_t this_task_handle = xTaskGetCurrentTaskHandle();
+    TaskHandle_t null_task_handle = NULL;
+    volatile cpt_state current_state = CPT_STATE_NONE;
+    uint32_t notification_value = 0;
+
+    // Set the wait handle first
+    bool valid = atomic_compare_exchange_strong(&actor->waiting_task_handle, &null_task_handle, this_task_handle);
+    ESP_RETURN_ON_FALSE(valid, ESP_ERR_INVALID_STATE, TAG, "Handle already set");
+
+    while (current_state != expected_state)
+    {
+        // Read the state after setting the handle: this fixes races
+        current_state = atomic_load(&actor->state);
+
+        if (current_state != expected_state)
+        {
+            notification_value = ulTaskNotifyTake(pdTRUE, max_wait_ms == CPT_WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(max_wait_ms));
+            if (notification_value == 0)
+            {
+                break;
+            }
+        }
+    }
+
+    atomic_store(&actor->waiting_task_handle, NULL);
+
+    return current_state == expected_state ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+esp_err_t cpt_actor_init(cpt_actor * actor, cpt_job * job, const cpt_config * config)
+{
+    // The structure is large because of the histograms, don't zero it through a temporary
+    memset(actor, 0, sizeof(cpt_actor));
+    esp_err_t ret = ESP_OK;
+
+    ret = cpt_config_validate(config);
+    ESP_GOTO_ON_ERROR(ret, exit, TAG, "Invalid configuration");
+
+    actor->job = job;
+    actor->worker_count = config->concurrency;
+    actor->transport = config->transport;
+    actor->batch_size = config->batch_size;
+
+    ret = cpt_actor_set_state(actor, CPT_STATE_INITIALIZING);
+    ESP_GOTO_ON_ERROR(ret, exit, TAG, "Error setting state: %s", esp_err_to_name(ret));
+
+    // Workers wait for each reply before sending another request, so there's at most one request per worker in flight
+    switch (actor->transport)
+    {
+        case CPT_TRANSPORT_QUEUE:
+            actor->queue = xQueueCreate(actor->worker_count, sizeof(cpt_actor_request));
+            ESP_GOTO_ON_FALSE(actor->queue != NULL, ESP_ERR_NO_MEM, exit, TAG, "Unable to create the request queue");
+            break;
+        case CPT_TRANSPORT_STREAM_BUFFER:
+            // A trigger level of one request wakes the owner up as soon as there's something to serve
+            actor->stream_buffer = xStreamBufferCreate(actor->worker_count * sizeof(cpt_actor_request), sizeof(cpt_actor_request));
+            ESP_GOTO_ON_FALSE(actor->stream_buffer != NULL, ESP_ERR_NO_MEM, exit, TAG, "Unable to create the request stream buffer");
+            actor->stream_buffer_mutex = xSemaphoreCreateMutex();
+            ESP_GOTO_ON_FALSE(actor->stream_buffer_mutex != NULL, ESP_ERR_NO_MEM, exit, TAG, "Unable to create the stream buffer mutex");
+            break;
+        default:
+            break;
+    }
+
+    for (uint8_t worker_index = 0; worker_index < actor->worker_count; worker_index ++)
+    {
+        cpt_actor_worker * worker = &actor->workers[worker_index];
+        cpt_job_worker_init(&worker->job_worker, worker_index);
+
+        ret = cpt_pool_acquire(cpt_affinity_get_core(config->affinity, worker_index), config->priority, &worker->pool_worker);
+        ESP_GOTO_ON_ERROR(ret, exit, TAG, "Unable to get a worker for worker %d", worker_index);
+
+        cpt_pool_start(worker->pool_worker, cpt_actor_worker_function, actor);
+    }
+
+    // The owner takes the next core in the affinity policy, as if it was one more worker
+    ret = cpt_pool_acquire(cpt_affinity_get_core(config->affinity, actor->worker_count), config->priority, &actor->owner_pool_worker);
+    ESP_GOTO_ON_ERROR(ret, exit, TAG, "Unable to get a worker for the owner");
+
+    cpt_pool_start(actor->owner_pool_worker, cpt_actor_owner_function, actor);
+
+    ESP_LOGI(TAG, "%d workers and owner initialized, priority: %d affinity: %s transport: %s batch: %d workload: %s (%d/%d)",
+        actor->worker_count,
+        config->priority,
+        cpt_affinity_to_name(config->affinity),
+        cpt_transport_to_name(config->transport),
+        config->batch_size,
+        cpt_job_workload_to_name(config->workload),
+        config->critical_size,
+        config->private_size);
+
+    exit:
+    if (ret != ESP_OK)
+    {
+        cpt_actor_uninit(actor);
+    }
+
+    return ret;
+}
+
+void cpt_actor_uninit(cpt_actor * actor)
+{
+    ESP_LOGI(TAG, "uninitializing");
+
+    for (int i = 0; i < actor->worker_count; i ++)
+    {
+        if (actor->workers[i].pool_worker != NULL)
+        {
+            cpt_pool_release(actor->workers[i].pool_worker);
+        }
+    }
+
+    if (actor->owner_pool_worker != NULL)
+    {
+        cpt_pool_release(actor->owner_pool_worker);
+    }
+
+    if (actor->queue != NULL)
+    {
+        vQueueDelete(actor->queue);
+    }
+
+    if (actor->stream_buffer != NULL)
+    {
+        vStreamBufferDelete(actor->stream_buffer);
+    }
+
+    if (actor->stream_buffer_mutex != NULL)
+    {
+        vSemaphoreDelete(actor->stream_buffer_mutex);
+    }
+
+    memset(actor, 0, sizeof(cpt_actor));
+}
+
+// Returns -1 if the task wasn't found
+static int8_t cpt_actor_get_current_worker_index(cpt_actor * actor)
+{
+    TaskHandle_t handle = xTaskGetCurrentTaskHandle();
+
+    for (int8_t i = 0; i < actor->worker_count; i ++)
+    {
+        if (actor->workers[i].pool_worker != NULL && actor->workers[i].pool_worker->handle == handle)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+static void cpt_actor_signal_initialized(cpt_actor * actor)
+{
+    // Workers plus the owner
+    if (atomic_fetch_add(&actor->initialized_tasks_count, 1) == actor->worker_count)
+    {
+        cpt_actor_set_state(actor, CPT_STATE_INITIALIZED);
+    }
+}
+
+// Called by workers. Blocks if the transport is full, which can't happen with a closed loop
+static void cpt_actor_send(cpt_actor * actor, const cpt_actor_request * request)
+{
+    switch (actor->transport)
+    {
+        case CPT_TRANSPORT_QUEUE:
+            xQueueSend(actor->queue, request, portMAX_DELAY);
+            break;
+
+        case CPT_TRANSPORT_STREAM_BUFFER:
+            xSemaphoreTake(actor->stream_buffer_mutex, portMAX_DELAY);
+            xStreamBufferSend(actor->stream_buffer, request, sizeof(cpt_actor_request), portMAX_DELAY);
+            xSemaphoreGive(actor->stream_buffer_mutex);
+            break;
+
+        case CPT_TRANSPORT_NOTIFICATION:
+            // The notification is a barrier, the owner sees the mailbox written once it sees the bit
+            actor->workers[request->worker_index].mailbox = * request;
+            xTaskNotify(actor->owner_pool_worker->handle, 1UL << request->worker_index, eSetBits);
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Called by the owner. Blocks until there is at least one request, then takes whatever else is pending
+// @return the number of requests stored in requests
+static size_t cpt_actor_receive(cpt_actor * actor, cpt_actor_request requests[CPT_ACTOR_MAX_RECEIVE_COUNT])
+{
+    size_t count = 0;
+
+    switch (actor->transport)
+    {
+        case CPT_TRANSPORT_QUEUE:
+            if (xQueueReceive(actor->queue, &requests[count], portMAX_DELAY) == pdTRUE)
+            {
+                count ++;
+
+                while (count < CPT_ACTOR_MAX_RECEIVE_COUNT && xQueueReceive(actor->queue, &requests[count], 0) == pdTRUE)
+                {
+                    count ++;
+                }
+            }
+            break;
+
+        case CPT_TRANSPORT_STREAM_BUFFER:
+            // Writers send whole requests, so the buffer always holds a multiple of the request size
+            count = xStreamBufferReceive(actor->stream_buffer, requests, CPT_ACTOR_MAX_RECEIVE_COUNT * sizeof(cpt_actor_request), portMAX_DELAY) / sizeof(cpt_actor_request);
+            break;
+
+        case CPT_TRANSPORT_NOTIFICATION:
+        {
+            uint32_t pending = 0;
+            xTaskNotifyWait(0, UINT32_MAX, &pending, portMAX_DELAY);
+
+            while (pending != 0 && count < CPT_ACTOR_MAX_RECEIVE_COUNT)
+            {
+                requests[count ++] = actor->workers[__builtin_ctz(pending)].mailbox;
+                pending &= pending - 1;
+            }
+            break;
+        }
+
+        default:
+            break;
+    }
+
+    return count;
+}
+
+// Runs the iterations of a request then replies to the worker. Returns true if the worker was told the job is done
+static bool cpt_actor_serve(cpt_actor * actor, const cpt_actor_request * request)
+{
+    cpt_actor_worker * worker = &actor->workers[request->worker_index];
+    cpt_job_status status = CPT_JOB_NOT_DONE;
+    uint16_t i = 0;
+
+    // No lock: the owner is the only task running the job
+    for (; i < request->iterations && status == CPT_JOB_NOT_DONE; i ++)
+    {
+        status = cpt_job_run(actor->job);
+    }
+
+    worker->counter += i;
+    worker->request_count ++;
+    worker->done = status == CPT_JOB_DONE;
+    xTaskNotifyGive(worker->pool_worker->handle);
+
+    return status == CPT_JOB_DONE;
+}
+
+// The owner serves requests until every worker was told the job is done. It doesn't need to wait for run_job, as
+// there's nothing to serve before the workers start
+static void cpt_actor_owner_function(void * parameters)
+{
+    cpt_actor * actor = (cpt_actor *) parameters;
+    cpt_actor_request requests[CPT_ACTOR_MAX_RECEIVE_COUNT];
+    uint8_t finished_workers_count = 0;
+
+    cpt_actor_signal_initialized(actor);
+
+    while (finished_workers_count < actor->worker_count)
+    {
+        size_t count = cpt_actor_receive(actor, requests);
+
+        for (size_t i = 0; i < count; i ++)
+        {
+            finished_workers_count += cpt_actor_serve(actor, &requests[i]) ? 1 : 0;
+        }
+    }
+
+    // signal that we're done
+    cpt_actor_set_state(actor, CPT_STATE_DONE);
+
+    // Returning parks the worker until the pool hands it to the next run
+}
+
+// Workers run the private part of the workload, then send a request for a batch of job iterations and wait for the
+// reply, until the owner tells them the job is done
+static void cpt_actor_worker_function(void * parameters)
+{
+    cpt_actor * actor = (cpt_actor *) parameters;
+    int8_t worker_index = cpt_actor_get_current_worker_index(actor);
+
+    if (worker_index == -1)
+    {
+        ESP_LOGE(TAG, "Worker not found in array, terminating task");
+        return;
+    }
+
+    cpt_actor_worker * worker = &actor->workers[worker_index];
+    const cpt_actor_request request = {
+        .worker_index = worker_index,
+        .iterations = actor->batch_size,
+    };
+
+    cpt_actor_signal_initialized(actor);
+
+    // Wait for run_job. A notification given before reaching this point stays pending, so there's no race
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    while (! worker->done)
+    {
+        for (uint16_t k = 0; k < request.iterations; k ++)
+        {
+            cpt_job_run_private(actor->job, &worker->job_worker);
+        }
+
+        uint64_t sent = cpt_get_current_time_us();
+        cpt_actor_send(actor, &request);
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        // Timer based rather than cycle based, as the worker may have migrated to the other core in the meantime
+        cpt_histogram_record(&worker->latency, cpt_get_current_time_us() - sent);
+    }
+}
+
+esp_err_t cpt_actor_run_job(cpt_actor * actor)
+{
+    ESP_LOGI(TAG, "Starting job");
+
+    // Wait for all tasks to be initialized
+    esp_err_t ret = cpt_actor_wait_for_state_change(actor, CPT_WAIT_FOREVER, CPT_STATE_INITIALIZED);
+    ESP_RETURN_ON_ERROR(ret, TAG, "Error waiting for initialization: %s", esp_err_to_name(ret));
+
+    cpt_actor_set_state(actor, CPT_STATE_RUNNING);
+
+    // Time measurement should begin here
+    for (int i = 0; i < actor->worker_count; i ++)
+    {
+        xTaskNotifyGive(actor->workers[i].pool_worker->handle);
+    }
+
+    return ESP_OK;
+}
+
+static void cpt_actor_log_latency(const char * name, const cpt_histogram * latency)
+{
+    ESP_LOGI(TAG, "%6s %9"PRIu32" %9"PRIu32" %9"PRIu32" %9"PRIu32" %9"PRIu32,
+        name,
+        latency->total_count,
+        cpt_histogram_get_percentile(latency, 50),
+        cpt_histogram_get_percentile(latency, 90),
+        cpt_histogram_get_percentile(latency, 99),
+        latency->max);
+}
+
+void cpt_actor_log_report(cpt_actor * actor)
+{
+    double shares[CPT_MAX_CONCURRENCY_COUNT];
+    cpt_stats_fairness fairness;
+
+    ESP_LOGI(TAG, "==== Job share ====");
+
+    for (int i = 0; i < actor->worker_count; i ++)
+    {
+        shares[i] = actor->workers[i].counter;
+        ESP_LOGI(TAG, "worker %d iterations: %lu requests: %lu", i, actor->workers[i].counter, actor->workers[i].request_count);
+    }
+
+    cpt_stats_get_fairness(shares, actor->worker_count, &fairness);
+    ESP_LOGI(TAG, "Jain's index: %.4f min/max: %.4f coefficient of variation: %.4f",
+        fairness.jain_index,
+        fairness.min_max_ratio,
+        fairness.coefficient_of_variation);
+
+    // Too large for the caller's stack
+    cpt_histogram * all_workers = malloc(sizeof(cpt_histogram));
+    if (all_workers == NULL)
+    {
+        ESP_LOGE(TAG, "Unable to allocate the latency histogram");
+        return;
+    }
+
+    cpt_histogram_reset(all_workers);
+
+    ESP_LOGI(TAG, "==== Request round trip (us) over %s ====", cpt_transport_to_name(actor->transport));
+    ESP_LOGI(TAG, "------ --------- --------- --------- --------- ---------");
+    ESP_LOGI(TAG, "Worker     Count       p50       p90       p99       max");
+    ESP_LOGI(TAG, "------ --------- --------- --------- --------- ---------");
+
+    for (int i = 0; i < actor->worker_count; i ++)
+    {
+        char name[8];
+        snprintf(name, sizeof(name), "%d", i);
+        cpt_actor_log_latency(name, &actor->workers[i].latency);
+        cpt_histogram_merge(all_workers, &actor->workers[i].latency);
+    }
+
+    cpt_actor_log_latency("all", all_workers);
+    free(all_workers);
+}
+
+static void cpt_actor_engine_log_report(void * engine)
+{
+    cpt_actor_log_report((cpt_actor *) engine);
+}
+
+static esp_err_t cpt_actor_engine_init(void * engine, cpt_job * job, const cpt_config * config)
+{
+    return cpt_actor_init((cpt_actor *) engine, job, config);
+}
+
+static void cpt_actor_engine_uninit(void * engine)
+{
+    cpt_actor_uninit((cpt_actor *) engine);
+}
+
+static esp_err_t cpt_actor_engine_run_job(void * engine)
+{
+    return cpt_actor_run_job((cpt_actor *) engine);
+}
+
+static esp_err_t cpt_actor_engine_wait_for_state_change(void * engine, uint32_t max_wait_ms, cpt_state state)
+{
+    return cpt_actor_wait_for_state_change((cpt_actor *) engine, max_wait_ms, state);
+}
+
+static const cpt_engine cpt_actor_engine = {
+    .name = "actor",
+    .engine_size = sizeof(cpt_actor),
+    .init = cpt_actor_engine_init,
+    .uninit = cpt_actor_engine_uninit,
+    .run_job = cpt_actor_engine_run_job,
+    .wait_for_state_change = cpt_actor_engine_wait_for_state_change,
+    .log_report = cpt_actor_engine_log_report,
+};
+
+esp_err_t cpt_actor_register()
+{
+    return cpt_engine_register(&cpt_actor_engine);
+}
\ No newline at end of file
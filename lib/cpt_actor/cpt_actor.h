@@ -0,0 +1,110 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __CPT_ACTOR_H__
+#define __CPT_ACTOR_H__
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "freertos/semphr.h"
+#include "freertos/stream_buffer.h"
+#include "esp_err.h"
+#include "stdatomic.h"
+
+#include "cpt_globals.h"
+#include "cpt_engine.h"
+#include "cpt_job.h"
+#include "cpt_pool.h"
+#include "cpt_histogram.h"
+
+// Most requests the owner takes from the transport at once. With a closed loop there's at most one per worker
+#define CPT_ACTOR_MAX_RECEIVE_COUNT (CPT_MAX_CONCURRENCY_COUNT)
+
+_Static_assert(CPT_MAX_CONCURRENCY_COUNT <= 32, "The notification transport needs a bit per worker");
+
+/// @brief A request for the owner to run some job iterations on behalf of a worker
+typedef struct
+{
+    uint8_t worker_index;
+    uint16_t iterations;
+} cpt_actor_request;
+
+/// @brief Structure handling a worker task in the actor test. Workers never touch the job: they send requests to
+/// the owner and wait for the reply (a closed loop), measuring the round trip
+typedef struct
+{
+    cpt_pool_worker * pool_worker; // Pool worker running the task
+    cpt_job_worker job_worker; // State for the private part of the workload
+    cpt_actor_request mailbox; // Request slot for the notification transport
+    unsigned long counter; // Job iterations run on behalf of this worker, written by the owner
+    unsigned long request_count; // Written by the owner
+    volatile bool done; // Set by the owner when replying to the request that found the job done
+    cpt_histogram latency; // Request round trips, in us
+} cpt_actor_worker;
+
+/// @brief Structure holding state for an actor test: the owner task is the only one running the job, worker tasks
+/// submit requests through the transport selected in the configuration
+typedef struct
+{
+    cpt_actor_worker workers[CPT_MAX_CONCURRENCY_COUNT];
+    uint8_t worker_count; // Number of workers used in workers
+    cpt_pool_worker * owner_pool_worker;
+    atomic_uint_fast8_t initialized_tasks_count; // Used to determine when all tasks (workers and owner) are initialized
+
+    cpt_job * job; // Only touched by the owner
+    cpt_transport transport;
+    uint16_t batch_size; // Job iterations per request
+    QueueHandle_t queue; // CPT_TRANSPORT_QUEUE
+    StreamBufferHandle_t stream_buffer; // CPT_TRANSPORT_STREAM_BUFFER
+    SemaphoreHandle_t stream_buffer_mutex; // Serializes the writers of stream_buffer
+
+    volatile _Atomic cpt_state state; // The state of this actor object
+    // An event is generated at each significant state change. Currently when all tasks are initialized, and when the job is completed.
+    volatile _Atomic TaskHandle_t waiting_task_handle; // Handle for a task waiting for the next event
+} cpt_actor;
+
+// Initializes the transport and the tasks necessary to run the test: config->concurrency workers plus the owner.
+// Workers wait for the run_job function to be called before sending requests. Each request carries
+// config->batch_size job iterations.
+esp_err_t cpt_actor_init(cpt_actor * actor, cpt_job * job, const cpt_config * config);
+void cpt_actor_uninit(cpt_actor * actor);
+
+// Starts the execution of the job scheduled for this actor object
+// This call is not blocking
+esp_err_t cpt_actor_run_job(cpt_actor * actor);
+
+/// @brief Logs how the job was shared across workers and the request latencies. To be called once the job is done
+void cpt_actor_log_report(cpt_actor * actor);
+
+/// @brief Block caller thread until the next state change.
+/// @details Same semantics as cpt_preempt_wait_for_state_change
+/// @param max_wait_ms the maximum wait time in ms, CPT_WAIT_FOREVER to never timeout
+/// @param state the state to wait for
+/// @return ESP_OK in case of success, ESP_ERROR_TIMEOUT if the maximum time was reached.
+esp_err_t cpt_actor_wait_for_state_change(cpt_actor * actor, uint32_t max_wait_ms, cpt_state state);
+
+/// @brief Adds the actor engine to the engine registry, under the name "actor"
+esp_err_t cpt_actor_register();
+
+#endif //__CPT_ACTOR_H__
\ No newline at end of file
@@ -0,0 +1,53 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "cpt_backoff.h"
+
+void cpt_backoff_init(cpt_backoff * backoff, cpt_yield_policy policy)
+{
+    * backoff = (cpt_backoff) {0};
+    backoff->policy = policy;
+    backoff->attempt_cycles = CPT_BACKOFF_MIN_CYCLES;
+    backoff->batch_cycles = CPT_BACKOFF_MIN_CYCLES;
+}
+
+const char * cpt_yield_policy_to_name(cpt_yield_policy policy)
+{
+    switch (policy)
+    {
+        case CPT_YIELD_BASELINE:
+            return "baseline";
+        case CPT_YIELD_NEVER:
+            return "never";
+        case CPT_YIELD_EVERY_N:
+            return "every_n";
+        case CPT_YIELD_DELAY:
+            return "delay";
+        case CPT_YIELD_BACKOFF:
+            return "backoff";
+        case CPT_YIELD_SPIN_THEN_BLOCK:
+            return "spin_then_block";
+        default:
+            return "invalid";
+    }
+}
\ No newline at end of file
@@ -0,0 +1,192 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __CPT_BACKOFF_H__
+#define __CPT_BACKOFF_H__
+
+#include "cpt_globals.h"
+#include "cpt_platform.h"
+
+// Failed attempts, or batches, between two yields with CPT_YIELD_EVERY_N
+#define CPT_BACKOFF_YIELD_INTERVAL (16)
+
+// Bounds of the busy wait of CPT_YIELD_BACKOFF, in CPU cycles. The wait doubles at each failed attempt, and after
+// each batch run with a contended lock. It's reset once the lock is acquired (for attempts) or wasn't contended
+#define CPT_BACKOFF_MIN_CYCLES (32)
+#define CPT_BACKOFF_MAX_CYCLES (16 * 1024)
+
+// Failed attempts spent spinning before blocking, with CPT_YIELD_SPIN_THEN_BLOCK
+#define CPT_BACKOFF_SPIN_LIMIT (64)
+
+/// @brief What a worker did to wait, to be reported along with the policy
+typedef struct
+{
+    uint32_t yield_count;
+    uint32_t delay_count; // Sleeps of a tick
+    uint32_t block_count; // Waits that gave up spinning
+    uint32_t contended_count; // Lock acquisitions that took more than one attempt
+    uint64_t pause_cycles; // Spent in busy waits
+} cpt_backoff_stats;
+
+/// @brief Waiting state of a worker, following a yield policy. Owned by a single task
+typedef struct
+{
+    cpt_yield_policy policy;
+    uint32_t attempts; // Failed attempts of the current lock acquisition
+    uint32_t attempt_cycles; // Busy wait after the next failed attempt
+    uint32_t batch_count; // Batches run
+    uint32_t batch_cycles; // Busy wait after the next contended batch
+    bool contended; // The last lock acquisition took more than one attempt
+    cpt_backoff_stats stats;
+} cpt_backoff;
+
+void cpt_backoff_init(cpt_backoff * backoff, cpt_yield_policy policy);
+
+/// @brief gets a printable name for a yield policy
+const char * cpt_yield_policy_to_name(cpt_yield_policy policy);
+
+static inline void cpt_backoff_pause(cpt_backoff * backoff, uint32_t cycles)
+{
+    uint32_t start = cpt_platform_get_cycle_count();
+
+    while (cpt_platform_get_cycle_count() - start < cycles)
+    {
+        cpt_platform_task_allow_delete();
+    }
+
+    backoff->stats.pause_cycles += cycles;
+}
+
+static inline void cpt_backoff_yield(cpt_backoff * backoff)
+{
+    cpt_platform_yield();
+    backoff->stats.yield_count ++;
+}
+
+static inline void cpt_backoff_delay(cpt_backoff * backoff)
+{
+    cpt_platform_delay_ms(1);
+    backoff->stats.delay_count ++;
+}
+
+/// @brief To be called by a waiter each time it finds the lock taken, before trying again. Inlined as it's in the
+/// lock's spin loop
+/// @return true when the waiter should stop spinning and block instead (spin-then-block past its spin limit)
+static inline bool cpt_backoff_wait(cpt_backoff * backoff)
+{
+    // Called by every spin loop on a lock, whatever the policy: a waiter that never gets the lock can still be deleted
+    cpt_platform_task_allow_delete();
+    backoff->attempts ++;
+
+    switch (backoff->policy)
+    {
+        case CPT_YIELD_EVERY_N:
+            if (backoff->attempts % CPT_BACKOFF_YIELD_INTERVAL == 0)
+            {
+                cpt_backoff_yield(backoff);
+            }
+            break;
+
+        case CPT_YIELD_DELAY:
+            cpt_backoff_delay(backoff);
+            break;
+
+        case CPT_YIELD_BACKOFF:
+            cpt_backoff_pause(backoff, backoff->attempt_cycles);
+            backoff->attempt_cycles = backoff->attempt_cycles < CPT_BACKOFF_MAX_CYCLES / 2 ? backoff->attempt_cycles * 2 : CPT_BACKOFF_MAX_CYCLES;
+            break;
+
+        case CPT_YIELD_SPIN_THEN_BLOCK:
+            if (backoff->attempts >= CPT_BACKOFF_SPIN_LIMIT)
+            {
+                backoff->stats.block_count ++;
+                return true;
+            }
+            break;
+
+        default:
+            // Baseline and never: plain spinning
+            break;
+    }
+
+    return false;
+}
+
+/// @brief To be called once the lock is acquired, ends the current acquisition
+static inline void cpt_backoff_acquired(cpt_backoff * backoff)
+{
+    backoff->contended = backoff->attempts > 0;
+    backoff->stats.contended_count += backoff->contended ? 1 : 0;
+    backoff->attempts = 0;
+    backoff->attempt_cycles = CPT_BACKOFF_MIN_CYCLES;
+}
+
+/// @brief To be called by a worker after each batch, in place of a plain yield
+/// @param contended whether the lock was contended during the batch, false for the lock-free backends
+static inline void cpt_backoff_after_batch(cpt_backoff * backoff, bool contended)
+{
+    backoff->batch_count ++;
+
+    switch (backoff->policy)
+    {
+        case CPT_YIELD_BASELINE:
+            cpt_backoff_yield(backoff);
+            break;
+
+        case CPT_YIELD_EVERY_N:
+            if (backoff->batch_count % CPT_BACKOFF_YIELD_INTERVAL == 0)
+            {
+                cpt_backoff_yield(backoff);
+            }
+            break;
+
+        case CPT_YIELD_DELAY:
+            cpt_backoff_delay(backoff);
+            break;
+
+        case CPT_YIELD_BACKOFF:
+            // Gives the other waiters a growing head start while the lock stays contended
+            if (contended)
+            {
+                cpt_backoff_pause(backoff, backoff->batch_cycles);
+                backoff->batch_cycles = backoff->batch_cycles < CPT_BACKOFF_MAX_CYCLES / 2 ? backoff->batch_cycles * 2 : CPT_BACKOFF_MAX_CYCLES;
+            }
+            else
+            {
+                backoff->batch_cycles = CPT_BACKOFF_MIN_CYCLES;
+            }
+            break;
+
+        case CPT_YIELD_SPIN_THEN_BLOCK:
+            if (contended)
+            {
+                cpt_backoff_yield(backoff);
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+#endif //__CPT_BACKOFF_H__
\ No newline at end of file
@@ -21,26 +21,445 @@ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
 WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
+#include "cpt_globals.h"
 #include "cpt_coop.h"
+#include "cpt_utils.h"
+#include "cpt_stats.h"
+#include "esp_check.h"
 
-esp_err_t cpt_coop_init(cpt_coop * coop, cpt_job * job)
+#define TAG "coop"
+
+static void cpt_coop_task_function(void * parameters);
+
+/// @brief change the state for this object and notify waiting task (if set)
+/// @param new_state the state to set this cpt_coop object to
+/// @return esp_ok in case of success
+static esp_err_t cpt_coop_set_state(cpt_coop * coop, cpt_state new_state)
 {
-    * coop = (cpt_coop) {0};
+    ESP_LOGD(TAG, "Changing state from %d to %d", atomic_load(&coop->state), new_state);
+    // Set the state first
+    atomic_store(&coop->state, new_state);
+
+    // Then read the handle
+    volatile TaskHandle_t waiting_task_handle = atomic_load(&coop->waiting_task_handle);
+
+    // Notify task if necessary
+    if (waiting_task_handle != NULL)
+    {
+        xTaskNotifyGive(waiting_task_handle);
+    }
 
     return ESP_OK;
 }
 
+esp_err_t cpt_coop_wait_for_state_change(cpt_coop * coop, uint32_t max_wait_ms, cpt_state expected_state)
+{
+    TaskHandle_t this_task_handle = xTaskGetCurrentTaskHandle();
+    TaskHandle_t null_task_handle = NULL;
+    volatile cpt_state current_state = CPT_STATE_NONE;
+    uint32_t notification_value = 0;
+
+    // Set the wait handle first
+    bool valid = atomic_compare_exchange_strong(&coop->waiting_task_handle, &null_task_handle, this_task_handle);
+    ESP_RETURN_ON_FALSE(valid, ESP_ERR_INVALID_STATE, TAG, "Handle already set");
+
+    while (current_state != expected_state)
+    {
+        // Read the state after setting the handle: this fixes races
+        current_state = atomic_load(&coop->state);
+
+        if (current_state != expected_state)
+        {
+            notification_value = ulTaskNotifyTake(pdTRUE, max_wait_ms == CPT_WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(max_wait_ms));
+            if (notification_value == 0)
+            {
+                break;
+            }
+        }
+    }
+
+    atomic_store(&coop->waiting_task_handle, NULL);
+
+    return current_state == expected_state ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+_Static_assert((CPT_COOP_DEQUE_SIZE & (CPT_COOP_DEQUE_SIZE - 1)) == 0, "CPT_COOP_DEQUE_SIZE must be a power of 2");
+_Static_assert(CPT_COOP_DEQUE_SIZE > CPT_MAX_CONCURRENCY_COUNT, "CPT_COOP_DEQUE_SIZE too small for CPT_MAX_CONCURRENCY_COUNT");
+
+// Deque operations follow "Correct and Efficient Work-Stealing for Weak Memory Models" (Le et al.). Indexes wrap
+// around, they're compared through their signed difference
+
+// Called by the owner scheduler only
+static inline void cpt_coop_deque_push(cpt_coop_deque * deque, uint16_t fsm_index)
+{
+    uint32_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+    atomic_store_explicit(&deque->entries[bottom & (CPT_COOP_DEQUE_SIZE - 1)], fsm_index, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+}
+
+// Called by the owner scheduler only. Returns -1 if the deque is empty
+static inline int cpt_coop_deque_pop(cpt_coop_deque * deque)
+{
+    uint32_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+    int fsm_index = -1;
+
+    // Claim the bottom entry before looking at top, so that a thief either sees the claim or is seen by the owner
+    atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    uint32_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+    if ((int32_t) (bottom - top) >= 0)
+    {
+        fsm_index = atomic_load_explicit(&deque->entries[bottom & (CPT_COOP_DEQUE_SIZE - 1)], memory_order_relaxed);
+
+        if (bottom != top)
+        {
+            return fsm_index;
+        }
+
+        // Last entry: a thief may be taking it too, whoever moves top first gets it
+        if (! atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+        {
+            fsm_index = -1;
+        }
+    }
+
+    // The deque is empty now, either way
+    atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+    return fsm_index;
+}
+
+// Called by thieves. Returns -1 if the deque is empty
+static inline int cpt_coop_deque_steal(cpt_coop_deque * deque)
+{
+    uint32_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    while ((int32_t) (atomic_load_explicit(&deque->bottom, memory_order_acquire) - top) > 0)
+    {
+        uint16_t fsm_index = atomic_load_explicit(&deque->entries[top & (CPT_COOP_DEQUE_SIZE - 1)], memory_order_relaxed);
+
+        // On failure top is reloaded and the entry read again, as it may have been taken in the meantime
+        if (atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+        {
+            return fsm_index;
+        }
+
+        atomic_thread_fence(memory_order_seq_cst);
+    }
+
+    return -1;
+}
+
+esp_err_t cpt_coop_init(cpt_coop * coop, cpt_job * job, const cpt_config * config)
+{
+    * coop = (cpt_coop) {0};
+    esp_err_t ret = ESP_OK;
+
+    ret = cpt_config_validate(config);
+    ESP_GOTO_ON_ERROR(ret, exit, TAG, "Invalid configuration");
+
+    coop->job = job;
+    coop->fsm_count = config->concurrency;
+    coop->scheduler_count = cpt_config_get_scheduler_count(config);
+    portMUX_INITIALIZE(&coop->job_spinlock);
+
+    ret = cpt_coop_set_state(coop, CPT_STATE_INITIALIZING);
+    ESP_GOTO_ON_ERROR(ret, exit, TAG, "Error setting state: %s", esp_err_to_name(ret));
+
+    // Split the job evenly across fsms, and the fsms evenly across schedulers. Tasks aren't running yet so
+    // there's no need to synchronize here.
+    for (int i = 0; i < coop->fsm_count; i ++)
+    {
+        coop->fsms[i] = (cpt_coop_fsm) {
+            .state = CPT_FSM_STATE_A,
+            .remaining = CPT_JOB_MAX_COUNT / coop->fsm_count + (i < CPT_JOB_MAX_COUNT % coop->fsm_count ? 1 : 0),
+        };
+        cpt_job_worker_init(&coop->fsms[i].job_worker, i);
+        cpt_coop_deque_push(&coop->schedulers[i % coop->scheduler_count].deque, i);
+    }
+
+    atomic_store(&coop->active_fsms_count, coop->fsm_count);
+    atomic_store(&coop->running_schedulers_count, coop->scheduler_count);
+
+    for (uint8_t scheduler_index = 0; scheduler_index < coop->scheduler_count; scheduler_index ++)
+    {
+        cpt_coop_scheduler * scheduler = &coop->schedulers[scheduler_index];
+
+        if (coop->scheduler_count == 1)
+        {
+            scheduler->job = job;
+        }
+        else
+        {
+            ret = cpt_job_init(&scheduler->partial_job, config);
+            ESP_GOTO_ON_ERROR(ret, exit, TAG, "Unable to initialize partial job %d", scheduler_index);
+            scheduler->job = &scheduler->partial_job;
+        }
+
+        ret = cpt_pool_acquire(cpt_affinity_get_core(config->affinity, scheduler_index), config->priority, &scheduler->worker);
+        ESP_GOTO_ON_ERROR(ret, exit, TAG, "Unable to get a worker for scheduler %d", scheduler_index);
+
+        cpt_pool_start(scheduler->worker, cpt_coop_task_function, coop);
+    }
+
+    ESP_LOGI(TAG, "%d schedulers initialized with %d fsms, priority: %d affinity: %s",
+        coop->scheduler_count,
+        coop->fsm_count,
+        config->priority,
+        cpt_affinity_to_name(config->affinity));
+
+    exit:
+    if (ret != ESP_OK)
+    {
+        cpt_coop_uninit(coop);
+    }
+
+    return ret;
+}
+
 void cpt_coop_uninit(cpt_coop * coop)
 {
-    (void)coop;
+    ESP_LOGI(TAG, "uninitializing");
+
+    for (int i = 0; i < coop->scheduler_count; i ++)
+    {
+        if (coop->schedulers[i].worker != NULL)
+        {
+            cpt_pool_release(coop->schedulers[i].worker);
+        }
+
+        cpt_job_uninit(&coop->schedulers[i].partial_job);
+    }
+
+    * coop = (cpt_coop) {0};
+}
+
+// Returns the index of the calling scheduler, -1 if the task wasn't found
+static int8_t cpt_coop_get_current_scheduler_index(cpt_coop * coop)
+{
+    TaskHandle_t handle = xTaskGetCurrentTaskHandle();
+
+    for (int8_t i = 0; i < coop->scheduler_count; i ++)
+    {
+        if (coop->schedulers[i].worker != NULL && coop->schedulers[i].worker->handle == handle)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/// @brief Advance a sub-fsm by one step
+/// @return true if the fsm is done (no more steps to run)
+static inline bool cpt_coop_fsm_step(cpt_coop_fsm * fsm, cpt_job * job)
+{
+    switch (fsm->state)
+    {
+        case CPT_FSM_STATE_A:
+            // No lock here: a job is only ever touched by a single scheduler
+            if (fsm->remaining == 0 || cpt_job_run(job) == CPT_JOB_DONE)
+            {
+                fsm->state = CPT_FSM_STATE_NONE;
+            }
+            else
+            {
+                fsm->remaining --;
+                fsm->state = CPT_FSM_STATE_B;
+            }
+            break;
+
+        case CPT_FSM_STATE_B:
+            fsm->counter ++;
+            cpt_job_run_private(job, &fsm->job_worker);
+            fsm->state = CPT_FSM_STATE_A;
+            break;
+
+        default:
+            break;
+    }
+
+    return fsm->state == CPT_FSM_STATE_NONE;
+}
+
+// Looks for an fsm in the other schedulers' deques. Returns -1 if there was nothing to steal
+static int cpt_coop_steal(cpt_coop * coop, uint8_t thief_index)
+{
+    for (uint8_t i = 1; i < coop->scheduler_count; i ++)
+    {
+        int fsm_index = cpt_coop_deque_steal(&coop->schedulers[(thief_index + i) % coop->scheduler_count].deque);
+        if (fsm_index >= 0)
+        {
+            coop->schedulers[thief_index].steals ++;
+            return fsm_index;
+        }
+    }
+
+    return -1;
+}
+
+// Each scheduler task takes fsms from its own deque, runs a slice of steps on them then pushes them back, until
+// all fsms are done. When its deque is empty it steals from the others. Like the preemptive tasks, schedulers
+// signal initialization then wait for run_job to start the test, so that initialization time is removed from
+// the perf measurement.
+static void cpt_coop_task_function(void * parameters)
+{
+    cpt_coop * coop = (cpt_coop *) parameters;
+    int8_t scheduler_index = cpt_coop_get_current_scheduler_index(coop);
+
+    if (scheduler_index == -1)
+    {
+        ESP_LOGE(TAG, "Scheduler not found in array, terminating task");
+        return;
+    }
+
+    cpt_coop_scheduler * scheduler = &coop->schedulers[scheduler_index];
+
+    if (atomic_fetch_add(&coop->initialized_schedulers_count, 1) == coop->scheduler_count - 1)
+    {
+        cpt_coop_set_state(coop, CPT_STATE_INITIALIZED);
+    }
+
+    // Wait for run_job. A notification given before reaching this point stays pending, so there's no race
+    ESP_LOGD(TAG, "scheduler %d waiting for start", scheduler_index);
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+    ESP_LOGD(TAG, "scheduler %d started", scheduler_index);
+
+    while (atomic_load_explicit(&coop->active_fsms_count, memory_order_relaxed) > 0)
+    {
+        int fsm_index = cpt_coop_deque_pop(&scheduler->deque);
+
+        if (fsm_index < 0)
+        {
+            fsm_index = cpt_coop_steal(coop, scheduler_index);
+        }
+
+        if (fsm_index < 0)
+        {
+            // Nothing to run: the remaining fsms are being run by other schedulers
+            taskYIELD();
+            continue;
+        }
+
+        cpt_coop_fsm * fsm = &coop->fsms[fsm_index];
+        bool fsm_done = false;
+
+        for (int step = 0; step < CPT_COOP_SLICE_STEPS && ! fsm_done; step ++)
+        {
+            fsm_done = cpt_coop_fsm_step(fsm, scheduler->job);
+        }
+
+        scheduler->slices ++;
+
+        if (fsm_done)
+        {
+            atomic_fetch_sub(&coop->active_fsms_count, 1);
+        }
+        else
+        {
+            cpt_coop_deque_push(&scheduler->deque, fsm_index);
+        }
+    }
+
+    // The only access to shared state: aggregate the partial job
+    if (scheduler->job != coop->job)
+    {
+        taskENTER_CRITICAL(&coop->job_spinlock);
+        cpt_job_merge(coop->job, scheduler->job);
+        taskEXIT_CRITICAL(&coop->job_spinlock);
+    }
+
+    // signal that we're done
+    if (atomic_fetch_sub(&coop->running_schedulers_count, 1) == 1)
+    {
+        cpt_coop_set_state(coop, CPT_STATE_DONE);
+    }
+
+    // Returning parks the worker until the pool hands it to the next run
 }
 
 esp_err_t cpt_coop_run_job(cpt_coop * coop)
 {
+    ESP_LOGI(TAG, "Starting job");
+
+    // Wait for all scheduler tasks to be initialized
+    esp_err_t ret = cpt_coop_wait_for_state_change(coop, CPT_WAIT_FOREVER, CPT_STATE_INITIALIZED);
+    ESP_RETURN_ON_ERROR(ret, TAG, "Error waiting for initialization: %s", esp_err_to_name(ret));
+
+    cpt_coop_set_state(coop, CPT_STATE_RUNNING);
+
+    // Time measurement should begin here
+    for (int i = 0; i < coop->scheduler_count; i ++)
+    {
+        xTaskNotifyGive(coop->schedulers[i].worker->handle);
+    }
+
     return ESP_OK;
 }
 
-esp_err_t cpt_coop_wait_for_time(cpt_coop * coop, uint16_t time_ms)
+void cpt_coop_log_report(cpt_coop * coop)
 {
-    return ESP_OK;
+    double shares[CPT_MAX_CONCURRENCY_COUNT];
+    cpt_stats_fairness fairness;
+
+    ESP_LOGI(TAG, "==== Job share ====");
+
+    for (int i = 0; i < coop->fsm_count; i ++)
+    {
+        shares[i] = coop->fsms[i].counter;
+        ESP_LOGI(TAG, "fsm %d iterations: %lu", i, coop->fsms[i].counter);
+    }
+
+    cpt_stats_get_fairness(shares, coop->fsm_count, &fairness);
+    ESP_LOGI(TAG, "Jain's index: %.4f min/max: %.4f coefficient of variation: %.4f",
+        fairness.jain_index,
+        fairness.min_max_ratio,
+        fairness.coefficient_of_variation);
+
+    for (int i = 0; i < coop->scheduler_count; i ++)
+    {
+        ESP_LOGI(TAG, "scheduler %d slices: %lu steals: %lu", i, coop->schedulers[i].slices, coop->schedulers[i].steals);
+    }
+}
+
+static void cpt_coop_engine_log_report(void * engine)
+{
+    cpt_coop_log_report((cpt_coop *) engine);
+}
+
+static esp_err_t cpt_coop_engine_init(void * engine, cpt_job * job, const cpt_config * config)
+{
+    return cpt_coop_init((cpt_coop *) engine, job, config);
+}
+
+static void cpt_coop_engine_uninit(void * engine)
+{
+    cpt_coop_uninit((cpt_coop *) engine);
+}
+
+static esp_err_t cpt_coop_engine_run_job(void * engine)
+{
+    return cpt_coop_run_job((cpt_coop *) engine);
+}
+
+static esp_err_t cpt_coop_engine_wait_for_state_change(void * engine, uint32_t max_wait_ms, cpt_state state)
+{
+    return cpt_coop_wait_for_state_change((cpt_coop *) engine, max_wait_ms, state);
+}
+
+static const cpt_engine cpt_coop_engine = {
+    .name = "coop",
+    .engine_size = sizeof(cpt_coop),
+    .init = cpt_coop_engine_init,
+    .uninit = cpt_coop_engine_uninit,
+    .run_job = cpt_coop_engine_run_job,
+    .wait_for_state_change = cpt_coop_engine_wait_for_state_change,
+    .log_report = cpt_coop_engine_log_report,
+};
+
+esp_err_t cpt_coop_register()
+{
+    return cpt_engine_register(&cpt_coop_engine);
 }
\ No newline at end of file
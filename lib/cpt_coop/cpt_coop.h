@@ -24,9 +24,26 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #ifndef __CPT_COOP_H__
 #define __CPT_COOP_H__
 
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_err.h"
+#include "esp_log.h"
+#include "stdatomic.h"
+
 #include "cpt_globals.h"
+#include "cpt_engine.h"
 #include "cpt_job.h"
+#include "cpt_pool.h"
+
+// Number of steps a scheduler runs on an fsm before putting it back in its deque. Deque operations (and the
+// chance for other schedulers to steal the fsm) only happen at slice boundaries
+#define CPT_COOP_SLICE_STEPS (8)
+
+// Capacity of a scheduler deque, must be a power of 2 and larger than CPT_MAX_CONCURRENCY_COUNT
+#define CPT_COOP_DEQUE_SIZE (64)
 
+/// @brief States for the cooperative sub-fsms. In state A the fsm runs an iteration of the job, in state B it
+/// does its bookkeeping and the private part of the workload before handing the CPU to the next fsm. NONE means the fsm is done.
 typedef enum
 {
     CPT_FSM_STATE_NONE,
@@ -35,18 +52,84 @@ typedef enum
     CPT_FSM_STATE_COUNT
 } cpt_coop_state;
 
+/// @brief A sub-fsm in the cooperative test. It's the cooperative counterpart of cpt_preempt_task
 typedef struct
 {
-    unsigned long counters[CPT_TASK_COUNT];
     cpt_coop_state state;
+    uint32_t remaining; // Iterations of the job left to this fsm: the job is split evenly across fsms
+    unsigned long counter; // Counts how many times this fsm had a chance to run a job
+    cpt_job_worker job_worker; // State for the private part of the workload
+} cpt_coop_fsm;
+
+/// @brief Bounded Chase-Lev deque of fsm indexes. The owner scheduler pushes and pops at the bottom with plain loads
+/// and stores, and only needs a compare and swap when racing a thief for the last fsm. Thieves take from the top,
+/// the least recently run fsm. The owner keeps running its most recently run fsm, the others wait for it to be done
+/// or to be stolen. The deque is never full as each fsm is in one deque at most.
+typedef struct
+{
+    volatile _Atomic uint32_t top;
+    volatile _Atomic uint32_t bottom;
+    volatile _Atomic uint16_t entries[CPT_COOP_DEQUE_SIZE];
+} cpt_coop_deque;
+
+/// @brief Structure handling a scheduler task in the cooperative test
+typedef struct
+{
+    cpt_pool_worker * worker; // Pool worker running the scheduler
+    cpt_coop_deque deque; // fsms owned by this scheduler
+
+    // The job the scheduler runs its fsms on. With a single scheduler this is the shared job, otherwise it's the
+    // private partial_job, merged into the shared one when the scheduler is done.
     cpt_job * job;
+    cpt_job partial_job;
+
+    unsigned long slices; // Count of slices run by this scheduler
+    unsigned long steals; // Count of fsms taken from other schedulers
+} cpt_coop_scheduler;
+
+/// @brief Structure holding state for a cooperative test
+typedef struct
+{
+    cpt_coop_fsm fsms[CPT_MAX_CONCURRENCY_COUNT];
+    uint8_t fsm_count; // Number of fsms used in fsms
+    cpt_coop_scheduler schedulers[CPT_MAX_SCHEDULER_COUNT];
+    uint8_t scheduler_count; // Number of schedulers used in schedulers
+
+    atomic_uint_fast8_t initialized_schedulers_count; // Used to determine when all schedulers are initialized
+    atomic_uint_fast8_t running_schedulers_count; // Used to determine when the last scheduler is done
+    atomic_uint_fast16_t active_fsms_count; // Schedulers keep looking for fsms to steal while this is not 0
+
+    cpt_job * job; // Only touched when aggregating the partial jobs at the end of the test
+    portMUX_TYPE job_spinlock; // Protects the aggregation into job
+
+    volatile _Atomic cpt_state state; // The state of this coop object
+    // An event is generated at each significant state change. Currently when the scheduler tasks are initialized, and when the job is completed.
+    volatile _Atomic TaskHandle_t waiting_task_handle; // Handle for a task waiting for the next event
 } cpt_coop;
 
-esp_err_t cpt_coop_init(cpt_coop * coop, cpt_job * job);
+// Initializes all structures and the scheduler tasks necessary to run the test. Schedulers will wait
+// for the run_job function to be called before stepping through the fsms.
+// The number of fsms and of schedulers, and the schedulers priority and affinity are taken from config. With several
+// schedulers each owns a deque of fsms and steals from the others when it runs dry. Schedulers don't lock the job.
+esp_err_t cpt_coop_init(cpt_coop * coop, cpt_job * job, const cpt_config * config);
 void cpt_coop_uninit(cpt_coop * coop);
 
+// Starts the execution of the job scheduled for this coop object
+// This call is not blocking
 esp_err_t cpt_coop_run_job(cpt_coop * coop);
-esp_err_t cpt_coop_wait_for_time(cpt_coop * coop, uint16_t time_ms);
+
+/// @brief Logs how the job was shared across fsms and schedulers. To be called once the job is done
+void cpt_coop_log_report(cpt_coop * coop);
+
+/// @brief Block caller thread until the next state change.
+/// @details Same semantics as cpt_preempt_wait_for_state_change
+/// @param max_wait_ms the maximum wait time in ms, CPT_WAIT_FOREVER to never timeout
+/// @param state the state to wait for
+/// @return ESP_OK in case of success, ESP_ERROR_TIMEOUT if the maximum time was reached.
+esp_err_t cpt_coop_wait_for_state_change(cpt_coop * coop, uint32_t max_wait_ms, cpt_state state);
+
+/// @brief Adds the cooperative engine to the engine registry, under the name "coop"
+esp_err_t cpt_coop_register();
 
 #endif //__CPT_COOP_H__
 
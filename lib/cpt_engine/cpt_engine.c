@@ -0,0 +1,210 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "esp_check.h"
+#include "esp_log.h"
+
+#include "cpt_engine.h"
+#include "cpt_utils.h"
+
+#define TAG "engine"
+
+static const cpt_engine * cpt_engines[CPT_ENGINE_MAX_COUNT];
+static size_t cpt_engines_count;
+
+esp_err_t cpt_engine_register(const cpt_engine * engine)
+{
+    ESP_RETURN_ON_FALSE(cpt_engines_count < CPT_ENGINE_MAX_COUNT, ESP_ERR_NO_MEM, TAG, "Registry full, can't add %s", engine->name);
+
+    cpt_engines[cpt_engines_count ++] = engine;
+    ESP_LOGD(TAG, "Registered %s", engine->name);
+
+    return ESP_OK;
+}
+
+size_t cpt_engine_get_count()
+{
+    return cpt_engines_count;
+}
+
+const cpt_engine * cpt_engine_get(size_t index)
+{
+    return index < cpt_engines_count ? cpt_engines[index] : NULL;
+}
+
+const cpt_engine * cpt_engine_find(const char * name)
+{
+    for (size_t i = 0; i < cpt_engines_count; i ++)
+    {
+        if (strcmp(cpt_engines[i]->name, name) == 0)
+        {
+            return cpt_engines[i];
+        }
+    }
+
+    return NULL;
+}
+
+// Sums up the memory taken by the run, and logs it. Tasks created during init took heap too, which is counted with the
+// stacks and control blocks rather than in the heap taken by the engine
+static void cpt_engine_fill_footprint(const cpt_engine * engine, const cpt_platform_heap_stats * heap_before,
+    const cpt_platform_heap_stats * heap_after, cpt_engine_result * result)
+{
+    cpt_engine_footprint * footprint = &result->footprint;
+    size_t heap_bytes = heap_after->allocated_bytes - heap_before->allocated_bytes;
+
+    footprint->heap_bytes = heap_bytes > footprint->tasks.created_heap_bytes ? heap_bytes - footprint->tasks.created_heap_bytes : 0;
+    footprint->bytes_per_worker = (double) (footprint->heap_bytes + footprint->tasks.stack_bytes + footprint->tasks.control_block_bytes) /
+        result->worker_count;
+
+    ESP_LOGI(TAG, "==== Footprint of %s ====", engine->name);
+    ESP_LOGI(TAG, "%"PRIu32" workers, tasks: %d (%d created), stacks: %"PRIu32" bytes, control blocks: %zu bytes, engine heap: %zu bytes",
+        result->worker_count,
+        footprint->tasks.worker_count,
+        footprint->tasks.created_count,
+        footprint->tasks.stack_bytes,
+        footprint->tasks.control_block_bytes,
+        footprint->heap_bytes);
+
+    if (footprint->tasks.max_stack_used > 0)
+    {
+        ESP_LOGI(TAG, "Bytes per worker: %.1f, deepest stack use: %"PRIu32" bytes, fitted stack (%d%% margin): %"PRIu32" bytes",
+            footprint->bytes_per_worker,
+            footprint->tasks.max_stack_used,
+            CPT_POOL_STACK_SAFETY_MARGIN,
+            cpt_pool_get_fitted_stack_size(footprint->tasks.max_stack_used));
+    }
+    else
+    {
+        ESP_LOGI(TAG, "Bytes per worker: %.1f, stack use not measured", footprint->bytes_per_worker);
+    }
+}
+
+esp_err_t cpt_engine_run(const cpt_engine * engine, const cpt_config * config, cpt_engine_result * result)
+{
+    esp_err_t ret = ESP_OK;
+    cpt_job job = {0};
+    void * instance = NULL;
+    bool initialized = false;
+    cpt_platform_heap_stats heap_before = {0};
+    cpt_platform_heap_stats heap_after = {0};
+#if CPT_ENGINE_ENABLE_SAMPLER
+    cpt_sampler sampler = {0};
+#endif //CPT_ENGINE_ENABLE_SAMPLER
+
+    * result = (cpt_engine_result) {
+        .worker_count = config->concurrency,
+    };
+
+    ESP_LOGI(TAG, "==== Running %s ====", engine->name);
+
+    ret = cpt_job_init(&job, config);
+    ESP_GOTO_ON_ERROR(ret, exit, TAG, "Unable to initialize the job: %s", esp_err_to_name(ret));
+
+    // The job is shared by all engines, its buffers aren't part of the footprint
+    cpt_pool_footprint_begin();
+    cpt_platform_get_heap_stats(&heap_before);
+
+    // Engine objects are allocated for the run only, so that all runs start from the same heap conditions
+    instance = calloc(1, engine->engine_size);
+    ESP_GOTO_ON_FALSE(instance != NULL, ESP_ERR_NO_MEM, exit, TAG, "Unable to allocate %s", engine->name);
+
+    // Engines clean up after themselves if init fails
+    ret = engine->init(instance, &job, config);
+    ESP_GOTO_ON_ERROR(ret, exit, TAG, "Unable to initialize %s: %s", engine->name, esp_err_to_name(ret));
+    initialized = true;
+
+    cpt_platform_get_heap_stats(&heap_after);
+
+#if CPT_ENGINE_ENABLE_SAMPLER
+    // The workers exist but wait for the start: the first interval shows the baseline. Not fatal, the run is still valid
+    if (cpt_sampler_start(&sampler, CPT_SAMPLER_INTERVAL_MS) != ESP_OK)
+    {
+        ESP_LOGW(TAG, "Running without the sampler");
+    }
+#endif //CPT_ENGINE_ENABLE_SAMPLER
+
+    ret = engine->run_job(instance);
+    ESP_GOTO_ON_ERROR(ret, exit, TAG, "Unable to run %s: %s", engine->name, esp_err_to_name(ret));
+
+#if CPT_FREQUENT_SYSTEM_STATUS_REPORT
+    cpt_log_system_status("Status prior starting test");
+#endif //CPT_FREQUENT_SYSTEM_STATUS_REPORT
+
+    ESP_LOGI(TAG, "Starting test");
+
+    uint64_t start_time = cpt_get_current_time_us();
+    ret = engine->wait_for_state_change(instance, CPT_WAIT_FOREVER, CPT_STATE_DONE);
+    result->duration_us = cpt_get_current_time_us() - start_time;
+    result->job_status = cpt_job_get_status(&job);
+
+#if CPT_ENGINE_ENABLE_SAMPLER
+    cpt_sampler_stop(&sampler);
+#endif //CPT_ENGINE_ENABLE_SAMPLER
+
+    if (engine->fill_result != NULL)
+    {
+        engine->fill_result(instance, result);
+    }
+
+    if (engine->log_report != NULL)
+    {
+        engine->log_report(instance);
+    }
+
+#if CPT_ENGINE_ENABLE_SAMPLER
+    cpt_sampler_log_report(&sampler);
+#endif //CPT_ENGINE_ENABLE_SAMPLER
+
+#if CPT_FREQUENT_SYSTEM_STATUS_REPORT
+    cpt_log_system_status("Test completed");
+#endif //CPT_FREQUENT_SYSTEM_STATUS_REPORT
+
+    exit:
+    result->ret = ret;
+
+#if CPT_ENGINE_ENABLE_SAMPLER
+    cpt_sampler_uninit(&sampler);
+#endif //CPT_ENGINE_ENABLE_SAMPLER
+
+    if (initialized)
+    {
+        engine->uninit(instance);
+    }
+
+    // Workers are parked once released, their stacks can be measured
+    cpt_pool_footprint_end(&result->footprint.tasks);
+
+    if (ret == ESP_OK)
+    {
+        cpt_engine_fill_footprint(engine, &heap_before, &heap_after, result);
+    }
+
+    cpt_job_uninit(&job);
+    free(instance);
+
+    return ret;
+}
\ No newline at end of file
@@ -0,0 +1,107 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __CPT_ENGINE_H__
+#define __CPT_ENGINE_H__
+
+#include "esp_err.h"
+
+#include "cpt_globals.h"
+#include "cpt_job.h"
+#include "cpt_pool.h"
+#include "cpt_sampler.h"
+
+// Maximum number of engines that can be registered
+#define CPT_ENGINE_MAX_COUNT (8)
+
+// Sample the CPU usage and the heap while each test runs, and log the time series after it. See cpt_sampler.h
+#define CPT_ENGINE_ENABLE_SAMPLER (0)
+
+/// @brief Memory taken by a run: the heap taken by the engine, measured around its allocation and init, and the pool
+/// workers it used
+typedef struct
+{
+    size_t heap_bytes; // Engine object and init allocations, not counting the tasks created by the pool
+    cpt_pool_footprint tasks; // Pool workers used by the engine
+    double bytes_per_worker; // Heap, stacks and task control blocks divided by the number of concurrent workers
+} cpt_engine_footprint;
+
+/// @brief Outcome of a test run on an engine
+typedef struct
+{
+    esp_err_t ret; // Return value of the run
+    uint64_t duration_us; // Time between the start of the job and its completion
+    cpt_job_status job_status; // Status of the job at the end of the run
+    uint32_t max_lock_wait_us; // Longest time a worker waited for the job lock, 0 if not applicable
+    uint32_t worker_count; // Concurrent workers: the config concurrency, unless the engine runs more on its tasks
+    cpt_engine_footprint footprint; // Memory taken by the run, once it's uninitialized
+} cpt_engine_result;
+
+/// @brief An engine is an implementation of the test (preemptive, cooperative...). Each engine provides this
+/// table of functions, all taking a pointer to its own object (of engine_size bytes) as first parameter.
+typedef struct
+{
+    const char * name;
+    size_t engine_size;
+
+    // Initializes all structures and tasks necessary to run the test
+    esp_err_t (* init)(void * engine, cpt_job * job, const cpt_config * config);
+    void (* uninit)(void * engine);
+
+    // Starts the execution of the job. Not blocking
+    esp_err_t (* run_job)(void * engine);
+
+    // Blocks the caller until the engine reaches state, see cpt_preempt_wait_for_state_change
+    esp_err_t (* wait_for_state_change)(void * engine, uint32_t max_wait_ms, cpt_state state);
+
+    // Optional, logs the engine specific results once the job is done
+    void (* log_report)(void * engine);
+
+    // Optional, adds the engine specific metrics to the result of a run once the job is done
+    void (* fill_result)(void * engine, cpt_engine_result * result);
+} cpt_engine;
+
+/// @brief Adds an engine to the registry. Engines usually provide a *_register function calling this.
+/// @return ESP_OK, ESP_ERR_NO_MEM if the registry is full
+esp_err_t cpt_engine_register(const cpt_engine * engine);
+
+/// @brief gets the number of registered engines
+size_t cpt_engine_get_count();
+
+/// @brief gets a registered engine by registration order
+/// @return the engine, NULL if index is out of range
+const cpt_engine * cpt_engine_get(size_t index);
+
+/// @brief gets a registered engine by name
+/// @return the engine, NULL if not found
+const cpt_engine * cpt_engine_find(const char * name);
+
+/// @brief Runs a full test on an engine: allocates and initializes it on a new job, runs the job, waits for it
+/// to be done and uninitializes it. Initialization time is not part of the measured duration. Logs the memory the
+/// engine took per worker, and the stack size fitting the deepest stack use of its workers.
+/// @param result filled with the outcome of the run
+/// @return ESP_OK or an error code, also stored in result
+esp_err_t cpt_engine_run(const cpt_engine * engine, const cpt_config * config, cpt_engine_result * result);
+
+#endif //__CPT_ENGINE_H__
+
@@ -0,0 +1,87 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "cpt_histogram.h"
+
+void cpt_histogram_reset(cpt_histogram * histogram)
+{
+    * histogram = (cpt_histogram) {0};
+}
+
+void cpt_histogram_merge(cpt_histogram * histogram, const cpt_histogram * source)
+{
+    for (uint32_t i = 0; i < CPT_HISTOGRAM_BUCKET_COUNT; i ++)
+    {
+        histogram->counts[i] += source->counts[i];
+    }
+
+    histogram->total_count += source->total_count;
+
+    if (source->max > histogram->max)
+    {
+        histogram->max = source->max;
+    }
+}
+
+// Highest value recorded in a bucket
+static uint32_t cpt_histogram_get_bucket_upper_bound(uint32_t index)
+{
+    if (index < 2 * CPT_HISTOGRAM_SUB_BUCKET_COUNT)
+    {
+        // The first two groups have a resolution of 1
+        return index;
+    }
+
+    uint32_t shift = index / CPT_HISTOGRAM_SUB_BUCKET_COUNT - 1;
+    uint32_t lower_bound = (CPT_HISTOGRAM_SUB_BUCKET_COUNT + index % CPT_HISTOGRAM_SUB_BUCKET_COUNT) << shift;
+
+    return lower_bound + ((1u << shift) - 1);
+}
+
+uint32_t cpt_histogram_get_percentile(const cpt_histogram * histogram, double percentile)
+{
+    if (histogram->total_count == 0)
+    {
+        return 0;
+    }
+
+    // Rank of the value at percentile, at least 1 so that percentile 0 returns the minimum
+    uint64_t rank = (uint64_t)(percentile / 100.0 * histogram->total_count + 0.5);
+    rank = rank == 0 ? 1 : rank;
+
+    uint64_t cumulative_count = 0;
+
+    for (uint32_t i = 0; i < CPT_HISTOGRAM_BUCKET_COUNT; i ++)
+    {
+        cumulative_count += histogram->counts[i];
+
+        if (cumulative_count >= rank)
+        {
+            uint32_t upper_bound = cpt_histogram_get_bucket_upper_bound(i);
+            // The max is exact, don't report values above it
+            return upper_bound < histogram->max ? upper_bound : histogram->max;
+        }
+    }
+
+    return histogram->max;
+}
\ No newline at end of file
@@ -0,0 +1,80 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __CPT_HISTOGRAM_H__
+#define __CPT_HISTOGRAM_H__
+
+#include <inttypes.h>
+
+// Log-bucketed histogram in the style of HdrHistogram: values are grouped by power of 2, and each group is split in
+// 2^CPT_HISTOGRAM_SUB_BUCKET_BITS linear sub-buckets. With 3 bits values are recorded with a precision of 12.5%,
+// small values (below the sub-bucket count) are exact.
+#define CPT_HISTOGRAM_SUB_BUCKET_BITS (3)
+#define CPT_HISTOGRAM_SUB_BUCKET_COUNT (1 << CPT_HISTOGRAM_SUB_BUCKET_BITS)
+#define CPT_HISTOGRAM_BUCKET_COUNT ((32 - CPT_HISTOGRAM_SUB_BUCKET_BITS + 1) * CPT_HISTOGRAM_SUB_BUCKET_COUNT)
+
+/// @brief Histogram of 32 bits values (e.g. cycle counts). Not thread safe: meant to be owned by a single task
+typedef struct
+{
+    uint32_t counts[CPT_HISTOGRAM_BUCKET_COUNT];
+    uint32_t total_count;
+    uint32_t max;
+} cpt_histogram;
+
+void cpt_histogram_reset(cpt_histogram * histogram);
+
+static inline uint32_t cpt_histogram_get_bucket_index(uint32_t value)
+{
+    if (value < CPT_HISTOGRAM_SUB_BUCKET_COUNT)
+    {
+        return value;
+    }
+
+    uint32_t magnitude = 31 - __builtin_clz(value); // Position of the most significant bit (NSAU on Xtensa)
+    uint32_t shift = magnitude - CPT_HISTOGRAM_SUB_BUCKET_BITS;
+
+    return (shift + 1) * CPT_HISTOGRAM_SUB_BUCKET_COUNT + ((value >> shift) & (CPT_HISTOGRAM_SUB_BUCKET_COUNT - 1));
+}
+
+/// @brief Records a value. Inlined as it's meant to be called in hot paths
+static inline void cpt_histogram_record(cpt_histogram * histogram, uint32_t value)
+{
+    histogram->counts[cpt_histogram_get_bucket_index(value)] ++;
+    histogram->total_count ++;
+
+    if (value > histogram->max)
+    {
+        histogram->max = value;
+    }
+}
+
+/// @brief Adds all values recorded in source to histogram
+void cpt_histogram_merge(cpt_histogram * histogram, const cpt_histogram * source);
+
+/// @brief gets the value at a percentile
+/// @param percentile between 0 and 100
+/// @return the highest value equivalent (same bucket) to the value at percentile, 0 if the histogram is empty
+uint32_t cpt_histogram_get_percentile(const cpt_histogram * histogram, double percentile);
+
+#endif //__CPT_HISTOGRAM_H__
+
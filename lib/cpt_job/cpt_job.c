@@ -24,20 +24,113 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <cpt_job.h>
 #include "esp_err.h"
 #include "esp_log.h"
+#include "esp_check.h"
+#include "cpt_platform.h"
+#include <string.h>
 
 #define TAG "cpt_job"
 
-#define CPT_JOB_MAX_COUNT (500 * 1000)
+_Static_assert(CPT_JOB_MAX_COUNT < UINT32_MAX, "CPT_JOB_MAX_COUNT doesn't fit the 32 bits atomic view");
+_Static_assert(__BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__, "The 32 bits atomic view requires a little endian target");
+_Static_assert(CPT_JOB_BUFFER_SIZE % (CPT_JOB_STRIDE * CPT_MAX_CONCURRENCY_COUNT) == 0, "Workers' walks must start on a stride boundary");
 
-esp_err_t cpt_job_init(cpt_job * job)
+#if CPT_JOB_BUFFER_IN_PSRAM
+#define CPT_JOB_BUFFER_MEMORY (CPT_PLATFORM_MEMORY_EXTERNAL)
+#else
+#define CPT_JOB_BUFFER_MEMORY (CPT_PLATFORM_MEMORY_INTERNAL)
+#endif
+
+esp_err_t cpt_job_init(cpt_job * job, const cpt_config * config)
 {
+    esp_err_t ret = ESP_OK;
+
     * job = (cpt_job) {0};
-    return ESP_OK;
+    job->workload = config->workload;
+    job->critical_size = config->critical_size;
+    job->private_size = config->private_size;
+
+    switch (job->workload)
+    {
+        case CPT_WORKLOAD_CRC:
+        case CPT_WORKLOAD_STRIDED:
+            job->buffer = cpt_platform_malloc(CPT_JOB_BUFFER_SIZE, 0, CPT_JOB_BUFFER_MEMORY);
+            ESP_GOTO_ON_FALSE(job->buffer, ESP_ERR_NO_MEM, err, TAG, "Failed to allocate the job buffer");
+            for (uint32_t index = 0; index < CPT_JOB_BUFFER_SIZE; index ++)
+            {
+                job->buffer[index] = (uint8_t) index;
+            }
+            break;
+        case CPT_WORKLOAD_PING_PONG:
+            // Aligned so that each shared line maps to exactly one cache line
+            job->shared_lines = cpt_platform_malloc(CPT_JOB_SHARED_LINE_COUNT * sizeof(cpt_job_line), CPT_CACHE_LINE_SIZE, CPT_JOB_BUFFER_MEMORY);
+            ESP_GOTO_ON_FALSE(job->shared_lines, ESP_ERR_NO_MEM, err, TAG, "Failed to allocate the job shared lines");
+            memset((void *) job->shared_lines, 0, CPT_JOB_SHARED_LINE_COUNT * sizeof(cpt_job_line));
+            break;
+        default:
+            break;
+    }
+
+err:
+    return ret;
 }
 
 void cpt_job_uninit(cpt_job * job)
 {
-    (void)job;
+    cpt_platform_free(job->buffer);
+    cpt_platform_free(job->shared_lines);
+    job->buffer = NULL;
+    job->shared_lines = NULL;
+}
+
+void cpt_job_worker_init(cpt_job_worker * worker, uint8_t worker_index)
+{
+    * worker = (cpt_job_worker) {0};
+    worker->position = (worker_index % CPT_MAX_CONCURRENCY_COUNT) * (CPT_JOB_BUFFER_SIZE / CPT_MAX_CONCURRENCY_COUNT);
+}
+
+// CRC of size bytes of the buffer starting at position, wrapping around at its end
+static uint32_t cpt_job_crc(const uint8_t * buffer, uint32_t * position, uint32_t checksum, uint32_t size)
+{
+    while (size > 0)
+    {
+        uint32_t chunk_size = CPT_JOB_BUFFER_SIZE - * position;
+        chunk_size = chunk_size < size ? chunk_size : size;
+
+        checksum = cpt_platform_crc32_le(checksum, buffer + * position, chunk_size);
+        * position = (* position + chunk_size) % CPT_JOB_BUFFER_SIZE;
+        size -= chunk_size;
+    }
+
+    return checksum;
+}
+
+// The critical part of the workload writes to the shared state, so it must run under the job lock
+static void cpt_job_run_critical(cpt_job * job)
+{
+    switch (job->workload)
+    {
+        case CPT_WORKLOAD_CRC:
+            job->checksum = cpt_job_crc(job->buffer, &job->position, job->checksum, job->critical_size);
+            break;
+        case CPT_WORKLOAD_STRIDED:
+        {
+            volatile uint8_t * buffer = job->buffer;
+            for (uint16_t unit = 0; unit < job->critical_size; unit ++)
+            {
+                buffer[job->position] ++;
+                job->position = (job->position + CPT_JOB_STRIDE) % CPT_JOB_BUFFER_SIZE;
+            }
+            break;
+        }
+        case CPT_WORKLOAD_PING_PONG:
+            for (uint16_t unit = 0; unit < job->critical_size; unit ++)
+            {
+                job->shared_lines[unit % CPT_JOB_SHARED_LINE_COUNT].words[0] ++;
+            }
+            break;
+        default:
+            break;
+    }
 }
 
 // Function to be used to access the shared counter. It's *not* thread safe
@@ -45,6 +138,7 @@ cpt_job_status cpt_job_run(cpt_job * job)
 {
     if (cpt_job_get_status(job) == CPT_JOB_NOT_DONE)
     {
+        cpt_job_run_critical(job);
         job->counter ++;
         return CPT_JOB_NOT_DONE;
     }
@@ -52,6 +146,75 @@ cpt_job_status cpt_job_run(cpt_job * job)
     return CPT_JOB_DONE;
 }
 
+// The private part of the workload only reads the shared buffer (its content is irrelevant to the result), and writes
+// to the worker's state
+void cpt_job_run_private(cpt_job * job, cpt_job_worker * worker)
+{
+    switch (job->workload)
+    {
+        case CPT_WORKLOAD_CRC:
+            worker->checksum = cpt_job_crc(job->buffer, &worker->position, worker->checksum, job->private_size);
+            break;
+        case CPT_WORKLOAD_STRIDED:
+        {
+            const volatile uint8_t * buffer = job->buffer;
+            for (uint16_t unit = 0; unit < job->private_size; unit ++)
+            {
+                worker->checksum += buffer[worker->position];
+                worker->position = (worker->position + CPT_JOB_STRIDE) % CPT_JOB_BUFFER_SIZE;
+            }
+            break;
+        }
+        case CPT_WORKLOAD_PING_PONG:
+            for (uint16_t unit = 0; unit < job->private_size; unit ++)
+            {
+                worker->line.words[unit % CPT_ARRAY_SIZE(worker->line.words)] ++;
+            }
+            break;
+        default:
+            break;
+    }
+}
+
+// Both lock-free runners use a CAS loop rather than a fetch-add: fetch-add would let the counter overshoot
+// CPT_JOB_MAX_COUNT, and Xtensa has no native fetch-add anyway (the compiler emits a CAS loop for it)
+cpt_job_status cpt_job_run_atomic32(cpt_job * job)
+{
+    uint32_t counter = atomic_load_explicit(&job->atomic_counter_low, memory_order_relaxed);
+
+    while (counter < CPT_JOB_MAX_COUNT)
+    {
+        // On failure counter is updated with the current value
+        if (atomic_compare_exchange_weak_explicit(&job->atomic_counter_low, &counter, counter + 1, memory_order_relaxed, memory_order_relaxed))
+        {
+            return CPT_JOB_NOT_DONE;
+        }
+    }
+
+    return CPT_JOB_DONE;
+}
+
+cpt_job_status cpt_job_run_atomic64(cpt_job * job)
+{
+    uint64_t counter = atomic_load_explicit(&job->atomic_counter, memory_order_relaxed);
+
+    while (counter < CPT_JOB_MAX_COUNT)
+    {
+        if (atomic_compare_exchange_weak_explicit(&job->atomic_counter, &counter, counter + 1, memory_order_relaxed, memory_order_relaxed))
+        {
+            return CPT_JOB_NOT_DONE;
+        }
+    }
+
+    return CPT_JOB_DONE;
+}
+
+void cpt_job_merge(cpt_job * job, const cpt_job * partial_job)
+{
+    job->counter += partial_job->counter;
+    job->checksum ^= partial_job->checksum;
+}
+
 cpt_job_status cpt_job_get_status(cpt_job * job)
 {
     if (job->counter < CPT_JOB_MAX_COUNT)
@@ -60,4 +223,36 @@ cpt_job_status cpt_job_get_status(cpt_job * job)
     }
 
     return CPT_JOB_DONE;
+}
+
+const char * cpt_job_backend_to_name(cpt_job_backend backend)
+{
+    switch (backend)
+    {
+        case CPT_JOB_BACKEND_LOCKED:
+            return "locked";
+        case CPT_JOB_BACKEND_ATOMIC32:
+            return "atomic32";
+        case CPT_JOB_BACKEND_ATOMIC64:
+            return "atomic64";
+        default:
+            return "invalid";
+    }
+}
+
+const char * cpt_job_workload_to_name(cpt_workload workload)
+{
+    switch (workload)
+    {
+        case CPT_WORKLOAD_COUNTER:
+            return "counter";
+        case CPT_WORKLOAD_CRC:
+            return "crc";
+        case CPT_WORKLOAD_STRIDED:
+            return "strided";
+        case CPT_WORKLOAD_PING_PONG:
+            return "ping pong";
+        default:
+            return "invalid";
+    }
 }
\ No newline at end of file
@@ -25,6 +25,34 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #define __CPT_JOB_H__
 
 #include "esp_err.h"
+#include "stdatomic.h"
+
+#include "cpt_globals.h"
+
+// Number of iterations after which a job is done
+#define CPT_JOB_MAX_COUNT (500 * 1000)
+
+// Allocate the workload buffers in PSRAM (cached, requires CONFIG_SPIRAM) rather than in internal DRAM (not cached)
+#define CPT_JOB_BUFFER_IN_PSRAM (0)
+
+// Size of the buffer used by the CRC and strided workloads, which sets what the strided workload measures:
+// - host: larger than the L1 and L2 caches of common cores, so that strided accesses miss them
+// - ESP32 with CPT_JOB_BUFFER_IN_PSRAM: far larger than the 32 KB flash/PSRAM cache, so that strided accesses miss it
+// - ESP32 otherwise: internal SRAM isn't cached at all, strided accesses measure plain SRAM reads and writes. Kept
+//   small since internal memory is scarce
+#if !defined(ESP_PLATFORM)
+#define CPT_JOB_BUFFER_SIZE (4 * 1024 * 1024)
+#elif CPT_JOB_BUFFER_IN_PSRAM
+#define CPT_JOB_BUFFER_SIZE (1024 * 1024)
+#else
+#define CPT_JOB_BUFFER_SIZE (32 * 1024)
+#endif
+
+// Distance between two accesses of the strided workload. A cache line, so that each access misses
+#define CPT_JOB_STRIDE (CPT_CACHE_LINE_SIZE)
+
+// Number of lines in the structure shared by the ping pong workload
+#define CPT_JOB_SHARED_LINE_COUNT (4)
 
 typedef enum
 {
@@ -32,22 +60,85 @@ typedef enum
     CPT_JOB_DONE
 } cpt_job_status;
 
-// A job here is simply a counter to be incremented at each interaction
-// it's oblivious of the number of tasks running it, or the synchronization mechanism.
+/// @brief A cache line worth of data, written by the ping pong workload
+typedef struct
+{
+    volatile uint32_t words[CPT_CACHE_LINE_SIZE / sizeof(uint32_t)];
+} cpt_job_line;
+
+/// @brief State of a worker for the private (non critical) part of the workload. Owned by a single worker
+typedef struct
+{
+    uint32_t position; // Position of the worker's walk in the job buffer
+    uint32_t checksum; // CRC accumulated by the worker
+    cpt_job_line line; // Written by the worker only
+} cpt_job_worker;
+
+// A job here is a counter to be incremented at each interaction, plus some optional work (the workload) to be done
+// in the same critical section. It's oblivious of the number of tasks running it, or the synchronization mechanism.
 typedef struct
 {
-    uint64_t counter;
+    union
+    {
+        uint64_t counter;
+
+        // Views used by the lock-free runners. The 32 bit one aliases the low word of counter, which is enough
+        // since CPT_JOB_MAX_COUNT fits in 32 bits and the target is little endian.
+        _Atomic uint64_t atomic_counter;
+        _Atomic uint32_t atomic_counter_low;
+    };
+
+    cpt_workload workload;
+    uint16_t critical_size; // Units of work run by cpt_job_run
+    uint16_t private_size; // Units of work run by cpt_job_run_private
+
+    // Workload state, accessed in the critical section only
+    uint8_t * buffer; // CRC and strided workloads
+    uint32_t position; // Position of the critical walk in buffer
+    uint32_t checksum; // CRC accumulated in the critical section
+    cpt_job_line * shared_lines; // Ping pong workload, CPT_JOB_SHARED_LINE_COUNT lines
 } cpt_job;
 
-esp_err_t cpt_job_init(cpt_job * job);
+/// @brief Initializes a job, allocating the buffers needed by the workload selected in config
+esp_err_t cpt_job_init(cpt_job * job, const cpt_config * config);
 void cpt_job_uninit(cpt_job * job);
 
-/// @brief  Runs an iteration of the job. Calling it after the job was completed has no effect. This function is *not* thread safe by design.
+/// @brief Initializes the state of a worker running the job. Workers start their walks at different positions
+void cpt_job_worker_init(cpt_job_worker * worker, uint8_t worker_index);
+
+/// @brief  Runs an iteration of the job: the critical part of the workload, then the counter increment. Calling it
+/// after the job was completed has no effect. This function is *not* thread safe by design.
 /// @return the job status
 cpt_job_status cpt_job_run(cpt_job * job);
 
+/// @brief Runs the private part of the workload for an iteration of the job, on the worker's own state. It only reads
+/// the shared job buffer, so it's safe to call outside of the critical section.
+void cpt_job_run_private(cpt_job * job, cpt_job_worker * worker);
+
+/// @brief Lock-free version of cpt_job_run, claiming an iteration with a compare and swap on the low 32 bits of the
+/// counter (natively supported by the S32C1I instruction on Xtensa). It's thread safe, and never lets the counter
+/// go past CPT_JOB_MAX_COUNT so the job status has the same semantics as with cpt_job_run.
+/// The critical part of the workload is not run, as there's nothing protecting it.
+/// @return the job status
+cpt_job_status cpt_job_run_atomic32(cpt_job * job);
+
+/// @brief Same as cpt_job_run_atomic32, on the full 64 bits counter. 64 bits atomics are emulated on Xtensa
+/// (libatomic falls back to a critical section), this is meant to measure what that costs.
+/// @return the job status
+cpt_job_status cpt_job_run_atomic64(cpt_job * job);
+
+/// @brief Adds the progress made on a partial job to another one. Used to aggregate jobs that were split across workers.
+/// This function is *not* thread safe by design.
+void cpt_job_merge(cpt_job * job, const cpt_job * partial_job);
+
 /// @brief gets the job status
 /// @return the job status
 cpt_job_status cpt_job_get_status(cpt_job * job);
 
+/// @brief gets a printable name for a job backend
+const char * cpt_job_backend_to_name(cpt_job_backend backend);
+
+/// @brief gets a printable name for a workload
+const char * cpt_job_workload_to_name(cpt_workload workload);
+
 #endif //__CPT_JOB_H__
@@ -0,0 +1,288 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "cpt_lock.h"
+#include "esp_check.h"
+
+#define TAG "lock"
+
+esp_err_t cpt_lock_init(cpt_lock * lock, cpt_lock_type type)
+{
+    * lock = (cpt_lock) {0};
+    esp_err_t ret = ESP_OK;
+
+    lock->type = type;
+
+    switch (type)
+    {
+        case CPT_LOCK_COUNTING_SEMAPHORE:
+            lock->semaphore = cpt_platform_semaphore_create_counting(1, 1);
+            break;
+
+        case CPT_LOCK_PRIORITY_CEILING:
+            // A counting semaphore, so that no priority inheritance gets in the way of the ceiling
+            lock->semaphore = cpt_platform_semaphore_create_counting(1, 1);
+            lock->ceiling_priority = CPT_TASK_PRIO;
+            break;
+
+        case CPT_LOCK_MUTEX:
+            lock->semaphore = cpt_platform_semaphore_create_mutex();
+            break;
+
+        case CPT_LOCK_BINARY_SEMAPHORE:
+            lock->semaphore = cpt_platform_semaphore_create_binary();
+            break;
+
+        case CPT_LOCK_CRITICAL_SECTION:
+            cpt_platform_spinlock_init(&lock->spinlock);
+            return ESP_OK;
+
+        case CPT_LOCK_TICKET:
+        case CPT_LOCK_MCS:
+            // Zero-initialized is unlocked
+            return ESP_OK;
+
+        default:
+            ESP_LOGE(TAG, "Invalid lock type %d", type);
+            return ESP_ERR_INVALID_ARG;
+    }
+
+    ESP_GOTO_ON_FALSE(lock->semaphore != NULL, ESP_ERR_NO_MEM, exit, TAG, "Unable to create semaphore");
+
+    exit:
+    return ret;
+}
+
+void cpt_lock_uninit(cpt_lock * lock)
+{
+    if (lock->semaphore != NULL)
+    {
+        cpt_platform_semaphore_delete(lock->semaphore);
+    }
+
+    * lock = (cpt_lock) {0};
+}
+
+// Semaphores block in the kernel with the baseline policy, any other policy polls them
+static inline void cpt_lock_take_semaphore(cpt_lock * lock, cpt_lock_node * node)
+{
+    if (node->backoff.policy == CPT_YIELD_BASELINE)
+    {
+        cpt_platform_semaphore_take(lock->semaphore, CPT_WAIT_FOREVER);
+        return;
+    }
+
+    while (! cpt_platform_semaphore_try_take(lock->semaphore))
+    {
+        if (cpt_backoff_wait(&node->backoff))
+        {
+            cpt_platform_semaphore_take(lock->semaphore, CPT_WAIT_FOREVER);
+            break;
+        }
+    }
+
+    cpt_backoff_acquired(&node->backoff);
+}
+
+// Between two checks of a spinlock. Spinlocks can't block: past the spin limit, spin-then-block sleeps a tick per check
+static inline void cpt_lock_spin_wait(cpt_lock_node * node)
+{
+    if (cpt_backoff_wait(&node->backoff))
+    {
+        cpt_platform_delay_ms(1);
+    }
+}
+
+void cpt_lock_set_ceiling(cpt_lock * lock, uint32_t priority)
+{
+    lock->ceiling_priority = priority;
+}
+
+static inline void cpt_lock_ceiling_acquire(cpt_lock * lock, cpt_lock_node * node)
+{
+    // Raised once the semaphore is held, not while waiting for it: with any yield policy but the baseline the waiter
+    // polls the semaphore (see cpt_lock_take_semaphore), and polling at the ceiling would starve a lower priority
+    // holder on the same core. The holder can be preempted between the take and the raise, not once raised
+    cpt_lock_take_semaphore(lock, node);
+
+    cpt_platform_task task = cpt_platform_task_get_current();
+    uint32_t priority = cpt_platform_task_get_priority(task);
+
+    if (priority < lock->ceiling_priority)
+    {
+        cpt_platform_task_set_priority(task, lock->ceiling_priority);
+    }
+
+    lock->holder_priority = priority;
+}
+
+static inline void cpt_lock_ceiling_release(cpt_lock * lock)
+{
+    // Read before giving, the next holder overwrites it
+    uint32_t priority = lock->holder_priority;
+
+    cpt_platform_semaphore_give(lock->semaphore);
+
+    if (priority < lock->ceiling_priority)
+    {
+        cpt_platform_task_set_priority(cpt_platform_task_get_current(), priority);
+    }
+}
+
+static inline void cpt_lock_mcs_acquire(cpt_lock * lock, cpt_lock_node * node)
+{
+    atomic_store_explicit(&node->next, NULL, memory_order_relaxed);
+    atomic_store_explicit(&node->locked, true, memory_order_relaxed);
+
+    cpt_lock_node * predecessor = atomic_exchange_explicit(&lock->mcs_tail, node, memory_order_acq_rel);
+
+    if (predecessor != NULL)
+    {
+        // Queue behind the predecessor, then spin on our own node only
+        atomic_store_explicit(&predecessor->next, node, memory_order_release);
+
+        while (atomic_load_explicit(&node->locked, memory_order_acquire))
+        {
+            cpt_lock_spin_wait(node);
+        }
+    }
+
+    cpt_backoff_acquired(&node->backoff);
+}
+
+static inline void cpt_lock_mcs_release(cpt_lock * lock, cpt_lock_node * node)
+{
+    cpt_lock_node * successor = atomic_load_explicit(&node->next, memory_order_acquire);
+
+    if (successor == NULL)
+    {
+        // No known successor: try to mark the queue empty
+        cpt_lock_node * expected = node;
+        if (atomic_compare_exchange_strong_explicit(&lock->mcs_tail, &expected, NULL, memory_order_acq_rel, memory_order_acquire))
+        {
+            return;
+        }
+
+        // A task is enqueuing right now, wait for it to link itself
+        while ((successor = atomic_load_explicit(&node->next, memory_order_acquire)) == NULL)
+        {
+            cpt_platform_task_allow_delete();
+        }
+    }
+
+    atomic_store_explicit(&successor->locked, false, memory_order_release);
+}
+
+void cpt_lock_acquire(cpt_lock * lock, cpt_lock_node * node)
+{
+    switch (lock->type)
+    {
+        case CPT_LOCK_COUNTING_SEMAPHORE:
+        case CPT_LOCK_MUTEX:
+        case CPT_LOCK_BINARY_SEMAPHORE:
+            cpt_lock_take_semaphore(lock, node);
+            break;
+
+        case CPT_LOCK_CRITICAL_SECTION:
+            cpt_platform_spinlock_enter(&lock->spinlock);
+            break;
+
+        case CPT_LOCK_TICKET:
+        {
+            uint32_t ticket = atomic_fetch_add_explicit(&lock->next_ticket, 1, memory_order_relaxed);
+            while (atomic_load_explicit(&lock->serving_ticket, memory_order_acquire) != ticket)
+            {
+                cpt_lock_spin_wait(node);
+            }
+
+            cpt_backoff_acquired(&node->backoff);
+            break;
+        }
+
+        case CPT_LOCK_MCS:
+            cpt_lock_mcs_acquire(lock, node);
+            break;
+
+        case CPT_LOCK_PRIORITY_CEILING:
+            cpt_lock_ceiling_acquire(lock, node);
+            break;
+
+        default:
+            break;
+    }
+}
+
+void cpt_lock_release(cpt_lock * lock, cpt_lock_node * node)
+{
+    switch (lock->type)
+    {
+        case CPT_LOCK_COUNTING_SEMAPHORE:
+        case CPT_LOCK_MUTEX:
+        case CPT_LOCK_BINARY_SEMAPHORE:
+            cpt_platform_semaphore_give(lock->semaphore);
+            break;
+
+        case CPT_LOCK_CRITICAL_SECTION:
+            cpt_platform_spinlock_exit(&lock->spinlock);
+            break;
+
+        case CPT_LOCK_TICKET:
+            // Only the holder writes serving_ticket
+            atomic_store_explicit(&lock->serving_ticket, atomic_load_explicit(&lock->serving_ticket, memory_order_relaxed) + 1, memory_order_release);
+            break;
+
+        case CPT_LOCK_MCS:
+            cpt_lock_mcs_release(lock, node);
+            break;
+
+        case CPT_LOCK_PRIORITY_CEILING:
+            cpt_lock_ceiling_release(lock);
+            break;
+
+        default:
+            break;
+    }
+}
+
+const char * cpt_lock_type_to_name(cpt_lock_type type)
+{
+    switch (type)
+    {
+        case CPT_LOCK_COUNTING_SEMAPHORE:
+            return "counting_semaphore";
+        case CPT_LOCK_MUTEX:
+            return "mutex";
+        case CPT_LOCK_BINARY_SEMAPHORE:
+            return "binary_semaphore";
+        case CPT_LOCK_CRITICAL_SECTION:
+            return "critical_section";
+        case CPT_LOCK_TICKET:
+            return "ticket";
+        case CPT_LOCK_MCS:
+            return "mcs";
+        case CPT_LOCK_PRIORITY_CEILING:
+            return "priority_ceiling";
+        default:
+            return "invalid";
+    }
+}
\ No newline at end of file
@@ -0,0 +1,88 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __CPT_LOCK_H__
+#define __CPT_LOCK_H__
+
+#include "esp_err.h"
+#include "stdatomic.h"
+
+#include "cpt_globals.h"
+#include "cpt_platform.h"
+#include "cpt_backoff.h"
+
+/// @brief Per-task waiting state. Each task acquiring a lock passes its own node, which must stay valid until the
+/// matching release. The MCS lock queues the nodes, all types wait according to the node's backoff policy
+typedef struct cpt_lock_node
+{
+    volatile _Atomic(struct cpt_lock_node *) next;
+    volatile atomic_bool locked;
+    cpt_backoff backoff; // Initialized by the owner of the node, with cpt_backoff_init
+} cpt_lock_node;
+
+/// @brief A lock protecting a shared resource, implemented as any of the cpt_lock_type strategies
+/// @details The ticket and MCS types spin without yielding: with more tasks than cores, a waiter can burn its whole
+/// time slice while the holder is preempted on the same core. That cost is part of what's being measured.
+typedef struct
+{
+    cpt_lock_type type;
+
+    cpt_platform_semaphore semaphore; // Counting semaphore, mutex and binary semaphore types
+    cpt_platform_spinlock spinlock; // Critical section type
+
+    // Ticket type: tasks take the next ticket and spin until it's served
+    volatile _Atomic uint32_t next_ticket;
+    volatile _Atomic uint32_t serving_ticket;
+
+    volatile _Atomic(cpt_lock_node *) mcs_tail; // MCS type: last node in the queue of waiting tasks
+
+    // Priority ceiling type: tasks are raised to the ceiling as soon as they hold the semaphore, and restored to their
+    // priority after giving it. With the ceiling at the highest priority of the tasks using the lock, a holder can't
+    // be preempted by any of them, nor by tasks below that priority
+    uint32_t ceiling_priority;
+    uint32_t holder_priority; // Priority of the holder before it was raised. Protected by the lock
+} cpt_lock;
+
+/// @brief Initializes a lock. The ceiling of the priority ceiling type is CPT_TASK_PRIO, see cpt_lock_set_ceiling
+esp_err_t cpt_lock_init(cpt_lock * lock, cpt_lock_type type);
+void cpt_lock_uninit(cpt_lock * lock);
+
+/// @brief Sets the ceiling of a priority ceiling lock: the highest priority of the tasks using it. Ignored by
+/// the other types. Not thread safe, to be called before the lock is used
+void cpt_lock_set_ceiling(cpt_lock * lock, uint32_t priority);
+
+/// @brief Blocks (or spins, depending on the lock type) until the lock is acquired. Unless the node's policy is
+/// CPT_YIELD_BASELINE, semaphores are polled, and waits between attempts follow the policy. Critical sections
+/// always spin in the port layer
+/// @param node the caller's node
+void cpt_lock_acquire(cpt_lock * lock, cpt_lock_node * node);
+
+/// @brief Releases a lock acquired by the caller
+/// @param node the same node passed to cpt_lock_acquire
+void cpt_lock_release(cpt_lock * lock, cpt_lock_node * node);
+
+/// @brief gets a printable name for a lock type
+const char * cpt_lock_type_to_name(cpt_lock_type type);
+
+#endif //__CPT_LOCK_H__
+
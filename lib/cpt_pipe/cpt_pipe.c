@@ -0,0 +1,487 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpt_globals.h"
+#include "cpt_pipe.h"
+#include "cpt_utils.h"
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+
+#define TAG "pipe"
+
+// Items are 32 bits: 0 for a plain item, CPT_PIPE_ITEM_STOP to tell a consumer to stop, and for the sampled items
+// CPT_PIPE_ITEM_SAMPLED plus the low 31 bits of the time they were produced at, in us
+#define CPT_PIPE_ITEM_STOP (1)
+#define CPT_PIPE_ITEM_SAMPLED (0x80000000)
+
+static void cpt_pipe_worker_function(void * parameters);
+
+/// @brief change the state for this object and notify waiting task (if set)
+/// @param new_state the state to set this cpt_pipe object to
+/// @return esp_ok in case of success
+static esp_err_t cpt_pipe_set_state(cpt_pipe * pipe, cpt_state new_state)
+{
+    ESP_LOGD(TAG, "Changing state from %d to %d", atomic_load(&pipe->state), new_state);
+    // Set the state first
+    atomic_store(&pipe->state, new_state);
+
+    // Then read the handle
+    volatile TaskHandle_t waiting_task_handle = atomic_load(&pipe->waiting_task_handle);
+
+    // Notify task if necessary
+    if (waiting_task_handle != NULL)
+    {
+        xTaskNotifyGive(waiting_task_handle);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t cpt_pipe_wait_for_state_change(cpt_pipe * pipe, uint32_t max_wait_ms, cpt_state expected_state)
+{
+    TaskHandle_t this_task_handle = xTaskGetCurrentTaskHandle();
+    TaskHandle_t null_task_handle = NULL;
+    volatile cpt_state current_state = CPT_STATE_NONE;
+    uint32_t notification_value = 0;
+
+    // Set the wait handle first
+    bool valid = atomic_compare_exchange_strong(&pipe->waiting_task_handle, &null_task_handle, this_task_handle);
+    ESP_RETURN_ON_FALSE(valid, ESP_ERR_INVALID_STATE, TAG, "Handle already set");
+
+    while (current_state != expected_state)
+    {
+        // Read the state after setting the handle: this fixes races
+        current_state = atomic_load(&pipe->state);
+
+        if (current_state != expected_state)
+        {
+            notification_value = ulTaskNotifyTake(pdTRUE, max_wait_ms == CPT_WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(max_wait_ms));
+            if (notification_value == 0)
+            {
+                break;
+            }
+        }
+    }
+
+    atomic_store(&pipe->waiting_task_handle, NULL);
+
+    return current_state == expected_state ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+esp_err_t cpt_pipe_init(cpt_pipe * pipe, cpt_job * job, const cpt_config * config)
+{
+    // The structure is large because of the histograms, don't zero it through a temporary
+    memset(pipe, 0, sizeof(cpt_pipe));
+    esp_err_t ret = ESP_OK;
+
+    ret = cpt_config_validate(config);
+    ESP_GOTO_ON_ERROR(ret, exit, TAG, "Invalid configuration");
+    ESP_GOTO_ON_FALSE(config->concurrency >= 2, ESP_ERR_NOT_SUPPORTED, exit, TAG, "At least a producer and a consumer are needed");
+    ESP_GOTO_ON_FALSE(config->channel != CPT_CHANNEL_RING_SPSC || config->concurrency == 2, ESP_ERR_NOT_SUPPORTED, exit, TAG,
+        "The SPSC ring supports a single producer and a single consumer");
+
+    pipe->job = job;
+    pipe->worker_count = config->concurrency;
+    pipe->producer_count = config->concurrency / 2;
+    pipe->channel = config->channel;
+    portMUX_INITIALIZE(&pipe->job_spinlock);
+    atomic_store(&pipe->running_producers_count, pipe->producer_count);
+    atomic_store(&pipe->running_consumers_count, pipe->worker_count - pipe->producer_count);
+
+    ret = cpt_pipe_set_state(pipe, CPT_STATE_INITIALIZING);
+    ESP_GOTO_ON_ERROR(ret, exit, TAG, "Error setting state: %s", esp_err_to_name(ret));
+
+    switch (pipe->channel)
+    {
+        case CPT_CHANNEL_QUEUE:
+            pipe->queue = xQueueCreate(CPT_PIPE_CAPACITY, sizeof(uint32_t));
+            ESP_GOTO_ON_FALSE(pipe->queue != NULL, ESP_ERR_NO_MEM, exit, TAG, "Unable to create the queue");
+            break;
+        case CPT_CHANNEL_RING_SPSC:
+            pipe->ring_spsc = heap_caps_aligned_alloc(CPT_CACHE_LINE_SIZE, sizeof(cpt_ring_spsc), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+            ESP_GOTO_ON_FALSE(pipe->ring_spsc != NULL, ESP_ERR_NO_MEM, exit, TAG, "Unable to allocate the ring");
+            ret = cpt_ring_spsc_init(pipe->ring_spsc, CPT_PIPE_CAPACITY);
+            ESP_GOTO_ON_ERROR(ret, exit, TAG, "Unable to initialize the ring");
+            break;
+        case CPT_CHANNEL_RING_MPMC:
+            pipe->ring_mpmc = heap_caps_aligned_alloc(CPT_CACHE_LINE_SIZE, sizeof(cpt_ring_mpmc), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+            ESP_GOTO_ON_FALSE(pipe->ring_mpmc != NULL, ESP_ERR_NO_MEM, exit, TAG, "Unable to allocate the ring");
+            ret = cpt_ring_mpmc_init(pipe->ring_mpmc, CPT_PIPE_CAPACITY);
+            ESP_GOTO_ON_ERROR(ret, exit, TAG, "Unable to initialize the ring");
+            break;
+        default:
+            break;
+    }
+
+    for (uint8_t worker_index = 0; worker_index < pipe->worker_count; worker_index ++)
+    {
+        cpt_pipe_worker * worker = &pipe->workers[worker_index];
+        bool producer = worker_index < pipe->producer_count;
+        uint8_t role_index = producer ? worker_index : worker_index - pipe->producer_count;
+
+        cpt_job_worker_init(&worker->job_worker, worker_index);
+
+        ret = cpt_pool_acquire(cpt_affinity_get_core(config->affinity, 2 * role_index + (producer ? 0 : 1)), config->priority, &worker->pool_worker);
+        ESP_GOTO_ON_ERROR(ret, exit, TAG, "Unable to get a worker for worker %d", worker_index);
+
+        cpt_pool_start(worker->pool_worker, cpt_pipe_worker_function, pipe);
+    }
+
+    ESP_LOGI(TAG, "%d producers and %d consumers initialized, priority: %d affinity: %s channel: %s workload: %s (%d)",
+        pipe->producer_count,
+        pipe->worker_count - pipe->producer_count,
+        config->priority,
+        cpt_affinity_to_name(config->affinity),
+        cpt_channel_to_name(config->channel),
+        cpt_job_workload_to_name(config->workload),
+        config->private_size);
+
+    exit:
+    if (ret != ESP_OK)
+    {
+        cpt_pipe_uninit(pipe);
+    }
+
+    return ret;
+}
+
+void cpt_pipe_uninit(cpt_pipe * pipe)
+{
+    ESP_LOGI(TAG, "uninitializing");
+
+    for (int i = 0; i < pipe->worker_count; i ++)
+    {
+        if (pipe->workers[i].pool_worker != NULL)
+        {
+            cpt_pool_release(pipe->workers[i].pool_worker);
+        }
+    }
+
+    if (pipe->queue != NULL)
+    {
+        vQueueDelete(pipe->queue);
+    }
+
+    if (pipe->ring_spsc != NULL)
+    {
+        cpt_ring_spsc_uninit(pipe->ring_spsc);
+        heap_caps_free(pipe->ring_spsc);
+    }
+
+    if (pipe->ring_mpmc != NULL)
+    {
+        cpt_ring_mpmc_uninit(pipe->ring_mpmc);
+        heap_caps_free(pipe->ring_mpmc);
+    }
+
+    memset(pipe, 0, sizeof(cpt_pipe));
+}
+
+// Returns -1 if the task wasn't found
+static int8_t cpt_pipe_get_current_worker_index(cpt_pipe * pipe)
+{
+    TaskHandle_t handle = xTaskGetCurrentTaskHandle();
+
+    for (int8_t i = 0; i < pipe->worker_count; i ++)
+    {
+        if (pipe->workers[i].pool_worker != NULL && pipe->workers[i].pool_worker->handle == handle)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+// Adds an item to the channel, waiting for room if it's full. The rings don't block, so producers yield until
+// there's room: the consumers may be on the same core
+static void cpt_pipe_push(cpt_pipe * pipe, cpt_pipe_worker * worker, uint32_t item)
+{
+    switch (pipe->channel)
+    {
+        case CPT_CHANNEL_QUEUE:
+            if (xQueueSend(pipe->queue, &item, 0) != pdTRUE)
+            {
+                worker->stall_count ++;
+                xQueueSend(pipe->queue, &item, portMAX_DELAY);
+            }
+            break;
+
+        case CPT_CHANNEL_RING_SPSC:
+            while (! cpt_ring_spsc_push(pipe->ring_spsc, item))
+            {
+                worker->stall_count ++;
+                taskYIELD();
+            }
+            break;
+
+        case CPT_CHANNEL_RING_MPMC:
+            while (! cpt_ring_mpmc_push(pipe->ring_mpmc, item))
+            {
+                worker->stall_count ++;
+                taskYIELD();
+            }
+            break;
+
+        default:
+            break;
+    }
+}
+
+// Takes an item from the channel, waiting for one if it's empty
+static uint32_t cpt_pipe_pop(cpt_pipe * pipe, cpt_pipe_worker * worker)
+{
+    uint32_t item = 0;
+
+    switch (pipe->channel)
+    {
+        case CPT_CHANNEL_QUEUE:
+            if (xQueueReceive(pipe->queue, &item, 0) != pdTRUE)
+            {
+                worker->stall_count ++;
+                xQueueReceive(pipe->queue, &item, portMAX_DELAY);
+            }
+            break;
+
+        case CPT_CHANNEL_RING_SPSC:
+            while (! cpt_ring_spsc_pop(pipe->ring_spsc, &item))
+            {
+                worker->stall_count ++;
+                taskYIELD();
+            }
+            break;
+
+        case CPT_CHANNEL_RING_MPMC:
+            while (! cpt_ring_mpmc_pop(pipe->ring_mpmc, &item))
+            {
+                worker->stall_count ++;
+                taskYIELD();
+            }
+            break;
+
+        default:
+            break;
+    }
+
+    return item;
+}
+
+static void cpt_pipe_produce(cpt_pipe * pipe, uint8_t producer_index)
+{
+    cpt_pipe_worker * worker = &pipe->workers[producer_index];
+    uint32_t item_count = CPT_JOB_MAX_COUNT / pipe->producer_count + (producer_index < CPT_JOB_MAX_COUNT % pipe->producer_count ? 1 : 0);
+
+    for (uint32_t i = 0; i < item_count; i ++)
+    {
+        cpt_job_run_private(pipe->job, &worker->job_worker);
+
+        uint32_t item = i % CPT_PIPE_LATENCY_SAMPLE_PERIOD == 0 ?
+            CPT_PIPE_ITEM_SAMPLED | ((uint32_t) cpt_get_current_time_us() & ~CPT_PIPE_ITEM_SAMPLED) :
+            0;
+
+        cpt_pipe_push(pipe, worker, item);
+        worker->counter ++;
+    }
+
+    // All items are in the channel, behind them a stop item for each consumer
+    if (atomic_fetch_sub(&pipe->running_producers_count, 1) == 1)
+    {
+        for (uint8_t i = pipe->producer_count; i < pipe->worker_count; i ++)
+        {
+            cpt_pipe_push(pipe, worker, CPT_PIPE_ITEM_STOP);
+        }
+    }
+}
+
+static void cpt_pipe_consume(cpt_pipe * pipe, uint8_t consumer_index)
+{
+    cpt_pipe_worker * worker = &pipe->workers[consumer_index];
+    uint32_t item;
+
+    while ((item = cpt_pipe_pop(pipe, worker)) != CPT_PIPE_ITEM_STOP)
+    {
+        if (item & CPT_PIPE_ITEM_SAMPLED)
+        {
+            cpt_histogram_record(&worker->latency, ((uint32_t) cpt_get_current_time_us() - item) & ~CPT_PIPE_ITEM_SAMPLED);
+        }
+
+        cpt_job_run_private(pipe->job, &worker->job_worker);
+        worker->counter ++;
+    }
+
+    // The only access to the job: account for the items consumed
+    const cpt_job consumed = { .counter = worker->counter };
+    taskENTER_CRITICAL(&pipe->job_spinlock);
+    cpt_job_merge(pipe->job, &consumed);
+    taskEXIT_CRITICAL(&pipe->job_spinlock);
+
+    // signal that we're done
+    if (atomic_fetch_sub(&pipe->running_consumers_count, 1) == 1)
+    {
+        cpt_pipe_set_state(pipe, CPT_STATE_DONE);
+    }
+}
+
+static void cpt_pipe_worker_function(void * parameters)
+{
+    cpt_pipe * pipe = (cpt_pipe *) parameters;
+    int8_t worker_index = cpt_pipe_get_current_worker_index(pipe);
+
+    if (worker_index == -1)
+    {
+        ESP_LOGE(TAG, "Worker not found in array, terminating task");
+        return;
+    }
+
+    if (atomic_fetch_add(&pipe->initialized_workers_count, 1) == pipe->worker_count - 1)
+    {
+        cpt_pipe_set_state(pipe, CPT_STATE_INITIALIZED);
+    }
+
+    // Wait for run_job. A notification given before reaching this point stays pending, so there's no race
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    if (worker_index < pipe->producer_count)
+    {
+        cpt_pipe_produce(pipe, worker_index);
+    }
+    else
+    {
+        cpt_pipe_consume(pipe, worker_index);
+    }
+
+    // Returning parks the worker until the pool hands it to the next run
+}
+
+esp_err_t cpt_pipe_run_job(cpt_pipe * pipe)
+{
+    ESP_LOGI(TAG, "Starting job");
+
+    // Wait for all workers to be initialized
+    esp_err_t ret = cpt_pipe_wait_for_state_change(pipe, CPT_WAIT_FOREVER, CPT_STATE_INITIALIZED);
+    ESP_RETURN_ON_ERROR(ret, TAG, "Error waiting for initialization: %s", esp_err_to_name(ret));
+
+    cpt_pipe_set_state(pipe, CPT_STATE_RUNNING);
+
+    // Time measurement should begin here. Consumers first, so that they're ready when items come
+    for (int i = pipe->worker_count - 1; i >= 0; i --)
+    {
+        xTaskNotifyGive(pipe->workers[i].pool_worker->handle);
+    }
+
+    return ESP_OK;
+}
+
+static void cpt_pipe_log_latency(const char * name, const cpt_histogram * latency)
+{
+    ESP_LOGI(TAG, "%8s %9"PRIu32" %9"PRIu32" %9"PRIu32" %9"PRIu32" %9"PRIu32,
+        name,
+        latency->total_count,
+        cpt_histogram_get_percentile(latency, 50),
+        cpt_histogram_get_percentile(latency, 90),
+        cpt_histogram_get_percentile(latency, 99),
+        latency->max);
+}
+
+void cpt_pipe_log_report(cpt_pipe * pipe)
+{
+    ESP_LOGI(TAG, "==== Items over %s ====", cpt_channel_to_name(pipe->channel));
+
+    for (int i = 0; i < pipe->worker_count; i ++)
+    {
+        ESP_LOGI(TAG, "%s %d items: %lu stalls: %lu",
+            i < pipe->producer_count ? "producer" : "consumer",
+            i < pipe->producer_count ? i : i - pipe->producer_count,
+            pipe->workers[i].counter,
+            pipe->workers[i].stall_count);
+    }
+
+    // Too large for the caller's stack
+    cpt_histogram * all_consumers = malloc(sizeof(cpt_histogram));
+    if (all_consumers == NULL)
+    {
+        ESP_LOGE(TAG, "Unable to allocate the latency histogram");
+        return;
+    }
+
+    cpt_histogram_reset(all_consumers);
+
+    ESP_LOGI(TAG, "==== Hand-off latency (us), one item in %d ====", CPT_PIPE_LATENCY_SAMPLE_PERIOD);
+    ESP_LOGI(TAG, "-------- --------- --------- --------- --------- ---------");
+    ESP_LOGI(TAG, "Consumer     Count       p50       p90       p99       max");
+    ESP_LOGI(TAG, "-------- --------- --------- --------- --------- ---------");
+
+    for (int i = pipe->producer_count; i < pipe->worker_count; i ++)
+    {
+        char name[8];
+        snprintf(name, sizeof(name), "%d", i - pipe->producer_count);
+        cpt_pipe_log_latency(name, &pipe->workers[i].latency);
+        cpt_histogram_merge(all_consumers, &pipe->workers[i].latency);
+    }
+
+    cpt_pipe_log_latency("all", all_consumers);
+    free(all_consumers);
+}
+
+static void cpt_pipe_engine_log_report(void * engine)
+{
+    cpt_pipe_log_report((cpt_pipe *) engine);
+}
+
+static esp_err_t cpt_pipe_engine_init(void * engine, cpt_job * job, const cpt_config * config)
+{
+    return cpt_pipe_init((cpt_pipe *) engine, job, config);
+}
+
+static void cpt_pipe_engine_uninit(void * engine)
+{
+    cpt_pipe_uninit((cpt_pipe *) engine);
+}
+
+static esp_err_t cpt_pipe_engine_run_job(void * engine)
+{
+    return cpt_pipe_run_job((cpt_pipe *) engine);
+}
+
+static esp_err_t cpt_pipe_engine_wait_for_state_change(void * engine, uint32_t max_wait_ms, cpt_state state)
+{
+    return cpt_pipe_wait_for_state_change((cpt_pipe *) engine, max_wait_ms, state);
+}
+
+static const cpt_engine cpt_pipe_engine = {
+    .name = "pipe",
+    .engine_size = sizeof(cpt_pipe),
+    .init = cpt_pipe_engine_init,
+    .uninit = cpt_pipe_engine_uninit,
+    .run_job = cpt_pipe_engine_run_job,
+    .wait_for_state_change = cpt_pipe_engine_wait_for_state_change,
+    .log_report = cpt_pipe_engine_log_report,
+};
+
+esp_err_t cpt_pipe_register()
+{
+    return cpt_engine_register(&cpt_pipe_engine);
+}
\ No newline at end of file
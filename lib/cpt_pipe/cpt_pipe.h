@@ -0,0 +1,105 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __CPT_PIPE_H__
+#define __CPT_PIPE_H__
+
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_err.h"
+#include "stdatomic.h"
+
+#include "cpt_globals.h"
+#include "cpt_engine.h"
+#include "cpt_job.h"
+#include "cpt_pool.h"
+#include "cpt_ring.h"
+#include "cpt_histogram.h"
+
+// Items the channel holds, must be a power of 2 for the rings
+#define CPT_PIPE_CAPACITY (256)
+
+// One item in this many carries a timestamp for the hand-off latency. Reading the timer for every item would cost
+// more than the hand-off itself
+#define CPT_PIPE_LATENCY_SAMPLE_PERIOD (64)
+
+/// @brief Structure handling a producer or consumer task in the pipe test
+typedef struct
+{
+    cpt_pool_worker * pool_worker; // Pool worker running the task
+    cpt_job_worker job_worker; // State for the private part of the workload, run for every item
+    unsigned long counter; // Items produced or consumed
+    unsigned long stall_count; // Times the channel was full (producers) or empty (consumers)
+    cpt_histogram latency; // Hand-off latency of the sampled items in us, consumers only
+} cpt_pipe_worker;
+
+/// @brief Structure holding state for a pipe test: producers hand CPT_JOB_MAX_COUNT items over to consumers
+/// through the channel selected in the configuration, each consumed item counting as an iteration of the job
+typedef struct
+{
+    cpt_pipe_worker workers[CPT_MAX_CONCURRENCY_COUNT]; // Producers first, then consumers
+    uint8_t worker_count; // Number of workers used in workers
+    uint8_t producer_count;
+    atomic_uint_fast8_t initialized_workers_count; // Used to determine when all workers are initialized
+    atomic_uint_fast8_t running_producers_count; // The last producer to finish tells the consumers to stop
+    atomic_uint_fast8_t running_consumers_count; // The last consumer to finish marks the test done
+
+    cpt_job * job; // Only touched when adding the items consumed at the end of the test
+    portMUX_TYPE job_spinlock; // Protects the aggregation into job
+
+    cpt_channel channel;
+    QueueHandle_t queue; // CPT_CHANNEL_QUEUE
+    cpt_ring_spsc * ring_spsc; // CPT_CHANNEL_RING_SPSC, allocated with a cache line alignment
+    cpt_ring_mpmc * ring_mpmc; // CPT_CHANNEL_RING_MPMC, allocated with a cache line alignment
+
+    volatile _Atomic cpt_state state; // The state of this pipe object
+    // An event is generated at each significant state change. Currently when all workers are initialized, and when the job is completed.
+    volatile _Atomic TaskHandle_t waiting_task_handle; // Handle for a task waiting for the next event
+} cpt_pipe;
+
+// Initializes the channel and the worker tasks necessary to run the test. Half of the config->concurrency workers
+// (rounded down) are producers, the others consumers. Producer i and consumer i take the affinity of workers 2i and
+// 2i + 1, so that with the round robin policy producers run on a core and consumers on the other.
+// Workers wait for the run_job function to be called before starting.
+esp_err_t cpt_pipe_init(cpt_pipe * pipe, cpt_job * job, const cpt_config * config);
+void cpt_pipe_uninit(cpt_pipe * pipe);
+
+// Starts the execution of the job scheduled for this pipe object
+// This call is not blocking
+esp_err_t cpt_pipe_run_job(cpt_pipe * pipe);
+
+/// @brief Logs the items handled and the stalls of each worker, and the hand-off latencies. To be called once the job is done
+void cpt_pipe_log_report(cpt_pipe * pipe);
+
+/// @brief Block caller thread until the next state change.
+/// @details Same semantics as cpt_preempt_wait_for_state_change
+/// @param max_wait_ms the maximum wait time in ms, CPT_WAIT_FOREVER to never timeout
+/// @param state the state to wait for
+/// @return ESP_OK in case of success, ESP_ERROR_TIMEOUT if the maximum time was reached.
+esp_err_t cpt_pipe_wait_for_state_change(cpt_pipe * pipe, uint32_t max_wait_ms, cpt_state state);
+
+/// @brief Adds the pipe engine to the engine registry, under the name "pipe"
+esp_err_t cpt_pipe_register();
+
+#endif //__CPT_PIPE_H__
\ No newline at end of file
@@ -0,0 +1,288 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __CPT_PLATFORM_H__
+#define __CPT_PLATFORM_H__
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "esp_err.h"
+
+#include "cpt_globals.h"
+
+// Backend selection. ESP-IDF defines ESP_PLATFORM, anything else is taken for a Linux host where tasks are pthreads,
+// so that the same locks, jobs and engines can be run on many more cores than the ESP32 has. ESP-IDF's own linux
+// target isn't used as its FreeRTOS port runs all tasks on a single thread. On the host, esp_err.h, esp_log.h and
+// esp_check.h come from the host directory of this library.
+#if defined(ESP_PLATFORM)
+#define CPT_PLATFORM_ESP_IDF (1)
+#define CPT_PLATFORM_LINUX (0)
+#else
+#define CPT_PLATFORM_ESP_IDF (0)
+#define CPT_PLATFORM_LINUX (1)
+#endif
+
+#if CPT_PLATFORM_ESP_IDF
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/semphr.h"
+#include "freertos/event_groups.h"
+#include "esp_cpu.h"
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+#endif //CPT_PLATFORM_ESP_IDF
+
+// Longest task name, including the terminator
+#define CPT_PLATFORM_TASK_NAME_LENGTH (16)
+
+/// @brief Function run by a task. Tasks must not return from it, they're deleted with cpt_platform_task_delete
+typedef void (* cpt_platform_task_function)(void * argument);
+
+/// @brief Where an allocation should be made from. External memory falls back to internal memory when there's none
+typedef enum
+{
+    CPT_PLATFORM_MEMORY_INTERNAL, // Internal RAM on the ESP32: needed by anything that is shared across cores
+    CPT_PLATFORM_MEMORY_EXTERNAL, // PSRAM on the ESP32
+} cpt_platform_memory;
+
+/// @brief Heap usage, in bytes. Fields the platform doesn't track are 0
+typedef struct
+{
+    size_t free_bytes;
+    size_t minimum_free_bytes; // Low water mark of free_bytes since boot
+    size_t allocated_bytes;
+} cpt_platform_heap_stats;
+
+/// @brief Run time of a task, see cpt_platform_task_sampler_sample. Times are in ticks of the run time clock (us with
+/// the default ESP-IDF configuration and on the host), and wrap around: only differences are meaningful
+typedef struct
+{
+    uint32_t id; // Stable for the life of the task: the task number on the ESP32, the thread id on the host
+    char name[CPT_PLATFORM_TASK_NAME_LENGTH];
+    int32_t core; // Core of an idle task, or of the task if the platform tells, CPT_PLATFORM_NO_AFFINITY otherwise
+    bool idle; // Time the core had nothing to run rather than a task. On the host it's the idle time of the CPU
+    uint32_t run_time;
+} cpt_platform_task_sample;
+
+/// @brief Samples the run time of the tasks into a buffer allocated at creation, so that sampling doesn't use the
+/// heap while a test runs
+typedef struct cpt_platform_task_sampler_state * cpt_platform_task_sampler;
+
+#if CPT_PLATFORM_ESP_IDF
+
+typedef TaskHandle_t cpt_platform_task;
+typedef SemaphoreHandle_t cpt_platform_semaphore;
+typedef EventGroupHandle_t cpt_platform_gate;
+typedef portMUX_TYPE cpt_platform_spinlock;
+
+// Core id for tasks the scheduler can run on any core
+#define CPT_PLATFORM_NO_AFFINITY ((int32_t) tskNO_AFFINITY)
+#define CPT_PLATFORM_MAX_PRIORITIES (configMAX_PRIORITIES)
+
+// Each core has its own cycle counter (CCOUNT), they aren't synchronized
+#define CPT_PLATFORM_CYCLE_COUNT_PER_CORE (1)
+
+#else
+
+typedef struct cpt_platform_task_state * cpt_platform_task;
+typedef struct cpt_platform_semaphore_state * cpt_platform_semaphore;
+typedef struct cpt_platform_gate_state * cpt_platform_gate;
+typedef pthread_spinlock_t cpt_platform_spinlock;
+
+#define CPT_PLATFORM_NO_AFFINITY (INT32_MAX)
+
+// Priorities are accepted for compatibility but ignored: real-time scheduling on Linux needs privileges
+#define CPT_PLATFORM_MAX_PRIORITIES (25)
+
+// The cycle counter is the monotonic clock, the same on all cores
+#define CPT_PLATFORM_CYCLE_COUNT_PER_CORE (0)
+
+#endif //CPT_PLATFORM_ESP_IDF
+
+/// @brief get the current time in us, from a monotonic high resolution clock
+uint64_t cpt_platform_get_time_us();
+
+/// @brief get the cycle counter of the calling core. On the host it's the monotonic clock in ns, truncated to 32
+/// bits like the ESP32 counter: only differences are meaningful
+static inline uint32_t cpt_platform_get_cycle_count()
+{
+#if CPT_PLATFORM_ESP_IDF
+    return esp_cpu_get_cycle_count();
+#else
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint32_t) ((uint64_t) now.tv_sec * 1000000000 + now.tv_nsec);
+#endif //CPT_PLATFORM_ESP_IDF
+}
+
+/// @brief get the number of cycle counter ticks per us
+uint32_t cpt_platform_get_cycles_per_us();
+
+/// @brief get the number of cores tasks can be pinned to
+int32_t cpt_platform_get_core_count();
+
+/// @brief get the core the caller is running on
+int32_t cpt_platform_get_core_id();
+
+/// @brief Creates a task
+/// @param stack_size in bytes, the host backend may round it up to its minimum
+/// @param core the core to pin the task to, or CPT_PLATFORM_NO_AFFINITY
+/// @param task set to the new task on success
+/// @return ESP_OK, ESP_ERR_NO_MEM if the task can't be created
+esp_err_t cpt_platform_task_create(cpt_platform_task_function function, const char * name, uint32_t stack_size, void * argument,
+    uint32_t priority, int32_t core, cpt_platform_task * task);
+
+/// @brief Deletes a task other than the caller. On the host the task must be blocked in a platform call (a wait on a
+/// notification, semaphore or gate) or spinning in a loop that calls cpt_platform_task_allow_delete for the deletion
+/// to complete
+void cpt_platform_task_delete(cpt_platform_task task);
+
+/// @brief Lets a pending deletion of the calling task complete. To be called in busy waits: on the host a thread can
+/// only be cancelled at a cancellation point, which spinning never reaches. Nothing to do on the ESP32
+static inline void cpt_platform_task_allow_delete()
+{
+#if CPT_PLATFORM_LINUX
+    pthread_testcancel();
+#endif //CPT_PLATFORM_LINUX
+}
+
+/// @brief gets the calling task. On the host, threads not created with cpt_platform_task_create get one on first call
+cpt_platform_task cpt_platform_task_get_current();
+
+/// @brief gets how much of its stack a task never used since it was created: its high water mark
+/// @param unused_bytes set to the high water mark, in bytes
+/// @return ESP_OK, ESP_ERR_NOT_SUPPORTED on the host, where stacks aren't filled with a pattern at creation
+esp_err_t cpt_platform_task_get_stack_high_water_mark(cpt_platform_task task, uint32_t * unused_bytes);
+
+/// @brief gets the size of the control block of a task (the TCB on the ESP32), allocated on top of its stack
+size_t cpt_platform_task_get_control_block_size();
+
+/// @brief gets the current priority of a task, which includes any priority inherited through a mutex
+uint32_t cpt_platform_task_get_priority(cpt_platform_task task);
+void cpt_platform_task_set_priority(cpt_platform_task task, uint32_t priority);
+
+/// @brief Relinquishes the CPU to tasks of the same priority
+static inline void cpt_platform_yield()
+{
+#if CPT_PLATFORM_ESP_IDF
+    taskYIELD();
+#else
+    sched_yield();
+#endif //CPT_PLATFORM_ESP_IDF
+}
+
+/// @brief Blocks the caller for at least ms, rounded up to a tick on the ESP32
+void cpt_platform_delay_ms(uint32_t ms);
+
+/// @brief Increments the notification count of a task, see cpt_platform_notify_take
+void cpt_platform_notify_give(cpt_platform_task task);
+
+/// @brief Waits for the notification count of the calling task to be non zero, then clears it
+/// @param max_wait_ms the timeout, or CPT_WAIT_FOREVER
+/// @return the count before clearing it, 0 on timeout
+uint32_t cpt_platform_notify_take(uint32_t max_wait_ms);
+
+/// @brief Semaphores: a mutex (with priority inheritance on the ESP32), a binary semaphore created given, and a
+/// counting semaphore. All return NULL if out of memory
+cpt_platform_semaphore cpt_platform_semaphore_create_mutex();
+cpt_platform_semaphore cpt_platform_semaphore_create_binary();
+cpt_platform_semaphore cpt_platform_semaphore_create_counting(uint32_t max_count, uint32_t initial_count);
+void cpt_platform_semaphore_delete(cpt_platform_semaphore semaphore);
+
+/// @param max_wait_ms the timeout, or CPT_WAIT_FOREVER
+/// @return true if taken, false on timeout
+bool cpt_platform_semaphore_take(cpt_platform_semaphore semaphore, uint32_t max_wait_ms);
+
+/// @brief Takes a semaphore if it's available, without blocking
+/// @return true if taken
+bool cpt_platform_semaphore_try_take(cpt_platform_semaphore semaphore);
+void cpt_platform_semaphore_give(cpt_platform_semaphore semaphore);
+
+/// @brief Spinlocks. On the ESP32 they're critical sections, which also disable interrupts on the holder's core
+void cpt_platform_spinlock_init(cpt_platform_spinlock * spinlock);
+
+static inline void cpt_platform_spinlock_enter(cpt_platform_spinlock * spinlock)
+{
+#if CPT_PLATFORM_ESP_IDF
+    taskENTER_CRITICAL(spinlock);
+#else
+    // Rather than pthread_spin_lock, so that a task spinning here can be deleted
+    while (pthread_spin_trylock(spinlock) != 0)
+    {
+        cpt_platform_task_allow_delete();
+    }
+#endif //CPT_PLATFORM_ESP_IDF
+}
+
+static inline void cpt_platform_spinlock_exit(cpt_platform_spinlock * spinlock)
+{
+#if CPT_PLATFORM_ESP_IDF
+    taskEXIT_CRITICAL(spinlock);
+#else
+    pthread_spin_unlock(spinlock);
+#endif //CPT_PLATFORM_ESP_IDF
+}
+
+/// @brief Gates block tasks until they're opened, then let every task through at once and stay open. Used as a
+/// start barrier
+/// @return the gate, closed, or NULL if out of memory
+cpt_platform_gate cpt_platform_gate_create();
+void cpt_platform_gate_delete(cpt_platform_gate gate);
+void cpt_platform_gate_open(cpt_platform_gate gate);
+void cpt_platform_gate_wait(cpt_platform_gate gate);
+
+/// @brief Allocates memory
+/// @param alignment a power of 2, or 0 for the natural alignment
+/// @return the memory, to be freed with cpt_platform_free, or NULL
+void * cpt_platform_malloc(size_t size, size_t alignment, cpt_platform_memory memory);
+void cpt_platform_free(void * memory);
+
+void cpt_platform_get_heap_stats(cpt_platform_heap_stats * stats);
+
+/// @param capacity the number of tasks that can be sampled
+/// @return the sampler, or NULL if out of memory
+cpt_platform_task_sampler cpt_platform_task_sampler_create(size_t capacity);
+void cpt_platform_task_sampler_delete(cpt_platform_task_sampler sampler);
+
+/// @brief Takes the run time of all tasks
+/// @param samples filled with up to the capacity of the sampler
+/// @param count set to the number of samples filled
+/// @param time set to the run time clock when the samples were taken
+/// @return ESP_OK, ESP_ERR_INVALID_SIZE if there are more tasks than the capacity of the sampler (ESP32 only, the host
+/// drops the extra ones), ESP_ERR_NOT_SUPPORTED if run time stats aren't enabled
+esp_err_t cpt_platform_task_sampler_sample(cpt_platform_task_sampler sampler, cpt_platform_task_sample * samples, size_t * count, uint32_t * time);
+
+/// @brief Logs the tasks in the system and their CPU usage
+/// @return ESP_OK, or an error code if the platform can't list them
+esp_err_t cpt_platform_log_tasks();
+
+/// @brief Little endian CRC32 (the one of Ethernet and zlib), chainable: crc is the result of the previous chunk,
+/// 0 for the first one
+uint32_t cpt_platform_crc32_le(uint32_t crc, const uint8_t * buffer, uint32_t length);
+
+#endif //__CPT_PLATFORM_H__
\ No newline at end of file
@@ -0,0 +1,358 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "cpt_platform.h"
+
+#if CPT_PLATFORM_ESP_IDF
+
+#include <stdio.h>
+
+#include "esp_check.h"
+#include "esp_heap_caps.h"
+#include "esp_log.h"
+#include "esp_rom_crc.h"
+#include "esp_rom_sys.h"
+#include "esp_timer.h"
+
+#define TAG "platform"
+
+// Waits are in ms, CPT_WAIT_FOREVER for no timeout
+#define CPT_PLATFORM_TICKS(max_wait_ms) ((max_wait_ms) == CPT_WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(max_wait_ms))
+
+// Set in a gate's event group when it's open
+#define CPT_PLATFORM_GATE_OPEN_BIT (1 << 0)
+
+uint64_t cpt_platform_get_time_us()
+{
+    return (uint64_t) esp_timer_get_time();
+}
+
+uint32_t cpt_platform_get_cycles_per_us()
+{
+    return esp_rom_get_cpu_ticks_per_us();
+}
+
+int32_t cpt_platform_get_core_count()
+{
+    return portNUM_PROCESSORS;
+}
+
+int32_t cpt_platform_get_core_id()
+{
+    return xPortGetCoreID();
+}
+
+esp_err_t cpt_platform_task_create(cpt_platform_task_function function, const char * name, uint32_t stack_size, void * argument,
+    uint32_t priority, int32_t core, cpt_platform_task * task)
+{
+    BaseType_t task_create_ret = xTaskCreatePinnedToCore(
+        function,                   // task function
+        name,                       // task name
+        stack_size,                 // stack size
+        argument,                   // context passed to task function
+        priority,                   // task priority
+        task,                       // task handle (output parameter)
+        core);                      // core
+
+    ESP_RETURN_ON_FALSE(task_create_ret == pdPASS, ESP_ERR_NO_MEM, TAG, "Unable to create task %s", name);
+
+    return ESP_OK;
+}
+
+void cpt_platform_task_delete(cpt_platform_task task)
+{
+    vTaskDelete(task);
+}
+
+cpt_platform_task cpt_platform_task_get_current()
+{
+    return xTaskGetCurrentTaskHandle();
+}
+
+esp_err_t cpt_platform_task_get_stack_high_water_mark(cpt_platform_task task, uint32_t * unused_bytes)
+{
+    // ESP-IDF stacks are in bytes rather than words
+    * unused_bytes = uxTaskGetStackHighWaterMark(task);
+
+    return ESP_OK;
+}
+
+size_t cpt_platform_task_get_control_block_size()
+{
+    // Same layout as the TCB, which is private to the kernel
+    return sizeof(StaticTask_t);
+}
+
+uint32_t cpt_platform_task_get_priority(cpt_platform_task task)
+{
+    return uxTaskPriorityGet(task);
+}
+
+void cpt_platform_task_set_priority(cpt_platform_task task, uint32_t priority)
+{
+    vTaskPrioritySet(task, priority);
+}
+
+void cpt_platform_delay_ms(uint32_t ms)
+{
+    // At least a tick, a 0 delay would only yield
+    vTaskDelay(ms > portTICK_PERIOD_MS ? pdMS_TO_TICKS(ms) : 1);
+}
+
+void cpt_platform_notify_give(cpt_platform_task task)
+{
+    xTaskNotifyGive(task);
+}
+
+uint32_t cpt_platform_notify_take(uint32_t max_wait_ms)
+{
+    return ulTaskNotifyTake(pdTRUE, CPT_PLATFORM_TICKS(max_wait_ms));
+}
+
+cpt_platform_semaphore cpt_platform_semaphore_create_mutex()
+{
+    return xSemaphoreCreateMutex();
+}
+
+cpt_platform_semaphore cpt_platform_semaphore_create_binary()
+{
+    // Binary semaphores are created empty
+    SemaphoreHandle_t semaphore = xSemaphoreCreateBinary();
+
+    if (semaphore != NULL)
+    {
+        xSemaphoreGive(semaphore);
+    }
+
+    return semaphore;
+}
+
+cpt_platform_semaphore cpt_platform_semaphore_create_counting(uint32_t max_count, uint32_t initial_count)
+{
+    return xSemaphoreCreateCounting(max_count, initial_count);
+}
+
+void cpt_platform_semaphore_delete(cpt_platform_semaphore semaphore)
+{
+    vSemaphoreDelete(semaphore);
+}
+
+bool cpt_platform_semaphore_take(cpt_platform_semaphore semaphore, uint32_t max_wait_ms)
+{
+    return xSemaphoreTake(semaphore, CPT_PLATFORM_TICKS(max_wait_ms)) == pdTRUE;
+}
+
+bool cpt_platform_semaphore_try_take(cpt_platform_semaphore semaphore)
+{
+    return xSemaphoreTake(semaphore, 0) == pdTRUE;
+}
+
+void cpt_platform_semaphore_give(cpt_platform_semaphore semaphore)
+{
+    xSemaphoreGive(semaphore);
+}
+
+void cpt_platform_spinlock_init(cpt_platform_spinlock * spinlock)
+{
+    portMUX_INITIALIZE(spinlock);
+}
+
+cpt_platform_gate cpt_platform_gate_create()
+{
+    return xEventGroupCreate();
+}
+
+void cpt_platform_gate_delete(cpt_platform_gate gate)
+{
+    vEventGroupDelete(gate);
+}
+
+void cpt_platform_gate_open(cpt_platform_gate gate)
+{
+    // Unblocks every waiting task in a single call, rather than one task at a time
+    xEventGroupSetBits(gate, CPT_PLATFORM_GATE_OPEN_BIT);
+}
+
+void cpt_platform_gate_wait(cpt_platform_gate gate)
+{
+    // The bit is never cleared, so a task reaching this point after the gate opened goes through right away
+    xEventGroupWaitBits(gate, CPT_PLATFORM_GATE_OPEN_BIT, pdFALSE, pdTRUE, portMAX_DELAY);
+}
+
+void * cpt_platform_malloc(size_t size, size_t alignment, cpt_platform_memory memory)
+{
+    uint32_t caps = (memory == CPT_PLATFORM_MEMORY_EXTERNAL ? MALLOC_CAP_SPIRAM : MALLOC_CAP_INTERNAL) | MALLOC_CAP_8BIT;
+    void * allocated = alignment > 0 ? heap_caps_aligned_alloc(alignment, size, caps) : heap_caps_malloc(size, caps);
+
+    if (allocated == NULL && memory == CPT_PLATFORM_MEMORY_EXTERNAL)
+    {
+        ESP_LOGD(TAG, "No external memory for %zu bytes, using internal memory", size);
+        return cpt_platform_malloc(size, alignment, CPT_PLATFORM_MEMORY_INTERNAL);
+    }
+
+    return allocated;
+}
+
+void cpt_platform_free(void * memory)
+{
+    heap_caps_free(memory);
+}
+
+void cpt_platform_get_heap_stats(cpt_platform_heap_stats * stats)
+{
+    multi_heap_info_t heap_info = (multi_heap_info_t) {0};
+    heap_caps_get_info(&heap_info, 0); // 0 matches all heaps, stats will be totalled across them
+
+    * stats = (cpt_platform_heap_stats) {
+        .free_bytes = heap_info.total_free_bytes,
+        .minimum_free_bytes = heap_info.minimum_free_bytes,
+        .allocated_bytes = heap_info.total_allocated_bytes,
+    };
+}
+
+// To properly log the task status (e.g. uxTaskGetSystemState) you'll need to enable the RTOS tracing features
+// via setting the build option -DCONFIG_FREERTOS_USE_TRACE_FACILITY, and GENERATE_RUN_TIME_STATS for the CPU usage
+esp_err_t cpt_platform_log_tasks()
+{
+    TaskStatus_t * task_statuses = NULL;
+
+    volatile UBaseType_t task_count;
+    esp_err_t ret = ESP_OK;
+
+    task_count = uxTaskGetNumberOfTasks();
+    ESP_LOGI(TAG, "==== Tasks stats ====");
+    ESP_LOGI(TAG, "%d tasks in system", task_count);
+    ESP_GOTO_ON_FALSE(task_count > 0, ESP_ERR_INVALID_STATE, exit, TAG, "No tasks in system");
+
+    task_statuses = pvPortMalloc(task_count * sizeof(TaskStatus_t));
+    ESP_GOTO_ON_FALSE(task_statuses != NULL, ESP_ERR_NO_MEM, exit, TAG, "Unable to allocate task info structures");
+
+    uint32_t total_run_time = 0;
+    float percentage_run_time;
+    float total_run_time_float;
+
+    task_count = uxTaskGetSystemState(task_statuses, task_count, &total_run_time);
+    ESP_GOTO_ON_FALSE(task_count > 0, ESP_ERR_INVALID_STATE, exit, TAG, "Unable to get tasks");
+    ESP_GOTO_ON_FALSE(total_run_time > 0, ESP_ERR_INVALID_STATE, exit, TAG, "Unable to get runtime");
+
+    total_run_time_float = (float)total_run_time / 100;
+
+    ESP_LOGI(TAG, "-------------- --------- ---- ----------------");
+    ESP_LOGI(TAG, "Name           CPU usage Prio Stack high water");
+    ESP_LOGI(TAG, "-------------- --------- ---- ----------------");
+
+    for (int i = 0; i < task_count; i ++)
+    {
+        percentage_run_time = (float)task_statuses[i].ulRunTimeCounter / total_run_time_float;
+        ESP_LOGI(TAG, "%-16s %6.2f%% %4d %16lu",
+            task_statuses[i].pcTaskName, 
+            percentage_run_time,
+            task_statuses[i].uxCurrentPriority,
+            task_statuses[i].usStackHighWaterMark);
+    }
+
+    exit:
+    if (task_statuses)
+    {
+        vPortFree(task_statuses);
+    }
+
+    return ret;
+}
+
+struct cpt_platform_task_sampler_state
+{
+    size_t capacity;
+    TaskStatus_t statuses[];
+};
+
+cpt_platform_task_sampler cpt_platform_task_sampler_create(size_t capacity)
+{
+    cpt_platform_task_sampler sampler = heap_caps_malloc(sizeof(struct cpt_platform_task_sampler_state) + capacity * sizeof(TaskStatus_t),
+        MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+
+    if (sampler != NULL)
+    {
+        sampler->capacity = capacity;
+    }
+
+    return sampler;
+}
+
+void cpt_platform_task_sampler_delete(cpt_platform_task_sampler sampler)
+{
+    heap_caps_free(sampler);
+}
+
+// Needs the same build options as cpt_platform_log_tasks
+esp_err_t cpt_platform_task_sampler_sample(cpt_platform_task_sampler sampler, cpt_platform_task_sample * samples, size_t * count, uint32_t * time)
+{
+    uint32_t total_run_time = 0;
+    UBaseType_t task_count = uxTaskGetSystemState(sampler->statuses, sampler->capacity, &total_run_time);
+
+    * count = 0;
+    ESP_RETURN_ON_FALSE(task_count > 0, ESP_ERR_INVALID_SIZE, TAG, "More than %d tasks to sample", sampler->capacity);
+    ESP_RETURN_ON_FALSE(total_run_time > 0, ESP_ERR_NOT_SUPPORTED, TAG, "Run time stats not enabled");
+
+    for (UBaseType_t i = 0; i < task_count; i ++)
+    {
+        const TaskStatus_t * status = &sampler->statuses[i];
+        cpt_platform_task_sample * sample = &samples[i];
+
+        * sample = (cpt_platform_task_sample) {
+            .id = status->xTaskNumber,
+            .core = CPT_PLATFORM_NO_AFFINITY,
+            .run_time = status->ulRunTimeCounter,
+        };
+        snprintf(sample->name, sizeof(sample->name), "%s", status->pcTaskName);
+
+        // The handles of the idle tasks stay valid, unlike the ones of tasks that may be deleted since the snapshot
+        for (int32_t core = 0; core < portNUM_PROCESSORS; core ++)
+        {
+            if (status->xHandle == xTaskGetIdleTaskHandleForCPU(core))
+            {
+                sample->core = core;
+                sample->idle = true;
+            }
+        }
+
+#if CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+        if (! sample->idle)
+        {
+            sample->core = status->xCoreID;
+        }
+#endif //CONFIG_FREERTOS_VTASKLIST_INCLUDE_COREID
+    }
+
+    * count = task_count;
+    * time = total_run_time;
+
+    return ESP_OK;
+}
+
+uint32_t cpt_platform_crc32_le(uint32_t crc, const uint8_t * buffer, uint32_t length)
+{
+    return esp_rom_crc32_le(crc, buffer, length);
+}
+
+#endif //CPT_PLATFORM_ESP_IDF
\ No newline at end of file
@@ -0,0 +1,643 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+// For the affinity and thread naming extensions. Before any header, as it changes what they declare
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+
+#include "cpt_platform.h"
+
+#if CPT_PLATFORM_LINUX
+
+#include <dirent.h>
+#include <errno.h>
+#include <malloc.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "esp_check.h"
+#include "esp_log.h"
+
+#define TAG "platform"
+
+// Smallest stack given to a thread: ESP32 stack sizes are far too small for glibc
+#define CPT_PLATFORM_MIN_STACK_SIZE (64 * 1024)
+
+/// @brief A pthread with the notification count of a FreeRTOS task
+struct cpt_platform_task_state
+{
+    pthread_t thread;
+    bool created; // false for threads not created with cpt_platform_task_create
+    char name[CPT_PLATFORM_TASK_NAME_LENGTH];
+    cpt_platform_task_function function;
+    void * argument;
+    int32_t core;
+    uint32_t priority; // Only kept to be read back, threads all run with the default policy
+
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    uint32_t notification_count;
+};
+
+struct cpt_platform_semaphore_state
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    uint32_t count;
+    uint32_t max_count;
+};
+
+struct cpt_platform_gate_state
+{
+    pthread_mutex_t mutex;
+    pthread_cond_t condition;
+    bool open;
+};
+
+struct cpt_platform_task_sampler_state
+{
+    size_t capacity;
+};
+
+static __thread cpt_platform_task cpt_platform_current_task;
+
+static uint64_t cpt_platform_get_time_ns()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+uint64_t cpt_platform_get_time_us()
+{
+    return cpt_platform_get_time_ns() / 1000;
+}
+
+uint32_t cpt_platform_get_cycles_per_us()
+{
+    // The cycle counter is the monotonic clock in ns
+    return 1000;
+}
+
+int32_t cpt_platform_get_core_count()
+{
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return count > 0 ? count : 1;
+}
+
+int32_t cpt_platform_get_core_id()
+{
+    return sched_getcpu();
+}
+
+// Condition variables use the monotonic clock, so that timeouts aren't affected by changes of the wall clock
+static void cpt_platform_init_condition(pthread_cond_t * condition)
+{
+    pthread_condattr_t attributes;
+
+    pthread_condattr_init(&attributes);
+    pthread_condattr_setclock(&attributes, CLOCK_MONOTONIC);
+    pthread_cond_init(condition, &attributes);
+    pthread_condattr_destroy(&attributes);
+}
+
+static struct timespec cpt_platform_get_deadline(uint32_t max_wait_ms)
+{
+    uint64_t deadline_ns = cpt_platform_get_time_ns() + (uint64_t) max_wait_ms * 1000000;
+
+    return (struct timespec) {
+        .tv_sec = deadline_ns / 1000000000,
+        .tv_nsec = deadline_ns % 1000000000,
+    };
+}
+
+// Waits on a condition with its mutex locked, until deadline or forever with CPT_WAIT_FOREVER. Returns false on timeout
+static bool cpt_platform_wait_condition(pthread_cond_t * condition, pthread_mutex_t * mutex, uint32_t max_wait_ms, const struct timespec * deadline)
+{
+    if (max_wait_ms == CPT_WAIT_FOREVER)
+    {
+        return pthread_cond_wait(condition, mutex) == 0;
+    }
+
+    return pthread_cond_timedwait(condition, mutex, deadline) != ETIMEDOUT;
+}
+
+// Deleted tasks are cancelled while waiting on a condition, which returns with the mutex locked
+static void cpt_platform_unlock_mutex(void * mutex)
+{
+    pthread_mutex_unlock((pthread_mutex_t *) mutex);
+}
+
+static cpt_platform_task cpt_platform_allocate_task(const char * name)
+{
+    cpt_platform_task task = calloc(1, sizeof(struct cpt_platform_task_state));
+
+    if (task != NULL)
+    {
+        snprintf(task->name, sizeof(task->name), "%s", name);
+        task->core = CPT_PLATFORM_NO_AFFINITY;
+        pthread_mutex_init(&task->mutex, NULL);
+        cpt_platform_init_condition(&task->condition);
+    }
+
+    return task;
+}
+
+static void cpt_platform_free_task(cpt_platform_task task)
+{
+    pthread_cond_destroy(&task->condition);
+    pthread_mutex_destroy(&task->mutex);
+    free(task);
+}
+
+static void * cpt_platform_task_start(void * parameters)
+{
+    cpt_platform_task task = (cpt_platform_task) parameters;
+
+    cpt_platform_current_task = task;
+    task->function(task->argument);
+
+    return NULL;
+}
+
+esp_err_t cpt_platform_task_create(cpt_platform_task_function function, const char * name, uint32_t stack_size, void * argument,
+    uint32_t priority, int32_t core, cpt_platform_task * task)
+{
+    esp_err_t ret = ESP_OK;
+    pthread_attr_t attributes;
+    cpt_platform_task new_task = cpt_platform_allocate_task(name);
+
+    * task = NULL;
+    ESP_RETURN_ON_FALSE(new_task != NULL, ESP_ERR_NO_MEM, TAG, "Unable to allocate task %s", name);
+
+    new_task->created = true;
+    new_task->function = function;
+    new_task->argument = argument;
+    new_task->core = core;
+    new_task->priority = priority;
+
+    pthread_attr_init(&attributes);
+    pthread_attr_setstacksize(&attributes, stack_size > CPT_PLATFORM_MIN_STACK_SIZE ? stack_size : CPT_PLATFORM_MIN_STACK_SIZE);
+
+    if (core != CPT_PLATFORM_NO_AFFINITY)
+    {
+        cpu_set_t cpus;
+
+        CPU_ZERO(&cpus);
+        CPU_SET(core % cpt_platform_get_core_count(), &cpus);
+        pthread_attr_setaffinity_np(&attributes, sizeof(cpus), &cpus);
+    }
+
+    int create_ret = pthread_create(&new_task->thread, &attributes, cpt_platform_task_start, new_task);
+    pthread_attr_destroy(&attributes);
+    ESP_GOTO_ON_FALSE(create_ret == 0, ESP_ERR_NO_MEM, exit, TAG, "Unable to create task %s: %s", name, strerror(create_ret));
+
+    pthread_setname_np(new_task->thread, new_task->name);
+    * task = new_task;
+
+    exit:
+    if (ret != ESP_OK)
+    {
+        cpt_platform_free_task(new_task);
+    }
+
+    return ret;
+}
+
+void cpt_platform_task_delete(cpt_platform_task task)
+{
+    if (! task->created)
+    {
+        ESP_LOGE(TAG, "Task %s wasn't created by the platform, not deleting it", task->name);
+        return;
+    }
+
+    // Joining releases the thread, and makes sure it's not using its state anymore
+    pthread_cancel(task->thread);
+    pthread_join(task->thread, NULL);
+    cpt_platform_free_task(task);
+}
+
+cpt_platform_task cpt_platform_task_get_current()
+{
+    if (cpt_platform_current_task == NULL)
+    {
+        char name[CPT_PLATFORM_TASK_NAME_LENGTH];
+
+        pthread_getname_np(pthread_self(), name, sizeof(name));
+        cpt_platform_current_task = cpt_platform_allocate_task(name);
+
+        if (cpt_platform_current_task != NULL)
+        {
+            cpt_platform_current_task->thread = pthread_self();
+        }
+    }
+
+    return cpt_platform_current_task;
+}
+
+esp_err_t cpt_platform_task_get_stack_high_water_mark(cpt_platform_task task, uint32_t * unused_bytes)
+{
+    // Threads don't track how deep their stack went
+    (void) task;
+    * unused_bytes = 0;
+
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+size_t cpt_platform_task_get_control_block_size()
+{
+    // The thread descriptor of the C library sits at the top of the stack, and is not counted
+    return sizeof(struct cpt_platform_task_state);
+}
+
+uint32_t cpt_platform_task_get_priority(cpt_platform_task task)
+{
+    return task->priority;
+}
+
+void cpt_platform_task_set_priority(cpt_platform_task task, uint32_t priority)
+{
+    task->priority = priority;
+}
+
+void cpt_platform_delay_ms(uint32_t ms)
+{
+    struct timespec delay = {
+        .tv_sec = ms / 1000,
+        .tv_nsec = (long) (ms % 1000) * 1000000,
+    };
+
+    while (nanosleep(&delay, &delay) != 0 && errno == EINTR)
+    {
+    }
+}
+
+void cpt_platform_notify_give(cpt_platform_task task)
+{
+    pthread_mutex_lock(&task->mutex);
+    task->notification_count ++;
+    pthread_cond_signal(&task->condition);
+    pthread_mutex_unlock(&task->mutex);
+}
+
+uint32_t cpt_platform_notify_take(uint32_t max_wait_ms)
+{
+    cpt_platform_task task = cpt_platform_task_get_current();
+    struct timespec deadline = cpt_platform_get_deadline(max_wait_ms);
+    uint32_t count;
+
+    pthread_mutex_lock(&task->mutex);
+    pthread_cleanup_push(cpt_platform_unlock_mutex, &task->mutex);
+
+    while (task->notification_count == 0 && cpt_platform_wait_condition(&task->condition, &task->mutex, max_wait_ms, &deadline))
+    {
+    }
+
+    count = task->notification_count;
+    task->notification_count = 0;
+
+    pthread_cleanup_pop(1);
+
+    return count;
+}
+
+static cpt_platform_semaphore cpt_platform_semaphore_create(uint32_t max_count, uint32_t initial_count)
+{
+    cpt_platform_semaphore semaphore = calloc(1, sizeof(struct cpt_platform_semaphore_state));
+
+    if (semaphore != NULL)
+    {
+        pthread_mutex_init(&semaphore->mutex, NULL);
+        cpt_platform_init_condition(&semaphore->condition);
+        semaphore->count = initial_count;
+        semaphore->max_count = max_count;
+    }
+
+    return semaphore;
+}
+
+cpt_platform_semaphore cpt_platform_semaphore_create_mutex()
+{
+    // No priority inheritance, priorities are ignored on the host anyway
+    return cpt_platform_semaphore_create(1, 1);
+}
+
+cpt_platform_semaphore cpt_platform_semaphore_create_binary()
+{
+    return cpt_platform_semaphore_create(1, 1);
+}
+
+cpt_platform_semaphore cpt_platform_semaphore_create_counting(uint32_t max_count, uint32_t initial_count)
+{
+    return cpt_platform_semaphore_create(max_count, initial_count);
+}
+
+void cpt_platform_semaphore_delete(cpt_platform_semaphore semaphore)
+{
+    pthread_cond_destroy(&semaphore->condition);
+    pthread_mutex_destroy(&semaphore->mutex);
+    free(semaphore);
+}
+
+bool cpt_platform_semaphore_take(cpt_platform_semaphore semaphore, uint32_t max_wait_ms)
+{
+    struct timespec deadline = cpt_platform_get_deadline(max_wait_ms);
+    uint32_t count;
+
+    pthread_mutex_lock(&semaphore->mutex);
+    pthread_cleanup_push(cpt_platform_unlock_mutex, &semaphore->mutex);
+
+    while (semaphore->count == 0 && cpt_platform_wait_condition(&semaphore->condition, &semaphore->mutex, max_wait_ms, &deadline))
+    {
+    }
+
+    count = semaphore->count;
+    semaphore->count -= count > 0 ? 1 : 0;
+
+    pthread_cleanup_pop(1);
+
+    return count > 0;
+}
+
+bool cpt_platform_semaphore_try_take(cpt_platform_semaphore semaphore)
+{
+    bool taken;
+
+    pthread_mutex_lock(&semaphore->mutex);
+    taken = semaphore->count > 0;
+    semaphore->count -= taken ? 1 : 0;
+    pthread_mutex_unlock(&semaphore->mutex);
+
+    return taken;
+}
+
+void cpt_platform_semaphore_give(cpt_platform_semaphore semaphore)
+{
+    pthread_mutex_lock(&semaphore->mutex);
+
+    if (semaphore->count < semaphore->max_count)
+    {
+        semaphore->count ++;
+        pthread_cond_signal(&semaphore->condition);
+    }
+
+    pthread_mutex_unlock(&semaphore->mutex);
+}
+
+void cpt_platform_spinlock_init(cpt_platform_spinlock * spinlock)
+{
+    pthread_spin_init(spinlock, PTHREAD_PROCESS_PRIVATE);
+}
+
+cpt_platform_gate cpt_platform_gate_create()
+{
+    cpt_platform_gate gate = calloc(1, sizeof(struct cpt_platform_gate_state));
+
+    if (gate != NULL)
+    {
+        pthread_mutex_init(&gate->mutex, NULL);
+        cpt_platform_init_condition(&gate->condition);
+    }
+
+    return gate;
+}
+
+void cpt_platform_gate_delete(cpt_platform_gate gate)
+{
+    pthread_cond_destroy(&gate->condition);
+    pthread_mutex_destroy(&gate->mutex);
+    free(gate);
+}
+
+void cpt_platform_gate_open(cpt_platform_gate gate)
+{
+    pthread_mutex_lock(&gate->mutex);
+    gate->open = true;
+    pthread_cond_broadcast(&gate->condition);
+    pthread_mutex_unlock(&gate->mutex);
+}
+
+void cpt_platform_gate_wait(cpt_platform_gate gate)
+{
+    pthread_mutex_lock(&gate->mutex);
+    pthread_cleanup_push(cpt_platform_unlock_mutex, &gate->mutex);
+
+    while (! gate->open)
+    {
+        pthread_cond_wait(&gate->condition, &gate->mutex);
+    }
+
+    pthread_cleanup_pop(1);
+}
+
+void * cpt_platform_malloc(size_t size, size_t alignment, cpt_platform_memory memory)
+{
+    void * allocated = NULL;
+
+    // There's a single kind of memory on the host
+    (void) memory;
+
+    if (alignment == 0)
+    {
+        return malloc(size);
+    }
+
+    return posix_memalign(&allocated, alignment, size) == 0 ? allocated : NULL;
+}
+
+void cpt_platform_free(void * memory)
+{
+    free(memory);
+}
+
+void cpt_platform_get_heap_stats(cpt_platform_heap_stats * stats)
+{
+    // The free memory of a process isn't bounded in any useful way
+    struct mallinfo2 info = mallinfo2();
+
+    // Large blocks are mapped rather than taken from the heap arena
+    * stats = (cpt_platform_heap_stats) {
+        .allocated_bytes = info.uordblks + info.hblkhd,
+    };
+}
+
+esp_err_t cpt_platform_log_tasks()
+{
+    ESP_LOGI(TAG, "==== Tasks stats ====");
+    ESP_LOGI(TAG, "Not available on the host, use top -H or perf instead");
+
+    return ESP_ERR_NOT_SUPPORTED;
+}
+
+cpt_platform_task_sampler cpt_platform_task_sampler_create(size_t capacity)
+{
+    cpt_platform_task_sampler sampler = malloc(sizeof(struct cpt_platform_task_sampler_state));
+
+    if (sampler != NULL)
+    {
+        sampler->capacity = capacity;
+    }
+
+    return sampler;
+}
+
+void cpt_platform_task_sampler_delete(cpt_platform_task_sampler sampler)
+{
+    free(sampler);
+}
+
+// /proc counts in clock ticks (usually 10 ms), converted to us like the ESP32 run time clock
+static uint32_t cpt_platform_ticks_to_us(unsigned long long ticks)
+{
+    return (uint32_t)(ticks * 1000000 / sysconf(_SC_CLK_TCK));
+}
+
+// Reads the run time of the threads of the process from /proc/self/task. Unlike the ESP32 version it doesn't come
+// from a preallocated buffer, but the heap of the host isn't what's measured
+static void cpt_platform_sample_threads(cpt_platform_task_sampler sampler, cpt_platform_task_sample * samples, size_t * count)
+{
+    DIR * directory = opendir("/proc/self/task");
+    struct dirent * entry;
+    char line[512];
+
+    while (directory != NULL && * count < sampler->capacity && (entry = readdir(directory)) != NULL)
+    {
+        unsigned long long user_ticks = 0;
+        unsigned long long system_ticks = 0;
+
+        if (entry->d_name[0] == '.')
+        {
+            continue;
+        }
+
+        snprintf(line, sizeof(line), "/proc/self/task/%s/stat", entry->d_name);
+        FILE * file = fopen(line, "r");
+
+        // The thread may have exited since the directory was listed
+        if (file == NULL)
+        {
+            continue;
+        }
+
+        bool valid = fgets(line, sizeof(line), file) != NULL;
+        fclose(file);
+
+        // The name is between parentheses and may contain spaces, the fields after it are space separated
+        char * name_start = valid ? strchr(line, '(') : NULL;
+        char * name_end = valid ? strrchr(line, ')') : NULL;
+
+        if (name_start == NULL || name_end == NULL || name_end < name_start
+            || sscanf(name_end + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %llu %llu", &user_ticks, &system_ticks) != 2)
+        {
+            continue;
+        }
+
+        cpt_platform_task_sample * sample = &samples[(* count) ++];
+        int name_length = name_end - name_start - 1;
+
+        * sample = (cpt_platform_task_sample) {
+            .id = strtoul(entry->d_name, NULL, 10),
+            .core = CPT_PLATFORM_NO_AFFINITY,
+            .run_time = cpt_platform_ticks_to_us(user_ticks + system_ticks),
+        };
+        snprintf(sample->name, sizeof(sample->name), "%.*s", name_length, name_start + 1);
+    }
+
+    if (directory != NULL)
+    {
+        closedir(directory);
+    }
+}
+
+// Adds the idle time of each CPU, from /proc/stat, as the idle task of that core. Ids count down from UINT32_MAX so
+// they don't collide with thread ids
+static void cpt_platform_sample_cpus(cpt_platform_task_sampler sampler, cpt_platform_task_sample * samples, size_t * count)
+{
+    FILE * file = fopen("/proc/stat", "r");
+    char line[256];
+
+    while (file != NULL && * count < sampler->capacity && fgets(line, sizeof(line), file) != NULL)
+    {
+        int core;
+        unsigned long long idle_ticks = 0;
+        unsigned long long io_wait_ticks = 0;
+
+        // The first line ("cpu ") totals all CPUs and doesn't match
+        if (sscanf(line, "cpu%d %*u %*u %*u %llu %llu", &core, &idle_ticks, &io_wait_ticks) != 3)
+        {
+            continue;
+        }
+
+        cpt_platform_task_sample * sample = &samples[(* count) ++];
+
+        * sample = (cpt_platform_task_sample) {
+            .id = UINT32_MAX - core,
+            .core = core,
+            .idle = true,
+            .run_time = cpt_platform_ticks_to_us(idle_ticks + io_wait_ticks),
+        };
+        snprintf(sample->name, sizeof(sample->name), "idle%d", core);
+    }
+
+    if (file != NULL)
+    {
+        fclose(file);
+    }
+}
+
+esp_err_t cpt_platform_task_sampler_sample(cpt_platform_task_sampler sampler, cpt_platform_task_sample * samples, size_t * count, uint32_t * time)
+{
+    * count = 0;
+    * time = (uint32_t) cpt_platform_get_time_us();
+
+    cpt_platform_sample_threads(sampler, samples, count);
+    cpt_platform_sample_cpus(sampler, samples, count);
+
+    return * count > 0 ? ESP_OK : ESP_ERR_NOT_SUPPORTED;
+}
+
+uint32_t cpt_platform_crc32_le(uint32_t crc, const uint8_t * buffer, uint32_t length)
+{
+    // Bitwise, there's no ROM table on the host. Slower than the ESP32 version, but the same result
+    crc = ~crc;
+
+    for (uint32_t i = 0; i < length; i ++)
+    {
+        crc ^= buffer[i];
+
+        for (int bit = 0; bit < 8; bit ++)
+        {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+
+    return ~crc;
+}
+
+#endif //CPT_PLATFORM_LINUX
\ No newline at end of file
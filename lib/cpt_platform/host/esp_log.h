@@ -0,0 +1,55 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __ESP_LOG_H__
+#define __ESP_LOG_H__
+
+// Host stand-in for the ESP-IDF header of the same name: same macros and output format, printed on stdout with a
+// ms timestamp. Debug and verbose logs are compiled out unless CPT_HOST_LOG_DEBUG is set
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <time.h>
+
+#ifndef CPT_HOST_LOG_DEBUG
+#define CPT_HOST_LOG_DEBUG (0)
+#endif
+
+static inline uint32_t esp_log_timestamp()
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint32_t) (now.tv_sec * 1000 + now.tv_nsec / 1000000);
+}
+
+#define ESP_HOST_LOG(letter, tag, format, ...) \
+    printf(letter " (%" PRIu32 ") %s: " format "\n", esp_log_timestamp(), tag, ##__VA_ARGS__)
+
+#define ESP_LOGE(tag, format, ...) ESP_HOST_LOG("E", tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_HOST_LOG("W", tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_HOST_LOG("I", tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) do { if (CPT_HOST_LOG_DEBUG) { ESP_HOST_LOG("D", tag, format, ##__VA_ARGS__); } } while (0)
+#define ESP_LOGV(tag, format, ...) do { if (CPT_HOST_LOG_DEBUG) { ESP_HOST_LOG("V", tag, format, ##__VA_ARGS__); } } while (0)
+
+#endif //__ESP_LOG_H__
\ No newline at end of file
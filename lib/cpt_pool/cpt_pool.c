@@ -0,0 +1,290 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdio.h>
+
+#include "esp_check.h"
+#include "esp_log.h"
+
+#include "cpt_pool.h"
+
+#define TAG "pool"
+
+static cpt_pool_worker cpt_pool_workers[CPT_POOL_SIZE];
+
+static uint32_t cpt_pool_stack_size = CPT_POOL_STACK_SIZE; // Stack of the tasks created from now on
+static uint32_t cpt_pool_max_stack_used; // Deepest stack use measured so far, across all workers
+static bool cpt_pool_measuring; // Between cpt_pool_footprint_begin and cpt_pool_footprint_end
+static cpt_pool_footprint cpt_pool_current_footprint;
+
+static void cpt_pool_worker_function(void * parameters)
+{
+    cpt_pool_worker * worker = (cpt_pool_worker *) parameters;
+
+    while (true)
+    {
+        cpt_platform_notify_take(CPT_WAIT_FOREVER);
+
+        // Functions use notifications too, one of theirs may be left over from the previous run: only run a
+        // function when one was given
+        cpt_pool_function function = atomic_exchange(&worker->function, NULL);
+        if (function == NULL)
+        {
+            continue;
+        }
+
+        function(worker->argument);
+        worker->run_count ++;
+        atomic_store(&worker->busy, false);
+    }
+}
+
+static esp_err_t cpt_pool_create_task(cpt_pool_worker * worker, int32_t core, uint32_t priority)
+{
+    char task_name[CPT_PLATFORM_TASK_NAME_LENGTH];
+    cpt_platform_heap_stats heap_before;
+    cpt_platform_heap_stats heap_after;
+
+    if (snprintf(task_name, CPT_PLATFORM_TASK_NAME_LENGTH, "pool_%u", (uint8_t) (worker - cpt_pool_workers)) >= CPT_PLATFORM_TASK_NAME_LENGTH)
+    {
+        ESP_LOGE(TAG, "Task name is truncated");
+    }
+
+    * worker = (cpt_pool_worker) {
+        .core = core,
+        .stack_size = cpt_pool_stack_size,
+    };
+
+    // The stack and the control block are on the heap on the ESP32, the host maps its stacks outside of it
+    cpt_platform_get_heap_stats(&heap_before);
+    esp_err_t ret = cpt_platform_task_create(cpt_pool_worker_function, task_name, worker->stack_size, worker, priority, core, &worker->handle);
+    cpt_platform_get_heap_stats(&heap_after);
+
+    if (ret == ESP_OK && cpt_pool_measuring)
+    {
+        cpt_pool_current_footprint.created_count ++;
+        cpt_pool_current_footprint.created_heap_bytes += heap_after.allocated_bytes - heap_before.allocated_bytes;
+    }
+
+    return ret;
+}
+
+// Adds an acquired worker to the footprint being measured, if any
+static void cpt_pool_measure(cpt_pool_worker * worker)
+{
+    if (cpt_pool_measuring && ! worker->measured)
+    {
+        worker->measured = true;
+        cpt_pool_current_footprint.worker_count ++;
+        cpt_pool_current_footprint.stack_bytes += worker->stack_size;
+        cpt_pool_current_footprint.control_block_bytes += cpt_platform_task_get_control_block_size();
+    }
+}
+
+esp_err_t cpt_pool_acquire(int32_t core, uint32_t priority, cpt_pool_worker ** worker)
+{
+    cpt_pool_worker * empty = NULL;
+    cpt_pool_worker * recyclable = NULL;
+
+    * worker = NULL;
+
+    for (int i = 0; i < CPT_POOL_SIZE; i ++)
+    {
+        cpt_pool_worker * candidate = &cpt_pool_workers[i];
+
+        if (candidate->acquired)
+        {
+            continue;
+        }
+
+        if (candidate->handle == NULL)
+        {
+            empty = empty == NULL ? candidate : empty;
+        }
+        else if (candidate->core == core && candidate->stack_size == cpt_pool_stack_size)
+        {
+            // Best case: an idle task already pinned where needed
+            candidate->acquired = true;
+            cpt_platform_task_set_priority(candidate->handle, priority);
+            cpt_pool_measure(candidate);
+            * worker = candidate;
+            return ESP_OK;
+        }
+        else
+        {
+            recyclable = recyclable == NULL ? candidate : recyclable;
+        }
+    }
+
+    if (empty == NULL && recyclable != NULL)
+    {
+        ESP_LOGD(TAG, "Recycling worker %d from core %"PRId32" to core %"PRId32" stack %"PRIu32" bytes", (int) (recyclable - cpt_pool_workers),
+            recyclable->core, core, cpt_pool_stack_size);
+        cpt_platform_task_delete(recyclable->handle);
+        recyclable->handle = NULL;
+        empty = recyclable;
+    }
+
+    ESP_RETURN_ON_FALSE(empty != NULL, ESP_ERR_NO_MEM, TAG, "All %d workers are in use", CPT_POOL_SIZE);
+    ESP_RETURN_ON_ERROR(cpt_pool_create_task(empty, core, priority), TAG, "Unable to create a worker");
+
+    empty->acquired = true;
+    cpt_pool_measure(empty);
+    * worker = empty;
+
+    return ESP_OK;
+}
+
+void cpt_pool_start(cpt_pool_worker * worker, cpt_pool_function function, void * argument)
+{
+    atomic_store(&worker->busy, true);
+    worker->argument = argument;
+
+    // The function is published last: the worker reads the argument after taking it
+    atomic_store(&worker->function, function);
+    cpt_platform_notify_give(worker->handle);
+}
+
+void cpt_pool_release(cpt_pool_worker * worker)
+{
+    // Functions usually signal the end of a run just before returning, give them a chance to do so
+    for (int waited_ms = 0; atomic_load(&worker->busy) && waited_ms < CPT_POOL_RELEASE_TIMEOUT_MS; waited_ms += CPT_POOL_RELEASE_POLL_MS)
+    {
+        cpt_platform_delay_ms(CPT_POOL_RELEASE_POLL_MS);
+    }
+
+    if (atomic_load(&worker->busy))
+    {
+        ESP_LOGW(TAG, "Worker %d still busy, deleting it", (int) (worker - cpt_pool_workers));
+        cpt_platform_task_delete(worker->handle);
+        worker->handle = NULL;
+        atomic_store(&worker->busy, false);
+        atomic_store(&worker->function, NULL);
+    }
+
+    worker->acquired = false;
+}
+
+#if CPT_POOL_ENABLE_AUTO_STACK_SIZE
+// Changes the stack of the tasks created from now on. Idle workers are parked, the ones with another stack are deleted
+static void cpt_pool_set_stack_size(uint32_t stack_size)
+{
+    if (stack_size == cpt_pool_stack_size)
+    {
+        return;
+    }
+
+    ESP_LOGI(TAG, "Stack size of new workers: %"PRIu32" -> %"PRIu32" bytes", cpt_pool_stack_size, stack_size);
+    cpt_pool_stack_size = stack_size;
+
+    for (int i = 0; i < CPT_POOL_SIZE; i ++)
+    {
+        cpt_pool_worker * worker = &cpt_pool_workers[i];
+
+        if (worker->handle != NULL && ! worker->acquired && worker->stack_size != stack_size)
+        {
+            cpt_platform_task_delete(worker->handle);
+            worker->handle = NULL;
+        }
+    }
+}
+#endif //CPT_POOL_ENABLE_AUTO_STACK_SIZE
+
+void cpt_pool_footprint_begin()
+{
+    cpt_pool_current_footprint = (cpt_pool_footprint) {0};
+    cpt_pool_measuring = true;
+}
+
+void cpt_pool_footprint_end(cpt_pool_footprint * footprint)
+{
+    for (int i = 0; i < CPT_POOL_SIZE; i ++)
+    {
+        cpt_pool_worker * worker = &cpt_pool_workers[i];
+        uint32_t unused_bytes;
+
+        if (! worker->measured)
+        {
+            continue;
+        }
+
+        worker->measured = false;
+
+        // Workers deleted on release (still busy) can't be measured
+        if (worker->handle != NULL && cpt_platform_task_get_stack_high_water_mark(worker->handle, &unused_bytes) == ESP_OK)
+        {
+            uint32_t stack_used = worker->stack_size - unused_bytes;
+            if (stack_used > cpt_pool_current_footprint.max_stack_used)
+            {
+                cpt_pool_current_footprint.max_stack_used = stack_used;
+            }
+        }
+    }
+
+    cpt_pool_measuring = false;
+    * footprint = cpt_pool_current_footprint;
+
+    if (footprint->max_stack_used > cpt_pool_max_stack_used)
+    {
+        cpt_pool_max_stack_used = footprint->max_stack_used;
+    }
+
+#if CPT_POOL_ENABLE_AUTO_STACK_SIZE
+    if (cpt_pool_max_stack_used > 0)
+    {
+        cpt_pool_set_stack_size(cpt_pool_get_fitted_stack_size(cpt_pool_max_stack_used));
+    }
+#endif //CPT_POOL_ENABLE_AUTO_STACK_SIZE
+}
+
+uint32_t cpt_pool_get_fitted_stack_size(uint32_t stack_used)
+{
+    uint32_t stack_size = (stack_used * (100 + CPT_POOL_STACK_SAFETY_MARGIN) / 100 + 15) & ~UINT32_C(15);
+
+    return stack_size > CPT_POOL_MIN_STACK_SIZE ? stack_size : CPT_POOL_MIN_STACK_SIZE;
+}
+
+void cpt_pool_log_status()
+{
+    ESP_LOGI(TAG, "==== Worker pool ====");
+
+    for (int i = 0; i < CPT_POOL_SIZE; i ++)
+    {
+        const cpt_pool_worker * worker = &cpt_pool_workers[i];
+        uint32_t unused_bytes;
+        char stack_used[12] = "n/a";
+
+        if (worker->handle != NULL)
+        {
+            if (cpt_platform_task_get_stack_high_water_mark(worker->handle, &unused_bytes) == ESP_OK)
+            {
+                snprintf(stack_used, sizeof(stack_used), "%"PRIu32, worker->stack_size - unused_bytes);
+            }
+
+            ESP_LOGI(TAG, "worker %d core: %"PRId32" stack: %"PRIu32" used: %s runs: %lu%s", i, worker->core, worker->stack_size,
+                stack_used, worker->run_count, worker->acquired ? " (acquired)" : "");
+        }
+    }
+
+    ESP_LOGI(TAG, "Deepest stack use: %"PRIu32" bytes, stack of new workers: %"PRIu32" bytes", cpt_pool_max_stack_used, cpt_pool_stack_size);
+}
\ No newline at end of file
@@ -0,0 +1,119 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __CPT_POOL_H__
+#define __CPT_POOL_H__
+
+#include "esp_err.h"
+#include "stdatomic.h"
+
+#include "cpt_globals.h"
+#include "cpt_platform.h"
+
+// Most worker tasks alive at once: enough for any engine at the maximum concurrency, plus a helper task (the actor
+// engine's owner)
+#define CPT_POOL_SIZE (CPT_MAX_CONCURRENCY_COUNT + 1)
+
+// The stack size to be used for worker tasks, the largest any engine needs. With CPT_POOL_ENABLE_AUTO_STACK_SIZE it's
+// the size until the first measurement.
+// Anything below 1000 causes assertions in simple operations like logging.
+#define CPT_POOL_STACK_SIZE (2048)
+
+// Size the stacks of the tasks created from then on after each measurement (see cpt_pool_footprint_end): the deepest
+// stack use measured so far, plus CPT_POOL_STACK_SAFETY_MARGIN percent, and at least CPT_POOL_MIN_STACK_SIZE. Idle
+// workers with another stack size are deleted, to be created again as needed. Only what was run is measured: code
+// paths going deeper later on (another engine, workload or logging level) have the margin only. ESP32 only, the host
+// can't measure stacks
+#define CPT_POOL_ENABLE_AUTO_STACK_SIZE (0)
+#define CPT_POOL_STACK_SAFETY_MARGIN (50)
+#define CPT_POOL_MIN_STACK_SIZE (1024)
+
+// How long cpt_pool_release waits for a worker to return from its function before deleting it, and how often it checks
+#define CPT_POOL_RELEASE_TIMEOUT_MS (100)
+#define CPT_POOL_RELEASE_POLL_MS (10)
+
+/// @brief Function run by a worker, the same as a FreeRTOS task function except that it may return
+typedef void (* cpt_pool_function)(void * argument);
+
+/// @brief A task of the pool. Between runs it's parked on its task notification
+typedef struct
+{
+    cpt_platform_task handle; // NULL if the slot has no task
+    int32_t core; // Core the task is pinned to, or CPT_PLATFORM_NO_AFFINITY
+    uint32_t stack_size; // Stack the task was created with, in bytes
+    bool acquired; // Owned by an engine
+    volatile _Atomic cpt_pool_function function; // Set by cpt_pool_start, taken by the task when it wakes up
+    void * argument;
+    volatile atomic_bool busy; // From cpt_pool_start until the function returns
+    unsigned long run_count; // Functions run by this task
+    bool measured; // Acquired since cpt_pool_footprint_begin
+} cpt_pool_worker;
+
+/// @brief Memory taken by the workers acquired between cpt_pool_footprint_begin and cpt_pool_footprint_end
+typedef struct
+{
+    uint8_t worker_count; // Workers acquired
+    uint8_t created_count; // Of which had to be created (or recycled), rather than reused
+    uint32_t stack_bytes; // Stacks of the workers acquired
+    size_t control_block_bytes; // Control blocks of the workers acquired
+    size_t created_heap_bytes; // Heap taken by creating tasks, allocator overhead included
+    uint32_t max_stack_used; // Deepest stack use of a worker, 0 if the platform can't tell. Tasks are reused across
+                             // runs and engines: it's the deepest since the task was created
+} cpt_pool_footprint;
+
+// The pool is global: its tasks outlive the engines using them, so that tasks aren't created and deleted for each
+// run. Tasks are created on demand and can't be moved to another core once created, so a worker pinned to another
+// core is recycled (deleted and created again) only when the pool is full. Priorities are changed on acquisition.
+// None of these functions is thread safe, they're meant to be called from the task running the engines.
+
+/// @brief Takes an idle worker from the pool, creating or recycling a task if needed
+/// @param core the core the worker must be pinned to, or CPT_PLATFORM_NO_AFFINITY
+/// @param priority the priority the worker will run at
+/// @param worker set to the worker on success
+/// @return ESP_OK, or ESP_ERR_NO_MEM if all workers are acquired or the task can't be created
+esp_err_t cpt_pool_acquire(int32_t core, uint32_t priority, cpt_pool_worker ** worker);
+
+/// @brief Wakes an acquired worker up to run function. The worker parks again when the function returns
+void cpt_pool_start(cpt_pool_worker * worker, cpt_pool_function function, void * argument);
+
+/// @brief Gives a worker back to the pool. If it's still running its function after CPT_POOL_RELEASE_TIMEOUT_MS
+/// (e.g. blocked on an object of an engine that failed to initialize) the task is deleted. On the host that needs the
+/// task to block or to spin on a lock, see cpt_platform_task_delete
+void cpt_pool_release(cpt_pool_worker * worker);
+
+/// @brief Starts recording the workers acquired, see cpt_pool_footprint_end
+void cpt_pool_footprint_begin();
+
+/// @brief Measures the workers acquired since cpt_pool_footprint_begin, once they're released. With
+/// CPT_POOL_ENABLE_AUTO_STACK_SIZE it also sizes the stacks of the workers created from then on
+void cpt_pool_footprint_end(cpt_pool_footprint * footprint);
+
+/// @brief gets the stack size fitting a stack use, with CPT_POOL_STACK_SAFETY_MARGIN
+/// @param stack_used the deepest use of a stack, in bytes
+/// @return the size in bytes, a multiple of 16 and at least CPT_POOL_MIN_STACK_SIZE
+uint32_t cpt_pool_get_fitted_stack_size(uint32_t stack_used);
+
+/// @brief Logs the tasks of the pool, their stack use and how many times each was reused
+void cpt_pool_log_status();
+
+#endif //__CPT_POOL_H__
\ No newline at end of file
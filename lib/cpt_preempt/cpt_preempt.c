@@ -23,17 +23,206 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 
 #include "cpt_globals.h"
 #include "cpt_preempt.h"
+#include "cpt_utils.h"
+#include "cpt_stats.h"
 #include "esp_check.h"
+#include <string.h>
 
 #define TAG "preempt"
 
-// The stack size to be used for tasks.
-// Anything below 1000 causes assertions in simple operations like logging.
-// For practical purposes where logging/debugging is included this value should be larger than 2000
-#define CPT_TASKS_STACK_SIZE (2048)
+#if CPT_PLATFORM_ESP_IDF
+// Sleeps are rounded up to a tick, other periods would make the scenario run a different load than documented
+_Static_assert(CPT_PREEMPT_CRITICAL_PERIOD_MS % portTICK_PERIOD_MS == 0 && CPT_PREEMPT_HOG_BUSY_MS % portTICK_PERIOD_MS == 0 &&
+    CPT_PREEMPT_HOG_IDLE_MS % portTICK_PERIOD_MS == 0, "Priority inversion periods must be multiples of the tick");
+#endif //CPT_PLATFORM_ESP_IDF
+
+// Instrumentation of the task loop. The macros below compile to nothing when the related features are disabled.
+// The lock wait is always measured, as it's needed to report the worst case wait. Timestamps carry their core: a
+// task that blocked or got preempted may resume on another core, whose cycle counter can't be compared
+#if CPT_PREEMPT_ENABLE_LATENCY_HISTOGRAMS || CPT_PREEMPT_ENABLE_CONTENTION_STATS
+#define CPT_PREEMPT_TIMESTAMP(name) cpt_cycle_stamp name = cpt_get_cycle_stamp()
+#else
+#define CPT_PREEMPT_TIMESTAMP(name)
+#endif
+
+#if CPT_PREEMPT_ENABLE_LATENCY_HISTOGRAMS
+#define CPT_PREEMPT_LATENCY_TIMESTAMP(name) CPT_PREEMPT_TIMESTAMP(name)
+#define CPT_PREEMPT_RECORD_LATENCY(task, histogram, cycles) cpt_histogram_record(&(task)->latency->histogram, cycles)
+#else
+#define CPT_PREEMPT_LATENCY_TIMESTAMP(name)
+#define CPT_PREEMPT_RECORD_LATENCY(task, histogram, cycles)
+#endif //CPT_PREEMPT_ENABLE_LATENCY_HISTOGRAMS
+
+// Cycles elapsed between two timestamps of a task. Samples spanning two cores are dropped and counted
+static inline bool cpt_preempt_get_elapsed(cpt_preempt_task * task, cpt_cycle_stamp start, cpt_cycle_stamp end, uint32_t * cycles)
+{
+    if (cpt_cycle_stamp_get_elapsed(start, end, cycles))
+    {
+        return true;
+    }
+
+    task->cross_core_sample_count ++;
+    return false;
+}
+
+#if CPT_PREEMPT_ENABLE_CONTENTION_STATS
+// The lock is considered contended if another task holds it at request time
+#define CPT_PREEMPT_CONTENTION_REQUEST(preempt, contended) bool contended = atomic_load_explicit(&(preempt)->shared->lock_holder, memory_order_relaxed) >= 0
+#define CPT_PREEMPT_CONTENTION_ACQUIRED(preempt, task, contended) cpt_preempt_contention_acquired(preempt, task, contended)
+#define CPT_PREEMPT_CONTENTION_RELEASING(preempt) atomic_store_explicit(&(preempt)->shared->lock_holder, -1, memory_order_relaxed)
+#define CPT_PREEMPT_RECORD_CONTENTION(task, total, cycles) (task)->contention.total += (cycles)
+
+// Called with the job lock held
+static inline void cpt_preempt_contention_acquired(cpt_preempt * preempt, cpt_preempt_task * task, bool contended)
+{
+    int32_t core = cpt_platform_get_core_id();
+
+    atomic_store_explicit(&preempt->shared->lock_holder, (int8_t) task->index, memory_order_relaxed);
+
+    if (contended)
+    {
+        task->contention.contended_count ++;
+    }
+    else
+    {
+        task->contention.uncontended_count ++;
+    }
+
+    if (preempt->shared->last_holder_core >= 0 && preempt->shared->last_holder_core != core)
+    {
+        task->contention.cross_core_handoff_count ++;
+    }
+
+    preempt->shared->last_holder_core = core;
+}
+#else
+#define CPT_PREEMPT_CONTENTION_REQUEST(preempt, contended)
+#define CPT_PREEMPT_CONTENTION_ACQUIRED(preempt, task, contended)
+#define CPT_PREEMPT_CONTENTION_RELEASING(preempt)
+#define CPT_PREEMPT_RECORD_CONTENTION(task, total, cycles)
+#endif //CPT_PREEMPT_ENABLE_CONTENTION_STATS
+
+#if CPT_PREEMPT_ENABLE_LATENCY_HISTOGRAMS || CPT_PREEMPT_ENABLE_CONTENTION_STATS
+#define CPT_PREEMPT_RECORD_HOLD(task, acquired, released) cpt_preempt_record_hold(task, acquired, released)
+
+static inline void cpt_preempt_record_hold(cpt_preempt_task * task, cpt_cycle_stamp acquired, cpt_cycle_stamp released)
+{
+    uint32_t cycles;
+
+    if (cpt_preempt_get_elapsed(task, acquired, released, &cycles))
+    {
+        CPT_PREEMPT_RECORD_LATENCY(task, lock_hold, cycles);
+        CPT_PREEMPT_RECORD_CONTENTION(task, hold_cycles, cycles);
+    }
+}
+#else
+#define CPT_PREEMPT_RECORD_HOLD(task, acquired, released)
+#endif
+
+#if CPT_PREEMPT_ENABLE_GAP_TRACKING
+#define CPT_PREEMPT_RECORD_GAP(preempt, task) cpt_preempt_record_gap(preempt, task)
+
+static inline void cpt_preempt_record_gap(cpt_preempt * preempt, cpt_preempt_task * task)
+{
+    uint64_t now = cpt_get_current_time_us();
+    uint32_t gap = now - task->last_iteration_us;
+    uint32_t slice = (now - preempt->start_time_us) / CPT_PREEMPT_GAP_SLICE_US;
+
+    slice = slice < CPT_PREEMPT_GAP_SLICE_COUNT ? slice : CPT_PREEMPT_GAP_SLICE_COUNT - 1;
+
+    if (gap > task->max_gap_us[slice])
+    {
+        task->max_gap_us[slice] = gap;
+    }
+
+    task->last_iteration_us = now;
+}
+#else
+#define CPT_PREEMPT_RECORD_GAP(preempt, task)
+#endif //CPT_PREEMPT_ENABLE_GAP_TRACKING
+
+#if CPT_PREEMPT_ENABLE_TRACE
+#define CPT_PREEMPT_TRACE(task, type, argument) cpt_trace_record((task)->trace, type, argument)
+#else
+#define CPT_PREEMPT_TRACE(task, type, argument)
+#endif //CPT_PREEMPT_ENABLE_TRACE
 
 static void cpt_preempt_task_function(void * parameters);
 
+// Gives a task its role and priority, according to the scenario
+static void cpt_preempt_assign_role(const cpt_config * config, cpt_preempt_task * task)
+{
+    uint8_t hog_count = (config->concurrency - 1) / 2;
+
+    task->role = CPT_PREEMPT_ROLE_WORKER;
+    task->priority = config->priority;
+
+    if (config->scenario == CPT_SCENARIO_PRIORITY_INVERSION)
+    {
+        if (task->index == 0)
+        {
+            task->role = CPT_PREEMPT_ROLE_LATENCY_CRITICAL;
+            task->priority = config->priority + 2;
+        }
+        else if (task->index <= hog_count)
+        {
+            task->role = CPT_PREEMPT_ROLE_HOG;
+            task->priority = config->priority + 1;
+        }
+    }
+}
+
+static const char * cpt_preempt_role_to_name(cpt_preempt_role role)
+{
+    switch (role)
+    {
+        case CPT_PREEMPT_ROLE_WORKER:
+            return "worker";
+        case CPT_PREEMPT_ROLE_LATENCY_CRITICAL:
+            return "latency_critical";
+        case CPT_PREEMPT_ROLE_HOG:
+            return "hog";
+        default:
+            return "invalid";
+    }
+}
+
+static inline size_t cpt_preempt_align_up(size_t size, size_t alignment)
+{
+    return (size + alignment - 1) / alignment * alignment;
+}
+
+/// @brief allocates the block holding params, shared and the task slots, and lays them out in it
+static esp_err_t cpt_preempt_allocate_layout(cpt_preempt * preempt, cpt_layout layout, uint8_t task_count)
+{
+    // Packed parts only get their natural alignment, padded ones start on a line and don't share it with anything
+    size_t line = layout == CPT_LAYOUT_PADDED ? CPT_CACHE_LINE_SIZE : 1;
+    size_t shared_alignment = line > _Alignof(cpt_preempt_shared) ? line : _Alignof(cpt_preempt_shared);
+    size_t task_alignment = line > _Alignof(cpt_preempt_task) ? line : _Alignof(cpt_preempt_task);
+
+    size_t shared_offset = cpt_preempt_align_up(sizeof(cpt_preempt_params), shared_alignment);
+    size_t tasks_offset = cpt_preempt_align_up(shared_offset + sizeof(cpt_preempt_shared), task_alignment);
+    size_t task_stride = cpt_preempt_align_up(sizeof(cpt_preempt_task), task_alignment);
+    size_t block_size = cpt_preempt_align_up(tasks_offset + task_count * task_stride, line);
+
+    // Internal memory only: the external memory cache isn't coherent across cores on ESP32, so atomics can't go there
+    uint8_t * block = cpt_platform_malloc(block_size, CPT_CACHE_LINE_SIZE, CPT_PLATFORM_MEMORY_INTERNAL);
+    ESP_RETURN_ON_FALSE(block != NULL, ESP_ERR_NO_MEM, TAG, "Unable to allocate %zu bytes for the %s layout", block_size, cpt_layout_to_name(layout));
+    memset(block, 0, block_size);
+
+    preempt->layout_block = block;
+    preempt->layout = layout;
+    preempt->params = (cpt_preempt_params *) block;
+    preempt->shared = (cpt_preempt_shared *)(block + shared_offset);
+    preempt->cpt_tasks = (cpt_preempt_task *)(block + tasks_offset);
+    preempt->task_stride = task_stride;
+
+    ESP_LOGD(TAG, "%s layout: %zu bytes, shared at %zu, tasks at %zu, task stride %zu",
+        cpt_layout_to_name(layout), block_size, shared_offset, tasks_offset, task_stride);
+
+    return ESP_OK;
+}
+
 /// @brief change the state for this object and notify waiting task (if set)
 /// @details If set, the task pending for state changes will be unblocked
 /// @param new_state the state to set this cpt_preempt object to
@@ -41,16 +230,22 @@ static void cpt_preempt_task_function(void * parameters);
 static esp_err_t cpt_preempt_set_state(cpt_preempt *preempt, cpt_state new_state)
 {
     ESP_LOGD(TAG, "Changing state from %d to %d", atomic_load(&preempt->state), new_state);
+#if CPT_PREEMPT_ENABLE_TRACE
+    // Several tasks can change the state (e.g. the last to initialize, the last to finish)
+    cpt_trace_clock_synchronize(&preempt->trace_clock);
+    cpt_trace_record_shared(preempt->state_trace, CPT_TRACE_STATE_CHANGE, new_state);
+#endif //CPT_PREEMPT_ENABLE_TRACE
+
     // Set the state first
     atomic_store(&preempt->state, new_state);
 
     // Then read the handle
-    volatile TaskHandle_t waiting_task_handle = atomic_load(&preempt->waiting_task_handle);
+    volatile cpt_platform_task waiting_task_handle = atomic_load(&preempt->waiting_task_handle);
 
     // Notify task if necessary
     if (waiting_task_handle != NULL)
     {
-        xTaskNotifyGive(waiting_task_handle);
+        cpt_platform_notify_give(waiting_task_handle);
     }
 
     return ESP_OK;
@@ -58,8 +253,8 @@ static esp_err_t cpt_preempt_set_state(cpt_preempt *preempt, cpt_state new_state
 
 esp_err_t cpt_preempt_wait_for_state_change(cpt_preempt * preempt, uint32_t max_wait_ms, cpt_state expected_state)
 {
-    TaskHandle_t this_task_handle = xTaskGetCurrentTaskHandle();
-    TaskHandle_t null_task_handle = NULL;
+    cpt_platform_task this_task_handle = cpt_platform_task_get_current();
+    cpt_platform_task null_task_handle = NULL;
     volatile cpt_state current_state = CPT_STATE_NONE;
     uint32_t notification_value = 0;
 
@@ -75,7 +270,7 @@ esp_err_t cpt_preempt_wait_for_state_change(cpt_preempt * preempt, uint32_t max_
         if (current_state != expected_state)
         {
             // Block here
-            notification_value = ulTaskNotifyTake(pdTRUE, max_wait_ms == CPT_WAIT_FOREVER ? portMAX_DELAY : pdMS_TO_TICKS(max_wait_ms));
+            notification_value = cpt_platform_notify_take(max_wait_ms);
             if (notification_value == 0)
             {
                 break;
@@ -85,43 +280,105 @@ esp_err_t cpt_preempt_wait_for_state_change(cpt_preempt * preempt, uint32_t max_
 
     atomic_store(&preempt->waiting_task_handle, NULL);
 
-    return notification_value == 0 ? ESP_ERR_TIMEOUT : ESP_OK;
+    return current_state == expected_state ? ESP_OK : ESP_ERR_TIMEOUT;
 }
 
-esp_err_t cpt_preempt_init(cpt_preempt * preempt, cpt_job * job)
+esp_err_t cpt_preempt_init(cpt_preempt * preempt, cpt_job * job, const cpt_config * config)
 {
     * preempt = (cpt_preempt) {0};
     esp_err_t ret = ESP_OK;
 
-    preempt->job = job;
-    preempt->job_lock = xSemaphoreCreateCounting(1, 1);
-    ESP_GOTO_ON_FALSE(preempt->job_lock != NULL, ESP_ERR_INVALID_STATE, exit, TAG, "Unable to create semaphore");
+    ret = cpt_config_validate(config);
+    ESP_GOTO_ON_ERROR(ret, exit, TAG, "Invalid configuration");
+
+    if (config->scenario == CPT_SCENARIO_PRIORITY_INVERSION)
+    {
+        // A latency critical worker, a hog and a holder, with the two levels above the configured priority available
+        ESP_GOTO_ON_FALSE(config->concurrency >= 3 && config->priority + 2 < CPT_PLATFORM_MAX_PRIORITIES && config->job_backend == CPT_JOB_BACKEND_LOCKED,
+            ESP_ERR_INVALID_ARG, exit, TAG, "The %s scenario needs 3 workers or more, priority %d or less and the locked backend",
+            cpt_scenario_to_name(config->scenario), CPT_PLATFORM_MAX_PRIORITIES - 3);
+    }
+
+    ret = cpt_preempt_allocate_layout(preempt, config->layout, config->concurrency);
+    ESP_GOTO_ON_ERROR(ret, exit, TAG, "Unable to allocate the task state");
+
+    preempt->params->job = job;
+    preempt->task_count = config->concurrency;
+#if CPT_PREEMPT_ENABLE_CONTENTION_STATS
+    preempt->shared->lock_holder = -1;
+    preempt->shared->last_holder_core = -1;
+#endif //CPT_PREEMPT_ENABLE_CONTENTION_STATS
+    preempt->params->job_backend = config->job_backend;
+    preempt->params->batch_size = config->batch_size;
+    preempt->params->adaptive_batch = config->adaptive_batch;
+    preempt->params->scenario = config->scenario;
+    preempt->params->yield_policy = config->yield_policy;
+    ret = cpt_lock_init(&preempt->shared->job_lock, config->lock_type);
+    ESP_GOTO_ON_ERROR(ret, exit, TAG, "Unable to create job lock: %s", esp_err_to_name(ret));
+
+    // The latency critical worker has the highest priority of the tasks taking the lock
+    cpt_lock_set_ceiling(&preempt->shared->job_lock,
+        config->scenario == CPT_SCENARIO_PRIORITY_INVERSION ? config->priority + 2 : config->priority);
+
+    preempt->start_barrier = cpt_platform_gate_create();
+    ESP_GOTO_ON_FALSE(preempt->start_barrier != NULL, ESP_ERR_NO_MEM, exit, TAG, "Unable to create the start barrier");
+
+#if CPT_PREEMPT_ENABLE_TRACE
+    preempt->state_trace = cpt_trace_buffer_create();
+    ESP_GOTO_ON_FALSE(preempt->state_trace != NULL, ESP_ERR_NO_MEM, exit, TAG, "Unable to allocate the state trace");
+#endif //CPT_PREEMPT_ENABLE_TRACE
 
-    BaseType_t task_create_ret = 0;
     ret = cpt_preempt_set_state(preempt, CPT_STATE_INITIALIZING);
     ESP_GOTO_ON_ERROR(ret, exit, TAG, "Error setting state: %s", esp_err_to_name(ret));
 
-    for (uint8_t task_index = 0; task_index < CPT_CONCURRENCY_COUNT; task_index ++)
+    for (uint8_t task_index = 0; task_index < preempt->task_count; task_index ++)
     {
-        char task_name[configMAX_TASK_NAME_LEN];
-        if (snprintf(task_name, configMAX_TASK_NAME_LEN, "task_%"PRIu8, task_index) < 0)
+        cpt_preempt_task * task = cpt_preempt_get_task(preempt, task_index);
+
+#if CPT_PREEMPT_ENABLE_LATENCY_HISTOGRAMS
+        task->latency = cpt_platform_malloc(sizeof(cpt_preempt_latency), 0, CPT_PLATFORM_MEMORY_INTERNAL);
+        ESP_GOTO_ON_FALSE(task->latency != NULL, ESP_ERR_NO_MEM, exit, TAG, "Unable to allocate histograms");
+        * task->latency = (cpt_preempt_latency) {0};
+#endif //CPT_PREEMPT_ENABLE_LATENCY_HISTOGRAMS
+#if CPT_PREEMPT_ENABLE_TRACE
+        task->trace = cpt_trace_buffer_create();
+        ESP_GOTO_ON_FALSE(task->trace != NULL, ESP_ERR_NO_MEM, exit, TAG, "Unable to allocate the trace of task %d", task_index);
+#endif //CPT_PREEMPT_ENABLE_TRACE
+
+        task->index = task_index;
+        cpt_preempt_assign_role(config, task);
+
+        // Tasks are held by the start barrier, none can be done before the count is complete
+        if (task->role != CPT_PREEMPT_ROLE_HOG)
         {
-            ESP_LOGE(TAG, "Task name is truncated");
+            atomic_fetch_add(&preempt->running_tasks_count, 1);
         }
 
-        task_create_ret = xTaskCreatePinnedToCore(
-            cpt_preempt_task_function,                    // task function
-            task_name,                                    // task name
-            CPT_TASKS_STACK_SIZE,                         // stack size
-            (void *)preempt,                              // context passed to task function
-            CPT_PREEMPT_TASK_PRIO,                        // task priority
-            &preempt->cpt_tasks[task_index].handle,       // task handle (output parameter)
-            CPT_PREEMPT_ENABLE_MULTI_CORE ? task_index % 2 : 0); // core
-    
-        ESP_GOTO_ON_FALSE(task_create_ret == pdPASS, ESP_ERR_INVALID_STATE, exit, TAG, "Unable to create task index %d", task_index);
+        // Adaptive batching starts small and grows while the lock is not contended
+        task->batch_size = config->adaptive_batch ? 1 : config->batch_size;
+        cpt_job_worker_init(&task->job_worker, task_index);
+        cpt_backoff_init(&task->lock_node.backoff, config->yield_policy);
+
+        ret = cpt_pool_acquire(cpt_affinity_get_core(config->affinity, task_index), task->priority, &task->worker);
+        ESP_GOTO_ON_ERROR(ret, exit, TAG, "Unable to get a worker for task index %d", task_index);
+
+        cpt_pool_start(task->worker, cpt_preempt_task_function, preempt);
     }
 
-    ESP_LOGI(TAG, "Tasks initialized");
+    ESP_LOGI(TAG, "%d tasks initialized, scenario: %s priority: %d affinity: %s job lock: %s yield: %s job backend: %s batch: %d%s workload: %s (%d/%d) layout: %s",
+        preempt->task_count,
+        cpt_scenario_to_name(config->scenario),
+        config->priority,
+        cpt_affinity_to_name(config->affinity),
+        cpt_lock_type_to_name(config->lock_type),
+        cpt_yield_policy_to_name(config->yield_policy),
+        cpt_job_backend_to_name(config->job_backend),
+        config->batch_size,
+        config->adaptive_batch ? " (adaptive)" : "",
+        cpt_job_workload_to_name(config->workload),
+        config->critical_size,
+        config->private_size,
+        cpt_layout_to_name(config->layout));
 
     exit:
     if (ret != ESP_OK)
@@ -136,18 +393,46 @@ void cpt_preempt_uninit(cpt_preempt * preempt)
 {
     ESP_LOGI(TAG, "uninitializing");
 
-    for (int i = 0; i < CPT_CONCURRENCY_COUNT; i ++)
+    for (int i = 0; i < preempt->task_count; i ++)
     {
-        if (preempt->cpt_tasks[i].handle != NULL)
+        cpt_preempt_task * task = cpt_preempt_get_task(preempt, i);
+
+        if (task->worker != NULL)
         {
-            ESP_LOGD(TAG, "Deleting task %d", i);
-            vTaskDelete(preempt->cpt_tasks[i].handle);
+            ESP_LOGD(TAG, "Releasing task %d", i);
+            cpt_pool_release(task->worker);
         }
+
+#if CPT_PREEMPT_ENABLE_LATENCY_HISTOGRAMS
+        if (task->latency != NULL)
+        {
+            cpt_platform_free(task->latency);
+        }
+#endif //CPT_PREEMPT_ENABLE_LATENCY_HISTOGRAMS
+#if CPT_PREEMPT_ENABLE_TRACE
+        if (task->trace != NULL)
+        {
+            cpt_platform_free(task->trace);
+        }
+#endif //CPT_PREEMPT_ENABLE_TRACE
+    }
+
+#if CPT_PREEMPT_ENABLE_TRACE
+    if (preempt->state_trace != NULL)
+    {
+        cpt_platform_free(preempt->state_trace);
+    }
+#endif //CPT_PREEMPT_ENABLE_TRACE
+
+    if (preempt->start_barrier != NULL)
+    {
+        cpt_platform_gate_delete(preempt->start_barrier);
     }
 
-    if (preempt->job_lock)
+    if (preempt->layout_block != NULL)
     {
-        vSemaphoreDelete(preempt->job_lock);
+        cpt_lock_uninit(&preempt->shared->job_lock);
+        cpt_platform_free(preempt->layout_block);
     }
 
     * preempt = (cpt_preempt) {0};
@@ -156,16 +441,13 @@ void cpt_preempt_uninit(cpt_preempt * preempt)
 // Returns -1 if the task wasn't found
 static int8_t cpt_preempt_get_current_task_index(cpt_preempt * preempt)
 {
-    TaskStatus_t task_status = {0};
-    vTaskGetInfo(
-        NULL,
-        &task_status,
-        pdFALSE,    //don't query for stack info (faster)
-        eNoAction); //don't query for task state (faster)
+    cpt_platform_task handle = cpt_platform_task_get_current();
 
-    for (int8_t i = 0; i < CPT_CONCURRENCY_COUNT; i ++)
+    for (int8_t i = 0; i < preempt->task_count; i ++)
     {
-        if (preempt->cpt_tasks[i].handle == task_status.xHandle)
+        cpt_pool_worker * worker = cpt_preempt_get_task(preempt, i)->worker;
+
+        if (worker != NULL && worker->handle == handle)
         {
             return i;
         }
@@ -174,9 +456,120 @@ static int8_t cpt_preempt_get_current_task_index(cpt_preempt * preempt)
     return -1;
 }
 
+// Runs a batch of job iterations with the backend selected at init. iterations is set to the number of job runs
+static inline cpt_job_status cpt_preempt_run_job_batch(cpt_preempt * preempt, cpt_preempt_task * task, uint16_t * iterations)
+{
+    cpt_job_status status = CPT_JOB_NOT_DONE;
+    uint16_t i = 0;
+
+    // The private part of the workload for the whole batch, outside of the critical section
+    for (uint16_t k = 0; k < task->batch_size; k ++)
+    {
+        cpt_job_run_private(preempt->params->job, &task->job_worker);
+    }
+
+    switch (preempt->params->job_backend)
+    {
+        case CPT_JOB_BACKEND_ATOMIC32:
+            for (; i < task->batch_size && status == CPT_JOB_NOT_DONE; i ++)
+            {
+                status = cpt_job_run_atomic32(preempt->params->job);
+            }
+            break;
+
+        case CPT_JOB_BACKEND_ATOMIC64:
+            for (; i < task->batch_size && status == CPT_JOB_NOT_DONE; i ++)
+            {
+                status = cpt_job_run_atomic64(preempt->params->job);
+            }
+            break;
+
+        default:
+        {
+            CPT_PREEMPT_TRACE(task, CPT_TRACE_LOCK_REQUEST, 0);
+            cpt_cycle_stamp acquire_start = cpt_get_cycle_stamp();
+            CPT_PREEMPT_CONTENTION_REQUEST(preempt, contended);
+
+            if (preempt->params->adaptive_batch)
+            {
+                atomic_fetch_add_explicit(&preempt->shared->lock_waiters, 1, memory_order_relaxed);
+            }
+
+            cpt_lock_acquire(&preempt->shared->job_lock, &task->lock_node);
+            cpt_cycle_stamp acquired = cpt_get_cycle_stamp();
+            CPT_PREEMPT_CONTENTION_ACQUIRED(preempt, task, contended);
+            CPT_PREEMPT_TRACE(task, CPT_TRACE_LOCK_ACQUIRE, task->batch_size);
+
+            if (preempt->params->adaptive_batch)
+            {
+                atomic_fetch_sub_explicit(&preempt->shared->lock_waiters, 1, memory_order_relaxed);
+            }
+
+            for (; i < task->batch_size && status == CPT_JOB_NOT_DONE; i ++)
+            {
+                status = cpt_job_run(preempt->params->job);
+            }
+
+            if (preempt->params->adaptive_batch)
+            {
+                // Additive increase while nobody's waiting, multiplicative decrease as soon as someone is: this bounds
+                // the wait of the other tasks when contended, and amortizes the acquisitions when not
+                if (atomic_load_explicit(&preempt->shared->lock_waiters, memory_order_relaxed) > 0)
+                {
+                    task->batch_size = task->batch_size > 1 ? task->batch_size / 2 : 1;
+                }
+                else if (task->batch_size < preempt->params->batch_size)
+                {
+                    task->batch_size ++;
+                }
+            }
+
+            CPT_PREEMPT_CONTENTION_RELEASING(preempt);
+            cpt_lock_release(&preempt->shared->job_lock, &task->lock_node);
+            CPT_PREEMPT_TIMESTAMP(released);
+            CPT_PREEMPT_TRACE(task, CPT_TRACE_LOCK_RELEASE, 0);
+
+            uint32_t lock_wait_cycles;
+
+            if (cpt_preempt_get_elapsed(task, acquire_start, acquired, &lock_wait_cycles))
+            {
+                if (lock_wait_cycles > task->max_lock_wait_cycles)
+                {
+                    task->max_lock_wait_cycles = lock_wait_cycles;
+                }
+
+                CPT_PREEMPT_RECORD_LATENCY(task, lock_wait, lock_wait_cycles);
+                CPT_PREEMPT_RECORD_CONTENTION(task, wait_cycles, lock_wait_cycles);
+            }
+
+            CPT_PREEMPT_RECORD_HOLD(task, acquired, released);
+            break;
+        }
+    }
+
+    * iterations = i;
+    return status;
+}
+
+// Keeps the CPU busy with the private part of the workload, in bursts, until the job is done. The job lock is never taken
+static void cpt_preempt_run_hog(cpt_preempt * preempt, cpt_preempt_task * task)
+{
+    while (atomic_load(&preempt->state) != CPT_STATE_DONE)
+    {
+        uint64_t busy_end_us = cpt_get_current_time_us() + CPT_PREEMPT_HOG_BUSY_MS * 1000;
+
+        while (cpt_get_current_time_us() < busy_end_us && atomic_load(&preempt->state) != CPT_STATE_DONE)
+        {
+            cpt_job_run_private(preempt->params->job, &task->job_worker);
+        }
+
+        cpt_platform_delay_ms(CPT_PREEMPT_HOG_IDLE_MS);
+    }
+}
+
 // Initialization times are removed from the perf measurement, so we'll have all tasks
-// enter a suspended state right after terminating their initialization. The job_run method
-// will wait for the tasks to be suspended before starting the preemptive run test.
+// wait on the start barrier right after terminating their initialization. The job_run method
+// releases them all at once.
 static void cpt_preempt_task_function(void * parameters)
 {
     bool done = false;
@@ -189,38 +582,77 @@ static void cpt_preempt_task_function(void * parameters)
         return;
     }
 
-    if (atomic_fetch_add(&preempt->initialized_tasks_count, 1) == CPT_CONCURRENCY_COUNT - 1)
+    if (atomic_fetch_add(&preempt->initialized_tasks_count, 1) == preempt->task_count - 1)
     {
         cpt_preempt_set_state(preempt, CPT_STATE_INITIALIZED);
     }
 
-    // Suspend the current task. It will be resumed by a call to start()
-    // There is a non-zero time interval between the fetch-add above and when the task is suspended, so 
-    // the obj_run method will have to poll for the tread state and spin for a while
-    ESP_LOGD(TAG, "suspending task %d, waiting for start", task_index);
-    vTaskSuspend(NULL);
-    ESP_LOGD(TAG, "task %d resumed", task_index);
+    // The gate stays open, so a task reaching this point after the release goes through right away
+    ESP_LOGD(TAG, "task %d waiting for start", task_index);
+    cpt_platform_gate_wait(preempt->start_barrier);
+
+    cpt_preempt_task * task = cpt_preempt_get_task(preempt, task_index);
+    task->start_us = cpt_get_current_time_us();
+
+#if CPT_PREEMPT_ENABLE_TRACE
+    cpt_trace_clock_synchronize(&preempt->trace_clock);
+#endif //CPT_PREEMPT_ENABLE_TRACE
+
+    if (task->role == CPT_PREEMPT_ROLE_HOG)
+    {
+        // The job is done by the other tasks, which also signal it
+        cpt_preempt_run_hog(preempt, task);
+        return;
+    }
+
+#if CPT_PREEMPT_ENABLE_GAP_TRACKING
+    // The first gap is measured from the start of the run, so that a late start counts as starvation
+    task->last_iteration_us = preempt->start_time_us;
+#endif //CPT_PREEMPT_ENABLE_GAP_TRACKING
 
     while (! done)
     {
-        xSemaphoreTake(preempt->job_lock, portMAX_DELAY);
-        done = cpt_job_run(preempt->job) == CPT_JOB_DONE;
-        xSemaphoreGive(preempt->job_lock);
+        CPT_PREEMPT_LATENCY_TIMESTAMP(iteration_start);
+
+        uint16_t iterations;
+        done = cpt_preempt_run_job_batch(preempt, task, &iterations) == CPT_JOB_DONE;
+        CPT_PREEMPT_RECORD_GAP(preempt, task);
 
         // Doesn't need to be in the critical section as it's accessed by this task only
-        preempt->cpt_tasks[task_index].counter ++;
+        task->counter += iterations;
+
+        // Job done, relinquish any remaining CPU to allow other threads to run, as the yield policy says
+        CPT_PREEMPT_TRACE(task, CPT_TRACE_YIELD, 0);
+
+        if (task->role == CPT_PREEMPT_ROLE_LATENCY_CRITICAL)
+        {
+            // Sleeps instead: like a control loop, it needs the lock once per period and is otherwise idle
+            cpt_platform_delay_ms(CPT_PREEMPT_CRITICAL_PERIOD_MS);
+        }
+        else
+        {
+            cpt_backoff_after_batch(&task->lock_node.backoff, task->lock_node.backoff.contended);
+        }
+
+        CPT_PREEMPT_LATENCY_TIMESTAMP(iteration_end);
+#if CPT_PREEMPT_ENABLE_LATENCY_HISTOGRAMS
+        uint32_t total_cycles;
 
-        // Job done, relinquish any remaining CPU to allow other threads to run
-        taskYIELD();
+        if (cpt_preempt_get_elapsed(task, iteration_start, iteration_end, &total_cycles))
+        {
+            CPT_PREEMPT_RECORD_LATENCY(task, total, total_cycles);
+        }
+#endif //CPT_PREEMPT_ENABLE_LATENCY_HISTOGRAMS
     }
 
-    // signal that we're done
-    cpt_preempt_set_state(preempt, CPT_STATE_DONE);
+    CPT_PREEMPT_TRACE(task, CPT_TRACE_JOB_DONE, task->counter > UINT16_MAX ? UINT16_MAX : task->counter);
 
-    // FreeRTOS tasks can't return, wait for deletion here
-    while (true)
+    // The last task to finish signals that we're done, so that no task is still waiting for the lock or updating its
+    // counters when the report is made. Hogs stop on it. Returning parks the worker until the pool hands it to the
+    // next run
+    if (atomic_fetch_sub(&preempt->running_tasks_count, 1) == 1)
     {
-        taskYIELD();
+        cpt_preempt_set_state(preempt, CPT_STATE_DONE);
     }
 }
 
@@ -228,39 +660,284 @@ esp_err_t cpt_preempt_run_job(cpt_preempt * preempt)
 {
     ESP_LOGI(TAG, "Starting job");
 
-    // Here we wait until all tasks are initialized (the last task that's initialized will signal then suspend itself)
-    cpt_preempt_wait_for_state_change(preempt, CPT_WAIT_FOREVER, CPT_STATE_INITIALIZED);
+    // Here we wait until all tasks are initialized (the last task that's initialized will signal then wait on the barrier)
+    esp_err_t ret = cpt_preempt_wait_for_state_change(preempt, CPT_WAIT_FOREVER, CPT_STATE_INITIALIZED);
+    ESP_RETURN_ON_ERROR(ret, TAG, "Error waiting for initialization: %s", esp_err_to_name(ret));
+
+    cpt_preempt_set_state(preempt, CPT_STATE_RUNNING);
+
+    // Release all tasks at once, rather than one task at a time. Time measurement should begin here
+    preempt->start_time_us = cpt_get_current_time_us();
+    cpt_platform_gate_open(preempt->start_barrier);
+
+    return ESP_OK;
+}
+
+#if CPT_PREEMPT_ENABLE_LATENCY_HISTOGRAMS
+static void cpt_preempt_log_histogram(int task_index, const char * name, const cpt_histogram * histogram)
+{
+    ESP_LOGI(TAG, "%4d %-9s %9"PRIu32" %9"PRIu32" %9"PRIu32" %9"PRIu32" %9"PRIu32" %9"PRIu32,
+        task_index,
+        name,
+        histogram->total_count,
+        cpt_cycles_to_ns(cpt_histogram_get_percentile(histogram, 50)),
+        cpt_cycles_to_ns(cpt_histogram_get_percentile(histogram, 90)),
+        cpt_cycles_to_ns(cpt_histogram_get_percentile(histogram, 99)),
+        cpt_cycles_to_ns(cpt_histogram_get_percentile(histogram, 99.9)),
+        cpt_cycles_to_ns(histogram->max));
+}
+#endif //CPT_PREEMPT_ENABLE_LATENCY_HISTOGRAMS
+
+#if CPT_PREEMPT_ENABLE_TRACE
+// Writes the traces to the console between markers, save the part in between as a .json file to open it in Perfetto
+static void cpt_preempt_dump_trace(cpt_preempt * preempt)
+{
+    const cpt_trace_buffer * buffers[CPT_MAX_CONCURRENCY_COUNT + 1];
+    uint8_t tracks[CPT_MAX_CONCURRENCY_COUNT + 1];
+    char name[CPT_PLATFORM_TASK_NAME_LENGTH];
+
+    ESP_LOGI(TAG, "==== Trace ====");
+
+    for (int i = 0; i < preempt->task_count; i ++)
+    {
+        buffers[i] = cpt_preempt_get_task(preempt, i)->trace;
+        tracks[i] = i;
+        snprintf(name, sizeof(name), "task %d", i);
+        cpt_trace_log_summary(name, buffers[i]);
+    }
+
+    buffers[preempt->task_count] = preempt->state_trace;
+    tracks[preempt->task_count] = CPT_TRACE_ENGINE_TRACK;
+    cpt_trace_log_summary("engine", preempt->state_trace);
+
+    ESP_LOGI(TAG, "---- Chrome trace JSON begin ----");
+    cpt_trace_write_chrome(stdout, &preempt->trace_clock, buffers, tracks, preempt->task_count + 1, preempt->start_time_us);
+    ESP_LOGI(TAG, "---- Chrome trace JSON end ----");
+}
+#endif //CPT_PREEMPT_ENABLE_TRACE
+
+void cpt_preempt_log_report(cpt_preempt * preempt)
+{
+    double shares[CPT_MAX_CONCURRENCY_COUNT];
+    size_t shares_count = 0;
+    cpt_stats_fairness fairness;
 
-    bool do_spin = true;
+    ESP_LOGI(TAG, "==== Job share ====");
 
-    // This should spin for a short time only, to avoid a race with the last task suspending itself
-    while (do_spin)
+    for (int i = 0; i < preempt->task_count; i ++)
     {
-        do_spin = false;
+        const cpt_preempt_task * task = cpt_preempt_get_task(preempt, i);
 
-        for (int i = 0; i < CPT_CONCURRENCY_COUNT; i ++)
+        // Hogs don't run the job, they'd only skew the fairness
+        if (task->role != CPT_PREEMPT_ROLE_HOG)
         {
-            TaskStatus_t task_status;
-            vTaskGetInfo(preempt->cpt_tasks[i].handle, &task_status, pdFALSE, eInvalid);
-            if (task_status.eCurrentState != eSuspended) {
-                do_spin = true;
-                break;
-            }
+            shares[shares_count ++] = task->counter;
         }
 
-        if (do_spin)
+        ESP_LOGI(TAG, "task %d iterations: %lu", i, task->counter);
+    }
+
+    cpt_stats_get_fairness(shares, shares_count, &fairness);
+    ESP_LOGI(TAG, "Jain's index: %.4f min/max: %.4f coefficient of variation: %.4f",
+        fairness.jain_index,
+        fairness.min_max_ratio,
+        fairness.coefficient_of_variation);
+
+    // Start skew: how long after the barrier release each task first ran
+    uint64_t first_start_us = UINT64_MAX;
+    uint64_t last_start_us = 0;
+
+    ESP_LOGI(TAG, "==== Start skew ====");
+
+    for (int i = 0; i < preempt->task_count; i ++)
+    {
+        uint64_t start_us = cpt_preempt_get_task(preempt, i)->start_us;
+
+        first_start_us = start_us < first_start_us ? start_us : first_start_us;
+        last_start_us = start_us > last_start_us ? start_us : last_start_us;
+        ESP_LOGI(TAG, "task %d started after: %"PRIu64" us", i, start_us - preempt->start_time_us);
+    }
+
+    ESP_LOGI(TAG, "First to last task start: %"PRIu64" us", last_start_us - first_start_us);
+
+    for (int i = 0; i < preempt->task_count; i ++)
+    {
+        uint32_t cross_core_sample_count = cpt_preempt_get_task(preempt, i)->cross_core_sample_count;
+
+        if (cross_core_sample_count > 0)
         {
-            taskYIELD();
+            ESP_LOGW(TAG, "task %d: %"PRIu32" timing samples dropped, they started and ended on different cores", i, cross_core_sample_count);
         }
     }
 
-    cpt_preempt_set_state(preempt, CPT_STATE_RUNNING);
+    ESP_LOGI(TAG, "==== Waits, %s yield policy ====", cpt_yield_policy_to_name(preempt->params->yield_policy));
+    ESP_LOGI(TAG, "---- ---------- ---------- ---------- ---------- ------------");
+    ESP_LOGI(TAG, "Task     Yields     Delays     Blocks  Contended     Pause us");
+    ESP_LOGI(TAG, "---- ---------- ---------- ---------- ---------- ------------");
 
-    // Now resume all tasks. Time measurement should begin here
-    for (uint8_t i = 0; i < CPT_CONCURRENCY_COUNT; i ++)
+    for (int i = 0; i < preempt->task_count; i ++)
     {
-        vTaskResume(preempt->cpt_tasks[i].handle);
+        const cpt_backoff_stats * stats = &cpt_preempt_get_task(preempt, i)->lock_node.backoff.stats;
+
+        ESP_LOGI(TAG, "%4d %10"PRIu32" %10"PRIu32" %10"PRIu32" %10"PRIu32" %12"PRIu64,
+            i,
+            stats->yield_count,
+            stats->delay_count,
+            stats->block_count,
+            stats->contended_count,
+            cpt_cycles_to_us(stats->pause_cycles));
     }
 
-    return ESP_OK;
+    if (preempt->params->scenario != CPT_SCENARIO_UNIFORM)
+    {
+        ESP_LOGI(TAG, "==== Roles, %s scenario, %s lock ====",
+            cpt_scenario_to_name(preempt->params->scenario),
+            cpt_lock_type_to_name(preempt->shared->job_lock.type));
+        ESP_LOGI(TAG, "---- ---------------- ---- ---------- -----------");
+        ESP_LOGI(TAG, "Task Role             Prio Iterations Max wait us");
+        ESP_LOGI(TAG, "---- ---------------- ---- ---------- -----------");
+
+        for (int i = 0; i < preempt->task_count; i ++)
+        {
+            const cpt_preempt_task * task = cpt_preempt_get_task(preempt, i);
+
+            ESP_LOGI(TAG, "%4d %-16s %4d %10lu %11"PRIu64,
+                i,
+                cpt_preempt_role_to_name(task->role),
+                task->priority,
+                task->counter,
+                cpt_cycles_to_us(task->max_lock_wait_cycles));
+        }
+    }
+
+#if CPT_PREEMPT_ENABLE_GAP_TRACKING
+    ESP_LOGI(TAG, "==== Longest gap between iterations (us) by %d ms slice ====", CPT_PREEMPT_GAP_SLICE_US / 1000);
+
+    for (int i = 0; i < preempt->task_count; i ++)
+    {
+        const uint32_t * gaps = cpt_preempt_get_task(preempt, i)->max_gap_us;
+        uint32_t max_gap = 0;
+        char line[CPT_PREEMPT_GAP_SLICE_COUNT * 10 + 1];
+        int line_length = 0;
+
+        for (int slice = 0; slice < CPT_PREEMPT_GAP_SLICE_COUNT; slice ++)
+        {
+            max_gap = gaps[slice] > max_gap ? gaps[slice] : max_gap;
+            line_length += snprintf(line + line_length, sizeof(line) - line_length, " %9"PRIu32, gaps[slice]);
+        }
+
+        ESP_LOGI(TAG, "task %2d max: %9"PRIu32" slices:%s", i, max_gap, line);
+    }
+#endif //CPT_PREEMPT_ENABLE_GAP_TRACKING
+
+#if CPT_PREEMPT_ENABLE_CONTENTION_STATS
+    if (preempt->params->job_backend == CPT_JOB_BACKEND_LOCKED)
+    {
+        ESP_LOGI(TAG, "==== Job lock contention ====");
+        ESP_LOGI(TAG, "---- ------------ ------------ ---------- ---------- ---------");
+        ESP_LOGI(TAG, "Task      Wait us      Hold us Uncontend. Contended  Handoffs");
+        ESP_LOGI(TAG, "---- ------------ ------------ ---------- ---------- ---------");
+
+        for (int i = 0; i < preempt->task_count; i ++)
+        {
+            const cpt_preempt_contention * contention = &cpt_preempt_get_task(preempt, i)->contention;
+
+            ESP_LOGI(TAG, "%4d %12"PRIu64" %12"PRIu64" %10"PRIu32" %10"PRIu32" %9"PRIu32,
+                i,
+                cpt_cycles_to_us(contention->wait_cycles),
+                cpt_cycles_to_us(contention->hold_cycles),
+                contention->uncontended_count,
+                contention->contended_count,
+                contention->cross_core_handoff_count);
+        }
+    }
+#endif //CPT_PREEMPT_ENABLE_CONTENTION_STATS
+
+#if CPT_PREEMPT_ENABLE_LATENCY_HISTOGRAMS
+    ESP_LOGI(TAG, "==== Iteration latencies (ns) ====");
+    ESP_LOGI(TAG, "---- --------- --------- --------- --------- --------- --------- ---------");
+    ESP_LOGI(TAG, "Task Latency       Count       p50       p90       p99     p99.9       max");
+    ESP_LOGI(TAG, "---- --------- --------- --------- --------- --------- --------- ---------");
+
+    for (int i = 0; i < preempt->task_count; i ++)
+    {
+        const cpt_preempt_latency * latency = cpt_preempt_get_task(preempt, i)->latency;
+
+        if (preempt->params->job_backend == CPT_JOB_BACKEND_LOCKED)
+        {
+            cpt_preempt_log_histogram(i, "lock_wait", &latency->lock_wait);
+            cpt_preempt_log_histogram(i, "lock_hold", &latency->lock_hold);
+        }
+
+        cpt_preempt_log_histogram(i, "total", &latency->total);
+    }
+#endif //CPT_PREEMPT_ENABLE_LATENCY_HISTOGRAMS
+
+#if CPT_PREEMPT_ENABLE_TRACE
+    cpt_preempt_dump_trace(preempt);
+#endif //CPT_PREEMPT_ENABLE_TRACE
+}
+
+static void cpt_preempt_engine_fill_result(void * engine, cpt_engine_result * result)
+{
+    cpt_preempt * preempt = (cpt_preempt *) engine;
+    uint32_t max_lock_wait_cycles = 0;
+
+    // The worst case of the latency critical worker is what the inversion scenario is about
+    if (preempt->params->scenario == CPT_SCENARIO_PRIORITY_INVERSION)
+    {
+        result->max_lock_wait_us = cpt_cycles_to_us(cpt_preempt_get_task(preempt, 0)->max_lock_wait_cycles);
+        return;
+    }
+
+    for (int i = 0; i < preempt->task_count; i ++)
+    {
+        if (cpt_preempt_get_task(preempt, i)->max_lock_wait_cycles > max_lock_wait_cycles)
+        {
+            max_lock_wait_cycles = cpt_preempt_get_task(preempt, i)->max_lock_wait_cycles;
+        }
+    }
+
+    result->max_lock_wait_us = cpt_cycles_to_us(max_lock_wait_cycles);
+}
+
+static void cpt_preempt_engine_log_report(void * engine)
+{
+    cpt_preempt_log_report((cpt_preempt *) engine);
+}
+
+static esp_err_t cpt_preempt_engine_init(void * engine, cpt_job * job, const cpt_config * config)
+{
+    return cpt_preempt_init((cpt_preempt *) engine, job, config);
+}
+
+static void cpt_preempt_engine_uninit(void * engine)
+{
+    cpt_preempt_uninit((cpt_preempt *) engine);
+}
+
+static esp_err_t cpt_preempt_engine_run_job(void * engine)
+{
+    return cpt_preempt_run_job((cpt_preempt *) engine);
+}
+
+static esp_err_t cpt_preempt_engine_wait_for_state_change(void * engine, uint32_t max_wait_ms, cpt_state state)
+{
+    return cpt_preempt_wait_for_state_change((cpt_preempt *) engine, max_wait_ms, state);
+}
+
+static const cpt_engine cpt_preempt_engine = {
+    .name = "preempt",
+    .engine_size = sizeof(cpt_preempt),
+    .init = cpt_preempt_engine_init,
+    .uninit = cpt_preempt_engine_uninit,
+    .run_job = cpt_preempt_engine_run_job,
+    .wait_for_state_change = cpt_preempt_engine_wait_for_state_change,
+    .log_report = cpt_preempt_engine_log_report,
+    .fill_result = cpt_preempt_engine_fill_result,
+};
+
+esp_err_t cpt_preempt_register()
+{
+    return cpt_engine_register(&cpt_preempt_engine);
 }
\ No newline at end of file
@@ -24,53 +24,181 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #ifndef __CPT_PREEMPT_H__
 #define __CPT_PREEMPT_H__
 
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-#include "freertos/semphr.h"
 #include "esp_err.h"
 #include "esp_log.h"
 #include "stdatomic.h"
 
 #include "cpt_globals.h"
+#include "cpt_platform.h"
+#include "cpt_engine.h"
 #include "cpt_job.h"
+#include "cpt_lock.h"
+#include "cpt_histogram.h"
+#include "cpt_pool.h"
+#include "cpt_trace.h"
 
-// 1 is the same priority as main. It allows for full CPU utilization
-#define CPT_PREEMPT_TASK_PRIO (1)
+// Record per-iteration latency histograms (lock wait, lock hold, total iteration) for each task. It adds a few cycle
+// counter reads and histogram updates to every iteration, so it's disabled by default
+#define CPT_PREEMPT_ENABLE_LATENCY_HISTOGRAMS (0)
 
-// Distribute tasks across cores (evenly split)
-#define CPT_PREEMPT_ENABLE_MULTI_CORE (1)
+#if CPT_PREEMPT_ENABLE_LATENCY_HISTOGRAMS
+/// @brief Per-iteration latencies of a task, in CPU cycles
+typedef struct
+{
+    cpt_histogram lock_wait; // From requesting the job lock to acquiring it
+    cpt_histogram lock_hold; // From acquiring the job lock to releasing it
+    cpt_histogram total; // Whole iteration, including the yield
+} cpt_preempt_latency;
+#endif //CPT_PREEMPT_ENABLE_LATENCY_HISTOGRAMS
+
+// Accumulate per-task contention statistics on the job lock. Compiled out when disabled
+#define CPT_PREEMPT_ENABLE_CONTENTION_STATS (0)
+
+#if CPT_PREEMPT_ENABLE_CONTENTION_STATS
+/// @brief Contention statistics of a task on the job lock. Times are in CPU cycles
+typedef struct
+{
+    uint64_t wait_cycles; // Total time spent waiting for the lock
+    uint64_t hold_cycles; // Total time spent holding the lock
+    uint32_t uncontended_count; // Acquisitions where no other task was holding the lock when requested
+    uint32_t contended_count; // Acquisitions where the lock was held by another task when requested
+    uint32_t cross_core_handoff_count; // Acquisitions where the previous holder ran on the other core
+} cpt_preempt_contention;
+#endif //CPT_PREEMPT_ENABLE_CONTENTION_STATS
+
+// Track the longest gap each task went without running a job iteration (for the locked backend: without acquiring
+// the lock), per time slice of the run. Adds a timer read to every iteration
+#define CPT_PREEMPT_ENABLE_GAP_TRACKING (0)
+
+// The run is split into slices of this duration for gap tracking. Anything after the last slice is accounted to it
+#define CPT_PREEMPT_GAP_SLICE_US (100 * 1000)
+#define CPT_PREEMPT_GAP_SLICE_COUNT (10)
+
+// Record a binary trace of each task (lock request, acquire and release, yield, job done) and of the state changes,
+// dumped as Chrome trace JSON after each run. The dump is large: use it with a single run, not a sweep
+#define CPT_PREEMPT_ENABLE_TRACE (0)
+
+// Priority inversion scenario (CPT_SCENARIO_PRIORITY_INVERSION). Worker 0 is latency critical: two levels above the
+// configured priority, it runs a batch of the job every CPT_PREEMPT_CRITICAL_PERIOD_MS. The next (concurrency - 1) / 2
+// workers are CPU hogs one level above, which never take the job lock: they're busy for CPT_PREEMPT_HOG_BUSY_MS, then
+// sleep for CPT_PREEMPT_HOG_IDLE_MS. The others run the job at the configured priority. When a hog preempts a holder
+// of the job lock, the latency critical worker waits for the hog, unless the lock prevents it (priority inheritance,
+// priority ceiling). Needs at least 3 workers, and hogs on the cores of the holders (e.g. CPT_AFFINITY_CORE_0).
+// Sleeps are rounded up to a tick, periods are multiples of it: 10 ms with CONFIG_FREERTOS_HZ=100. The latency
+// critical worker runs a batch every 10 ms, the hogs are busy for two ticks and sleep for one
+#define CPT_PREEMPT_CRITICAL_PERIOD_MS (10)
+#define CPT_PREEMPT_HOG_BUSY_MS (20)
+#define CPT_PREEMPT_HOG_IDLE_MS (10)
+
+/// @brief What a task does, according to the scenario
+typedef enum
+{
+    CPT_PREEMPT_ROLE_WORKER = 0, // Runs the job back to back, yielding after each batch
+    CPT_PREEMPT_ROLE_LATENCY_CRITICAL, // Runs a batch of the job per period
+    CPT_PREEMPT_ROLE_HOG, // Uses the CPU without the job lock, until the job is done
+} cpt_preempt_role;
 
 /// @brief Structure handling a task in the preemptive test
 typedef struct
 {
-    TaskHandle_t handle; // Handle for the task
+    cpt_pool_worker * worker; // Pool worker running the task
+    uint8_t index; // Position of the task in cpt_tasks
+    cpt_preempt_role role;
+    uint8_t priority; // Base priority of the task, before any inheritance or ceiling
+    uint64_t start_us; // When the task first ran after the start barrier
     unsigned long counter;  // Counts how many times this task had a chance to run a job
+    cpt_lock_node lock_node; // This task's node when queueing on job_lock, also holds its yield policy state
+    uint16_t batch_size; // Current batch size, changes over time with adaptive batching
+    cpt_job_worker job_worker; // State for the private part of the workload
+    uint32_t max_lock_wait_cycles; // Longest wait for job_lock, among the ones that started and ended on the same core
+    uint32_t cross_core_sample_count; // Lock waits, holds and iterations not timed as they spanned two cores
+#if CPT_PREEMPT_ENABLE_LATENCY_HISTOGRAMS
+    cpt_preempt_latency * latency; // Allocated at init, as histograms are too large for the task array
+#endif //CPT_PREEMPT_ENABLE_LATENCY_HISTOGRAMS
+#if CPT_PREEMPT_ENABLE_CONTENTION_STATS
+    cpt_preempt_contention contention;
+#endif //CPT_PREEMPT_ENABLE_CONTENTION_STATS
+#if CPT_PREEMPT_ENABLE_GAP_TRACKING
+    uint64_t last_iteration_us; // End of the last job iteration, or start of the run
+    uint32_t max_gap_us[CPT_PREEMPT_GAP_SLICE_COUNT]; // Longest gap between iterations, by slice where it ended
+#endif //CPT_PREEMPT_ENABLE_GAP_TRACKING
+#if CPT_PREEMPT_ENABLE_TRACE
+    cpt_trace_buffer * trace; // Allocated at init, only written by this task
+#endif //CPT_PREEMPT_ENABLE_TRACE
 } cpt_preempt_task;
 
+/// @brief Cold part of the test state: set at init, then only read by the tasks
+typedef struct
+{
+    cpt_job * job;
+    cpt_job_backend job_backend; // The lock-free backends bypass job_lock
+    uint16_t batch_size; // Job iterations per acquisition of job_lock, upper bound with adaptive batching
+    bool adaptive_batch;
+    cpt_scenario scenario;
+    cpt_yield_policy yield_policy;
+} cpt_preempt_params;
+
+/// @brief Hot part of the test state: written by all tasks at every lock acquisition
+typedef struct
+{
+    cpt_lock job_lock;  // Protects access to the shared resource (the job)
+    atomic_uint_fast8_t lock_waiters; // Tasks waiting for job_lock, only maintained with adaptive batching
+#if CPT_PREEMPT_ENABLE_CONTENTION_STATS
+    volatile _Atomic int8_t lock_holder; // Index of the task holding job_lock, -1 if none
+    int32_t last_holder_core; // Core of the last task holding job_lock, -1 if none. Protected by job_lock
+#endif //CPT_PREEMPT_ENABLE_CONTENTION_STATS
+} cpt_preempt_shared;
+
 /// @brief Structure holding state for a preemoption test
+/// @details The state accessed by the tasks while running (params, shared and the tasks slots) lives in a single
+/// allocation, laid out according to config->layout. With CPT_LAYOUT_PACKED the parts are contiguous, so the lock,
+/// the read-mostly params and each task's counters share cache lines. With CPT_LAYOUT_PADDED each part, and each
+/// task slot, starts on its own cache line.
 typedef struct
 {
-    cpt_preempt_task cpt_tasks[CPT_CONCURRENCY_COUNT];
+    void * layout_block; // Holds params, shared and the task slots
+    cpt_layout layout;
+    cpt_preempt_params * params;
+    cpt_preempt_shared * shared;
+    cpt_preempt_task * cpt_tasks; // Use cpt_preempt_get_task to access, slots are task_stride bytes apart
+    size_t task_stride;
+    uint8_t task_count; // Number of tasks used in cpt_tasks
     atomic_uint_fast8_t initialized_tasks_count; // Used to determine when all tasks are initialized
+    atomic_uint_fast8_t running_tasks_count; // Tasks running the job (all but the hogs), the last one done signals it
 
-    cpt_job * job;
-
-    SemaphoreHandle_t job_lock;  // Protects access to the shared resource (the job)
+    cpt_platform_gate start_barrier; // Tasks wait for run_job to open it
+    uint64_t start_time_us; // When the start barrier was released
 
     volatile _Atomic cpt_state state; // The state of this preempt object
     // An event is generated at each significant state change. Currently when the preempt object threads all are initialized, and when the job is completed.
-    volatile _Atomic TaskHandle_t waiting_task_handle; // Handle for a task waiting for the next event
+    volatile _Atomic cpt_platform_task waiting_task_handle; // Handle for a task waiting for the next event
+
+#if CPT_PREEMPT_ENABLE_TRACE
+    cpt_trace_buffer * state_trace; // State changes, written by the caller of run_job and by the tasks
+    cpt_trace_clock trace_clock;
+#endif //CPT_PREEMPT_ENABLE_TRACE
 } cpt_preempt;
 
-// Initializes all structures and tasks necessary to run the test. Tasks are suspended at creation and
-// will be resumed when calling the start function.
-esp_err_t cpt_preempt_init(cpt_preempt * preempt, cpt_job * job);
+/// @brief gets the slot of a task, according to the layout
+static inline cpt_preempt_task * cpt_preempt_get_task(cpt_preempt * preempt, uint8_t task_index)
+{
+    return (cpt_preempt_task *)((uint8_t *) preempt->cpt_tasks + task_index * preempt->task_stride);
+}
+
+// Initializes all structures and tasks necessary to run the test. Tasks wait on a start barrier after
+// initializing, it's released by the run_job function. The number of tasks, their priority and core affinity and the
+// job lock type are taken from config.
+esp_err_t cpt_preempt_init(cpt_preempt * preempt, cpt_job * job, const cpt_config * config);
 void cpt_preempt_uninit(cpt_preempt * preempt);
 
 // Starts the execution of the job scheduled for this preempt object
 // This call is not blocking
 esp_err_t cpt_preempt_run_job(cpt_preempt * preempt);
 
+/// @brief Logs the results collected by the tasks: how fairly the job was shared, plus the optional statistics.
+/// To be called once the job is done
+void cpt_preempt_log_report(cpt_preempt * preempt);
+
 /// @brief Block caller thread until the next state change.
 /// @details cpt_preempt objects signal an event at each relevant state change. A task (and just one) can use this method to block until the next state change
 ///        by using this function. It handles the race between setting the state and calling this method by virtue of a short spin on
@@ -80,4 +208,7 @@ esp_err_t cpt_preempt_run_job(cpt_preempt * preempt);
 /// @return ESP_OK in case of success, ESP_ERROR_TIMEOUT if the maximum time was reached.
 esp_err_t cpt_preempt_wait_for_state_change(cpt_preempt * preempt, uint32_t max_wait_ms, cpt_state state);
 
+/// @brief Adds the preemptive engine to the engine registry, under the name "preempt"
+esp_err_t cpt_preempt_register();
+
 #endif //__CPT_PREEMPT_H__
\ No newline at end of file
@@ -0,0 +1,471 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+
+#include "cpt_globals.h"
+#include "cpt_proto.h"
+#include "cpt_utils.h"
+#include "esp_check.h"
+
+#define TAG "proto"
+
+_Static_assert(CPT_JOB_MAX_COUNT / CPT_PROTO_WORKERS_PER_CONCURRENCY < UINT16_MAX, "Job too large for cpt_proto_worker.remaining");
+_Static_assert(CPT_PROTO_MAX_WORKER_COUNT <= UINT16_MAX, "Too many workers for a uint16_t index");
+
+static void cpt_proto_task_function(void * parameters);
+
+/// @brief change the state for this object and notify waiting task (if set)
+/// @param new_state the state to set this cpt_proto object to
+/// @return esp_ok in case of success
+static esp_err_t cpt_proto_set_state(cpt_proto * proto, cpt_state new_state)
+{
+    ESP_LOGD(TAG, "Changing state from %d to %d", atomic_load(&proto->state), new_state);
+    // Set the state first
+    atomic_store(&proto->state, new_state);
+
+    // Then read the handle
+    volatile cpt_platform_task waiting_task_handle = atomic_load(&proto->waiting_task_handle);
+
+    // Notify task if necessary
+    if (waiting_task_handle != NULL)
+    {
+        cpt_platform_notify_give(waiting_task_handle);
+    }
+
+    return ESP_OK;
+}
+
+esp_err_t cpt_proto_wait_for_state_change(cpt_proto * proto, uint32_t max_wait_ms, cpt_state expected_state)
+{
+    cpt_platform_task this_task_handle = cpt_platform_task_get_current();
+    cpt_platform_task null_task_handle = NULL;
+    volatile cpt_state current_state = CPT_STATE_NONE;
+    uint32_t notification_value = 0;
+
+    // Set the wait handle first
+    bool valid = atomic_compare_exchange_strong(&proto->waiting_task_handle, &null_task_handle, this_task_handle);
+    ESP_RETURN_ON_FALSE(valid, ESP_ERR_INVALID_STATE, TAG, "Handle already set");
+
+    while (current_state != expected_state)
+    {
+        // Read the state after setting the handle: this fixes races
+        current_state = atomic_load(&proto->state);
+
+        if (current_state != expected_state)
+        {
+            notification_value = cpt_platform_notify_take(max_wait_ms);
+            if (notification_value == 0)
+            {
+                break;
+            }
+        }
+    }
+
+    atomic_store(&proto->waiting_task_handle, NULL);
+
+    return current_state == expected_state ? ESP_OK : ESP_ERR_TIMEOUT;
+}
+
+// Iterations of the job given to a worker at init
+static inline uint16_t cpt_proto_get_share(cpt_proto * proto, uint16_t worker_index)
+{
+    return CPT_JOB_MAX_COUNT / proto->worker_count + (worker_index < CPT_JOB_MAX_COUNT % proto->worker_count ? 1 : 0);
+}
+
+esp_err_t cpt_proto_init(cpt_proto * proto, cpt_job * job, const cpt_config * config)
+{
+    * proto = (cpt_proto) {0};
+    esp_err_t ret = ESP_OK;
+    cpt_platform_heap_stats heap_before;
+    cpt_platform_heap_stats heap_after;
+
+    ret = cpt_config_validate(config);
+    ESP_GOTO_ON_ERROR(ret, exit, TAG, "Invalid configuration");
+
+    proto->job = job;
+    proto->worker_count = config->concurrency * CPT_PROTO_WORKERS_PER_CONCURRENCY;
+    proto->scheduler_count = cpt_config_get_scheduler_count(config);
+    cpt_platform_spinlock_init(&proto->job_spinlock);
+
+    proto->start_barrier = cpt_platform_gate_create();
+    ESP_GOTO_ON_FALSE(proto->start_barrier != NULL, ESP_ERR_NO_MEM, exit, TAG, "Unable to create the start barrier");
+
+    ret = cpt_proto_set_state(proto, CPT_STATE_INITIALIZING);
+    ESP_GOTO_ON_ERROR(ret, exit, TAG, "Error setting state: %s", esp_err_to_name(ret));
+
+    // Workers are split in contiguous blocks across schedulers, and the job evenly across workers. Schedulers aren't
+    // running yet so there's no need to synchronize here.
+    cpt_platform_get_heap_stats(&heap_before);
+
+    for (uint8_t scheduler_index = 0; scheduler_index < proto->scheduler_count; scheduler_index ++)
+    {
+        cpt_proto_scheduler * scheduler = &proto->schedulers[scheduler_index];
+
+        scheduler->worker_count = proto->worker_count / proto->scheduler_count +
+            (scheduler_index < proto->worker_count % proto->scheduler_count ? 1 : 0);
+        scheduler->first_worker_index = scheduler_index == 0 ? 0 :
+            proto->schedulers[scheduler_index - 1].first_worker_index + proto->schedulers[scheduler_index - 1].worker_count;
+
+        scheduler->workers = cpt_platform_malloc(scheduler->worker_count * sizeof(cpt_proto_worker), 0, CPT_PLATFORM_MEMORY_INTERNAL);
+        ESP_GOTO_ON_FALSE(scheduler->workers != NULL, ESP_ERR_NO_MEM, exit, TAG, "Unable to allocate %d workers", scheduler->worker_count);
+
+        for (uint16_t i = 0; i < scheduler->worker_count; i ++)
+        {
+            scheduler->workers[i] = (cpt_proto_worker) {
+                .remaining = cpt_proto_get_share(proto, scheduler->first_worker_index + i),
+            };
+        }
+    }
+
+    cpt_platform_get_heap_stats(&heap_after);
+    proto->worker_heap_bytes = heap_after.allocated_bytes - heap_before.allocated_bytes;
+
+    atomic_store(&proto->running_schedulers_count, proto->scheduler_count);
+
+    for (uint8_t scheduler_index = 0; scheduler_index < proto->scheduler_count; scheduler_index ++)
+    {
+        cpt_proto_scheduler * scheduler = &proto->schedulers[scheduler_index];
+
+        if (proto->scheduler_count == 1)
+        {
+            scheduler->job = job;
+        }
+        else
+        {
+            ret = cpt_job_init(&scheduler->partial_job, config);
+            ESP_GOTO_ON_ERROR(ret, exit, TAG, "Unable to initialize partial job %d", scheduler_index);
+            scheduler->job = &scheduler->partial_job;
+        }
+
+        cpt_job_worker_init(&scheduler->job_worker, scheduler_index);
+
+        ret = cpt_pool_acquire(cpt_affinity_get_core(config->affinity, scheduler_index), config->priority, &scheduler->worker);
+        ESP_GOTO_ON_ERROR(ret, exit, TAG, "Unable to get a worker for scheduler %d", scheduler_index);
+
+        cpt_pool_start(scheduler->worker, cpt_proto_task_function, proto);
+    }
+
+    ESP_LOGI(TAG, "%d schedulers initialized with %d workers, priority: %d affinity: %s workload: %s (%d/%d)",
+        proto->scheduler_count,
+        proto->worker_count,
+        config->priority,
+        cpt_affinity_to_name(config->affinity),
+        cpt_job_workload_to_name(config->workload),
+        config->critical_size,
+        config->private_size);
+
+    exit:
+    if (ret != ESP_OK)
+    {
+        cpt_proto_uninit(proto);
+    }
+
+    return ret;
+}
+
+void cpt_proto_uninit(cpt_proto * proto)
+{
+    ESP_LOGI(TAG, "uninitializing");
+
+    for (int i = 0; i < proto->scheduler_count; i ++)
+    {
+        cpt_proto_scheduler * scheduler = &proto->schedulers[i];
+
+        if (scheduler->worker != NULL)
+        {
+            cpt_pool_release(scheduler->worker);
+        }
+
+        if (scheduler->workers != NULL)
+        {
+            cpt_platform_free(scheduler->workers);
+        }
+
+        cpt_job_uninit(&scheduler->partial_job);
+    }
+
+    if (proto->start_barrier != NULL)
+    {
+        cpt_platform_gate_delete(proto->start_barrier);
+    }
+
+    * proto = (cpt_proto) {0};
+}
+
+// Returns the index of the calling scheduler, -1 if the task wasn't found
+static int8_t cpt_proto_get_current_scheduler_index(cpt_proto * proto)
+{
+    cpt_platform_task handle = cpt_platform_task_get_current();
+
+    for (int8_t i = 0; i < proto->scheduler_count; i ++)
+    {
+        if (proto->schedulers[i].worker != NULL && proto->schedulers[i].worker->handle == handle)
+        {
+            return i;
+        }
+    }
+
+    return -1;
+}
+
+/// @brief The coroutine of a worker: each resume runs an iteration of the job, or its private part, like the states
+/// of a cpt_coop_fsm
+/// @return true if the worker is done
+static bool cpt_proto_worker_run(cpt_proto_worker * worker, cpt_proto_scheduler * scheduler)
+{
+    CPT_PROTO_BEGIN(worker);
+
+    while (worker->remaining > 0)
+    {
+        // No lock here: a job is only ever touched by a single scheduler
+        if (cpt_job_run(scheduler->job) == CPT_JOB_DONE)
+        {
+            break;
+        }
+
+        worker->remaining --;
+        CPT_PROTO_YIELD(worker);
+
+        cpt_job_run_private(scheduler->job, &scheduler->job_worker);
+        CPT_PROTO_YIELD(worker);
+    }
+
+    CPT_PROTO_END(worker);
+}
+
+// Each scheduler task resumes its workers in turn until all are done. A round over the workers is the longest a
+// worker waits between two resumes. Like the preemptive tasks, schedulers signal initialization then wait for run_job
+// to start the test, so that initialization time is removed from the perf measurement.
+static void cpt_proto_task_function(void * parameters)
+{
+    cpt_proto * proto = (cpt_proto *) parameters;
+    int8_t scheduler_index = cpt_proto_get_current_scheduler_index(proto);
+
+    if (scheduler_index == -1)
+    {
+        ESP_LOGE(TAG, "Scheduler not found in array, terminating task");
+        return;
+    }
+
+    cpt_proto_scheduler * scheduler = &proto->schedulers[scheduler_index];
+    uint16_t active_count = scheduler->worker_count;
+
+    if (atomic_fetch_add(&proto->initialized_schedulers_count, 1) == proto->scheduler_count - 1)
+    {
+        cpt_proto_set_state(proto, CPT_STATE_INITIALIZED);
+    }
+
+    // The gate stays open, so a scheduler reaching this point after the release goes through right away
+    ESP_LOGD(TAG, "scheduler %d waiting for start", scheduler_index);
+    cpt_platform_gate_wait(proto->start_barrier);
+    scheduler->start_us = cpt_get_current_time_us();
+
+    while (active_count > 0)
+    {
+#if CPT_PROTO_ENABLE_SWITCH_TIMING
+        uint32_t pass_start = cpt_get_cycle_count();
+        uint32_t run_cycles = 0;
+#endif //CPT_PROTO_ENABLE_SWITCH_TIMING
+
+        for (uint16_t i = 0; i < scheduler->worker_count; i ++)
+        {
+            cpt_proto_worker * worker = &scheduler->workers[i];
+
+            if (worker->resume == CPT_PROTO_RESUME_DONE)
+            {
+                continue;
+            }
+
+#if CPT_PROTO_ENABLE_SWITCH_TIMING
+            uint32_t resume_start = cpt_get_cycle_count();
+#endif //CPT_PROTO_ENABLE_SWITCH_TIMING
+
+            bool done = cpt_proto_worker_run(worker, scheduler);
+
+#if CPT_PROTO_ENABLE_SWITCH_TIMING
+            run_cycles += cpt_get_cycle_count() - resume_start;
+#endif //CPT_PROTO_ENABLE_SWITCH_TIMING
+
+            scheduler->resumes ++;
+
+            if (done)
+            {
+                active_count --;
+            }
+        }
+
+        scheduler->passes ++;
+
+#if CPT_PROTO_ENABLE_SWITCH_TIMING
+        uint32_t pass_cycles = cpt_get_cycle_count() - pass_start;
+        scheduler->switch_cycles += pass_cycles - run_cycles;
+
+        if (pass_cycles > scheduler->max_pass_cycles)
+        {
+            scheduler->max_pass_cycles = pass_cycles;
+        }
+#endif //CPT_PROTO_ENABLE_SWITCH_TIMING
+    }
+
+    scheduler->end_us = cpt_get_current_time_us();
+
+    // The only access to shared state: aggregate the partial job
+    if (scheduler->job != proto->job)
+    {
+        cpt_platform_spinlock_enter(&proto->job_spinlock);
+        cpt_job_merge(proto->job, scheduler->job);
+        cpt_platform_spinlock_exit(&proto->job_spinlock);
+    }
+
+    // signal that we're done
+    if (atomic_fetch_sub(&proto->running_schedulers_count, 1) == 1)
+    {
+        cpt_proto_set_state(proto, CPT_STATE_DONE);
+    }
+
+    // Returning parks the worker until the pool hands it to the next run
+}
+
+esp_err_t cpt_proto_run_job(cpt_proto * proto)
+{
+    ESP_LOGI(TAG, "Starting job");
+
+    // Wait for all schedulers to be initialized
+    esp_err_t ret = cpt_proto_wait_for_state_change(proto, CPT_WAIT_FOREVER, CPT_STATE_INITIALIZED);
+    ESP_RETURN_ON_ERROR(ret, TAG, "Error waiting for initialization: %s", esp_err_to_name(ret));
+
+    cpt_proto_set_state(proto, CPT_STATE_RUNNING);
+
+    // Release all schedulers at once. Time measurement should begin here
+    cpt_platform_gate_open(proto->start_barrier);
+
+    return ESP_OK;
+}
+
+void cpt_proto_log_report(cpt_proto * proto)
+{
+    uint16_t min_iterations = UINT16_MAX;
+    uint16_t max_iterations = 0;
+    uint64_t total_resumes = 0;
+    uint64_t start_us = UINT64_MAX;
+    uint64_t end_us = 0;
+
+    // The engine object and the scheduler tasks, shared by all workers, are in the footprint logged by cpt_engine_run
+    ESP_LOGI(TAG, "==== Memory per worker ====");
+    ESP_LOGI(TAG, "%d workers, state: %zu bytes, heap: %.1f bytes",
+        proto->worker_count,
+        sizeof(cpt_proto_worker),
+        (double) proto->worker_heap_bytes / proto->worker_count);
+
+    ESP_LOGI(TAG, "==== Schedulers ====");
+    ESP_LOGI(TAG, "   # Workers     Resumes   Resumes/s  Switch ns  Round us  Max round us");
+
+    for (int i = 0; i < proto->scheduler_count; i ++)
+    {
+        cpt_proto_scheduler * scheduler = &proto->schedulers[i];
+        uint64_t duration_us = scheduler->end_us > scheduler->start_us ? scheduler->end_us - scheduler->start_us : 1;
+
+        for (uint16_t j = 0; j < scheduler->worker_count; j ++)
+        {
+            uint16_t iterations = cpt_proto_get_share(proto, scheduler->first_worker_index + j) - scheduler->workers[j].remaining;
+
+            min_iterations = iterations < min_iterations ? iterations : min_iterations;
+            max_iterations = iterations > max_iterations ? iterations : max_iterations;
+        }
+
+        total_resumes += scheduler->resumes;
+        start_us = scheduler->start_us < start_us ? scheduler->start_us : start_us;
+        end_us = scheduler->end_us > end_us ? scheduler->end_us : end_us;
+
+#if CPT_PROTO_ENABLE_SWITCH_TIMING
+        ESP_LOGI(TAG, "%4d %7d %11"PRIu64" %11.0f %10"PRIu32" %9.1f %13"PRIu64,
+            i,
+            scheduler->worker_count,
+            scheduler->resumes,
+            scheduler->resumes * 1e6 / duration_us,
+            cpt_cycles_to_ns(scheduler->resumes > 0 ? scheduler->switch_cycles / scheduler->resumes : 0),
+            scheduler->passes > 0 ? (double) duration_us / scheduler->passes : 0,
+            cpt_cycles_to_us(scheduler->max_pass_cycles));
+#else
+        ESP_LOGI(TAG, "%4d %7d %11"PRIu64" %11.0f %10s %9.1f %13s",
+            i,
+            scheduler->worker_count,
+            scheduler->resumes,
+            scheduler->resumes * 1e6 / duration_us,
+            "-",
+            scheduler->passes > 0 ? (double) duration_us / scheduler->passes : 0,
+            "-");
+#endif //CPT_PROTO_ENABLE_SWITCH_TIMING
+    }
+
+    ESP_LOGI(TAG, "Total resumes/s: %.0f, iterations per worker min: %d max: %d",
+        end_us > start_us ? total_resumes * 1e6 / (end_us - start_us) : 0,
+        min_iterations,
+        max_iterations);
+}
+
+static void cpt_proto_engine_log_report(void * engine)
+{
+    cpt_proto_log_report((cpt_proto *) engine);
+}
+
+static void cpt_proto_engine_fill_result(void * engine, cpt_engine_result * result)
+{
+    result->worker_count = ((cpt_proto *) engine)->worker_count;
+}
+
+static esp_err_t cpt_proto_engine_init(void * engine, cpt_job * job, const cpt_config * config)
+{
+    return cpt_proto_init((cpt_proto *) engine, job, config);
+}
+
+static void cpt_proto_engine_uninit(void * engine)
+{
+    cpt_proto_uninit((cpt_proto *) engine);
+}
+
+static esp_err_t cpt_proto_engine_run_job(void * engine)
+{
+    return cpt_proto_run_job((cpt_proto *) engine);
+}
+
+static esp_err_t cpt_proto_engine_wait_for_state_change(void * engine, uint32_t max_wait_ms, cpt_state state)
+{
+    return cpt_proto_wait_for_state_change((cpt_proto *) engine, max_wait_ms, state);
+}
+
+static const cpt_engine cpt_proto_engine = {
+    .name = "proto",
+    .engine_size = sizeof(cpt_proto),
+    .init = cpt_proto_engine_init,
+    .uninit = cpt_proto_engine_uninit,
+    .run_job = cpt_proto_engine_run_job,
+    .wait_for_state_change = cpt_proto_engine_wait_for_state_change,
+    .log_report = cpt_proto_engine_log_report,
+    .fill_result = cpt_proto_engine_fill_result,
+};
+
+esp_err_t cpt_proto_register()
+{
+    return cpt_engine_register(&cpt_proto_engine);
+}
\ No newline at end of file
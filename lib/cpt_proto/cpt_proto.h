@@ -0,0 +1,140 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __CPT_PROTO_H__
+#define __CPT_PROTO_H__
+
+#include "esp_err.h"
+#include "stdatomic.h"
+
+#include "cpt_globals.h"
+#include "cpt_platform.h"
+#include "cpt_engine.h"
+#include "cpt_job.h"
+#include "cpt_pool.h"
+
+// Logical workers per unit of config concurrency. Workers are stackless coroutines (protothreads), a few bytes each,
+// so the engine runs thousands of them: concurrency 1 to CPT_MAX_CONCURRENCY_COUNT makes 640 to 10240 workers
+#define CPT_PROTO_WORKERS_PER_CONCURRENCY (640)
+
+#define CPT_PROTO_MAX_WORKER_COUNT (CPT_MAX_CONCURRENCY_COUNT * CPT_PROTO_WORKERS_PER_CONCURRENCY)
+
+// Read the cycle counter around each resume, to tell the time spent switching between workers from the time spent
+// running them. Costs two reads of the counter per switch, which are counted as switch time
+#define CPT_PROTO_ENABLE_SWITCH_TIMING (1)
+
+// Resume point of a worker that returned from its function
+#define CPT_PROTO_RESUME_DONE (UINT16_MAX)
+
+// Protothread macros, for a function of a worker returning true when done. Locals don't survive a yield: all the
+// state must be in the worker. The resume point is a line number, so there can be one yield per line at most and
+// switch statements can't be used in between CPT_PROTO_BEGIN and CPT_PROTO_END
+#define CPT_PROTO_BEGIN(worker) switch ((worker)->resume) { case 0:
+
+#define CPT_PROTO_YIELD(worker) \
+    do { \
+        (worker)->resume = __LINE__; \
+        return false; \
+        case __LINE__:; \
+    } while (0)
+
+#define CPT_PROTO_END(worker) } (worker)->resume = CPT_PROTO_RESUME_DONE; return true
+
+/// @brief A logical worker. It's the coroutine counterpart of cpt_preempt_task: the job iterations left are all it
+/// needs on top of its resume point, the private workload state is shared by the workers of a scheduler
+typedef struct
+{
+    uint16_t resume; // Line to resume at, 0 to start and CPT_PROTO_RESUME_DONE when done
+    uint16_t remaining; // Iterations of the job left to this worker: the job is split evenly across workers
+} cpt_proto_worker;
+
+/// @brief Structure handling a scheduler task, which resumes its workers round robin until all are done
+typedef struct
+{
+    cpt_pool_worker * worker; // Pool worker running the scheduler
+    cpt_proto_worker * workers; // Allocated at init, so that a scheduler only touches memory of its own
+    uint16_t first_worker_index; // Index of workers[0] among all workers
+    uint16_t worker_count;
+
+    // The job the scheduler runs its workers on. With a single scheduler this is the shared job, otherwise it's the
+    // private partial_job, merged into the shared one when the scheduler is done
+    cpt_job * job;
+    cpt_job partial_job;
+    cpt_job_worker job_worker; // Workers of a scheduler never run at once, they can share the private workload state
+
+    uint64_t start_us; // When the scheduler started resuming workers
+    uint64_t end_us; // When its last worker was done
+    uint64_t resumes; // Count of calls to worker functions
+    uint64_t passes; // Count of rounds over all workers
+#if CPT_PROTO_ENABLE_SWITCH_TIMING
+    uint64_t switch_cycles; // Time between leaving a worker and entering the next one
+    uint32_t max_pass_cycles; // Longest round: the worst wait of a worker between two resumes
+#endif //CPT_PROTO_ENABLE_SWITCH_TIMING
+} cpt_proto_scheduler;
+
+/// @brief Structure holding state for a coroutine test
+typedef struct
+{
+    cpt_proto_scheduler schedulers[CPT_MAX_SCHEDULER_COUNT];
+    uint8_t scheduler_count;
+    uint16_t worker_count;
+    size_t worker_heap_bytes; // Heap taken by the workers of all schedulers, allocator overhead included
+
+    atomic_uint_fast8_t initialized_schedulers_count; // Used to determine when all schedulers are initialized
+    atomic_uint_fast8_t running_schedulers_count; // Used to determine when the last scheduler is done
+
+    cpt_job * job; // Only touched when aggregating the partial jobs at the end of the test
+    cpt_platform_spinlock job_spinlock; // Protects the aggregation into job
+    cpt_platform_gate start_barrier; // Opened by run_job to release all schedulers at once
+
+    volatile _Atomic cpt_state state; // The state of this proto object
+    // An event is generated at each significant state change. Currently when the schedulers are initialized, and when the job is completed.
+    volatile _Atomic cpt_platform_task waiting_task_handle; // Handle for a task waiting for the next event
+} cpt_proto;
+
+// Initializes the workers and the scheduler tasks, one per core unless the config says otherwise. Schedulers are placed
+// according to the config affinity, run at the config priority, and wait for the run_job function to be called before
+// resuming the workers.
+// There are CPT_PROTO_WORKERS_PER_CONCURRENCY workers per unit of config concurrency. Schedulers don't lock the job.
+esp_err_t cpt_proto_init(cpt_proto * proto, cpt_job * job, const cpt_config * config);
+void cpt_proto_uninit(cpt_proto * proto);
+
+// Starts the execution of the job scheduled for this proto object
+// This call is not blocking
+esp_err_t cpt_proto_run_job(cpt_proto * proto);
+
+/// @brief Logs the memory taken by the state of the workers, and the throughput, switch time and round time of each
+/// scheduler. To be called once the job is done
+void cpt_proto_log_report(cpt_proto * proto);
+
+/// @brief Block caller thread until the next state change.
+/// @details Same semantics as cpt_preempt_wait_for_state_change
+/// @param max_wait_ms the maximum wait time in ms, CPT_WAIT_FOREVER to never timeout
+/// @param state the state to wait for
+/// @return ESP_OK in case of success, ESP_ERROR_TIMEOUT if the maximum time was reached.
+esp_err_t cpt_proto_wait_for_state_change(cpt_proto * proto, uint32_t max_wait_ms, cpt_state state);
+
+/// @brief Adds the coroutine engine to the engine registry, under the name "proto"
+esp_err_t cpt_proto_register();
+
+#endif //__CPT_PROTO_H__
\ No newline at end of file
@@ -0,0 +1,117 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "esp_check.h"
+#include "esp_log.h"
+
+#include "cpt_repeat.h"
+
+#define TAG "repeat"
+
+// Summarizes durations without touching them, so that outliers are judged against all the runs every time
+static void cpt_repeat_summarize(const double * durations, size_t count, double outlier_threshold, cpt_repeat_result * result)
+{
+    double kept[CPT_STATS_MAX_SAMPLE_COUNT];
+
+    for (size_t i = 0; i < count; i ++)
+    {
+        kept[i] = durations[i];
+    }
+
+    size_t kept_count = cpt_stats_reject_outliers(kept, count, outlier_threshold);
+    cpt_stats_summarize(kept, kept_count, &result->duration_us);
+
+    result->run_count = count;
+    result->outlier_count = count - kept_count;
+    result->result.duration_us = (uint64_t) result->duration_us.median;
+}
+
+esp_err_t cpt_repeat_run(const cpt_engine * engine, const cpt_config * config, const cpt_repeat_params * params, cpt_repeat_result * result)
+{
+    double durations[CPT_STATS_MAX_SAMPLE_COUNT];
+    cpt_engine_result run_result;
+    uint32_t max_lock_wait_us = 0;
+    size_t count = 0;
+
+    * result = (cpt_repeat_result) {0};
+    result->convergence_requested = params->target_relative_ci > 0;
+
+    ESP_RETURN_ON_FALSE(params->max_count > 0 && params->max_count <= CPT_STATS_MAX_SAMPLE_COUNT && params->min_count <= params->max_count,
+        ESP_ERR_INVALID_ARG, TAG, "Invalid repetition counts: %d to %d", params->min_count, params->max_count);
+
+    for (int i = 0; i < params->warmup_count; i ++)
+    {
+        ESP_LOGI(TAG, "Warm-up %d/%d", i + 1, params->warmup_count);
+
+        if (cpt_engine_run(engine, config, &run_result) != ESP_OK)
+        {
+            result->result = run_result;
+            return run_result.ret;
+        }
+    }
+
+    while (count < params->max_count)
+    {
+        ESP_LOGI(TAG, "Repetition %zu/%d", count + 1, params->max_count);
+
+        if (cpt_engine_run(engine, config, &run_result) != ESP_OK)
+        {
+            result->result = run_result;
+            return run_result.ret;
+        }
+
+        durations[count ++] = run_result.duration_us;
+        max_lock_wait_us = run_result.max_lock_wait_us > max_lock_wait_us ? run_result.max_lock_wait_us : max_lock_wait_us;
+
+        result->result = run_result;
+        cpt_repeat_summarize(durations, count, params->outlier_threshold, result);
+
+        // A single run has an infinite interval, so it never converges
+        if (result->convergence_requested && count >= params->min_count &&
+            result->duration_us.ci95_half_width <= params->target_relative_ci * result->duration_us.mean)
+        {
+            result->converged = true;
+            break;
+        }
+    }
+
+    result->result.max_lock_wait_us = max_lock_wait_us;
+
+    return ESP_OK;
+}
+
+void cpt_repeat_log_result(const cpt_engine * engine, const cpt_repeat_result * result)
+{
+    const cpt_stats_summary * duration = &result->duration_us;
+
+    ESP_LOGI(TAG, "%s: %d runs (%d outliers)%s median: %.0f us mean: %.0f us stddev: %.0f us 95%% CI: +/- %.0f us (%.2f%%)",
+        engine->name,
+        result->run_count,
+        result->outlier_count,
+        result->convergence_requested && ! result->converged ? " not converged" : "",
+        duration->median,
+        duration->mean,
+        duration->stddev,
+        duration->ci95_half_width,
+        duration->mean > 0 ? 100 * duration->ci95_half_width / duration->mean : 0);
+}
\ No newline at end of file
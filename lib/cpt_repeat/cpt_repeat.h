@@ -0,0 +1,82 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __CPT_REPEAT_H__
+#define __CPT_REPEAT_H__
+
+#include "esp_err.h"
+
+#include "cpt_globals.h"
+#include "cpt_engine.h"
+#include "cpt_stats.h"
+
+// Runs discarded before measuring: they settle caches, the heap and the worker pool
+#define CPT_REPEAT_WARMUP_COUNT (1)
+
+// Measured runs: at least the minimum, then until the confidence interval is tight enough or the maximum is reached
+#define CPT_REPEAT_MIN_COUNT (5)
+#define CPT_REPEAT_MAX_COUNT (20)
+
+// Repetitions stop once the 95% confidence interval of the mean duration is within this fraction of the mean
+#define CPT_REPEAT_TARGET_RELATIVE_CI (0.02)
+
+/// @brief How an engine is run repeatedly
+typedef struct
+{
+    uint8_t warmup_count;
+    uint8_t min_count;
+    uint8_t max_count; // At most CPT_STATS_MAX_SAMPLE_COUNT
+    double target_relative_ci; // 0 to always run max_count times
+    double outlier_threshold; // Modified z-score, see cpt_stats_reject_outliers
+} cpt_repeat_params;
+
+#define CPT_REPEAT_PARAMS_DEFAULT { \
+    .warmup_count = CPT_REPEAT_WARMUP_COUNT, \
+    .min_count = CPT_REPEAT_MIN_COUNT, \
+    .max_count = CPT_REPEAT_MAX_COUNT, \
+    .target_relative_ci = CPT_REPEAT_TARGET_RELATIVE_CI, \
+    .outlier_threshold = CPT_STATS_OUTLIER_THRESHOLD, \
+}
+
+/// @brief Outcome of the repeated runs of an engine
+typedef struct
+{
+    // Duration is the median of the measured runs without outliers, max lock wait the largest of all runs,
+    // anything else comes from the last run
+    cpt_engine_result result;
+    cpt_stats_summary duration_us; // Over the runs that weren't rejected as outliers
+    uint8_t run_count; // Measured runs, warm-up excluded
+    uint8_t outlier_count;
+    bool convergence_requested; // A confidence interval target was set, otherwise converged is meaningless
+    bool converged; // The confidence interval reached the target before max_count runs
+} cpt_repeat_result;
+
+/// @brief Runs a test on an engine with cpt_engine_run, warm-up runs first then measured runs until the mean
+/// duration is known precisely enough. Stops at the first failed run
+/// @return ESP_OK or the error of the failed run, also stored in result
+esp_err_t cpt_repeat_run(const cpt_engine * engine, const cpt_config * config, const cpt_repeat_params * params, cpt_repeat_result * result);
+
+/// @brief Logs the statistics of the repeated runs
+void cpt_repeat_log_result(const cpt_engine * engine, const cpt_repeat_result * result);
+
+#endif //__CPT_REPEAT_H__
\ No newline at end of file
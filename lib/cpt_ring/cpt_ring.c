@@ -0,0 +1,74 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include "esp_check.h"
+
+#include "cpt_ring.h"
+#include "cpt_platform.h"
+
+#define TAG "ring"
+
+// Internal memory only: the external memory cache isn't coherent across cores on ESP32, so atomics can't go there
+#define CPT_RING_MEMORY (CPT_PLATFORM_MEMORY_INTERNAL)
+
+esp_err_t cpt_ring_spsc_init(cpt_ring_spsc * ring, uint32_t capacity)
+{
+    ESP_RETURN_ON_FALSE(capacity > 0 && (capacity & (capacity - 1)) == 0, ESP_ERR_INVALID_ARG, TAG, "Capacity %"PRIu32" is not a power of 2", capacity);
+
+    * ring = (cpt_ring_spsc) {0};
+    ring->mask = capacity - 1;
+    ring->items = cpt_platform_malloc(capacity * sizeof(uint32_t), CPT_CACHE_LINE_SIZE, CPT_RING_MEMORY);
+    ESP_RETURN_ON_FALSE(ring->items != NULL, ESP_ERR_NO_MEM, TAG, "Unable to allocate %"PRIu32" items", capacity);
+
+    return ESP_OK;
+}
+
+void cpt_ring_spsc_uninit(cpt_ring_spsc * ring)
+{
+    cpt_platform_free(ring->items);
+    * ring = (cpt_ring_spsc) {0};
+}
+
+esp_err_t cpt_ring_mpmc_init(cpt_ring_mpmc * ring, uint32_t capacity)
+{
+    ESP_RETURN_ON_FALSE(capacity > 0 && (capacity & (capacity - 1)) == 0, ESP_ERR_INVALID_ARG, TAG, "Capacity %"PRIu32" is not a power of 2", capacity);
+
+    * ring = (cpt_ring_mpmc) {0};
+    ring->mask = capacity - 1;
+    ring->cells = cpt_platform_malloc(capacity * sizeof(cpt_ring_mpmc_cell), CPT_CACHE_LINE_SIZE, CPT_RING_MEMORY);
+    ESP_RETURN_ON_FALSE(ring->cells != NULL, ESP_ERR_NO_MEM, TAG, "Unable to allocate %"PRIu32" cells", capacity);
+
+    // Cell i can be written on the first lap at position i
+    for (uint32_t i = 0; i < capacity; i ++)
+    {
+        atomic_init(&ring->cells[i].sequence, i);
+    }
+
+    return ESP_OK;
+}
+
+void cpt_ring_mpmc_uninit(cpt_ring_mpmc * ring)
+{
+    cpt_platform_free(ring->cells);
+    * ring = (cpt_ring_mpmc) {0};
+}
\ No newline at end of file
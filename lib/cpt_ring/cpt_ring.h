@@ -0,0 +1,204 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __CPT_RING_H__
+#define __CPT_RING_H__
+
+#include "esp_err.h"
+#include "stdatomic.h"
+#include <stdbool.h>
+
+#include "cpt_globals.h"
+
+// Puts a field at the start of a cache line, so that fields written by different cores never share one. Structures
+// using it must be allocated with a cache line alignment (cpt_platform_malloc) for it to be honored
+#define CPT_RING_ALIGNED __attribute__((aligned(CPT_CACHE_LINE_SIZE)))
+
+/// @brief Bounded lock-free ring of 32 bits items for a single producer and a single consumer. Each side only
+/// writes its own index, and keeps a cached copy of the other side's one so that it only reads it (and pulls its
+/// cache line) when the ring looks full or empty
+typedef struct
+{
+    // Written by the producer
+    CPT_RING_ALIGNED _Atomic uint32_t head;
+    uint32_t cached_tail;
+
+    // Written by the consumer
+    CPT_RING_ALIGNED _Atomic uint32_t tail;
+    uint32_t cached_head;
+
+    // Read only after init
+    CPT_RING_ALIGNED uint32_t mask;
+    uint32_t * items;
+} cpt_ring_spsc;
+
+/// @brief A slot of an MPMC ring. sequence tells whether the slot is ready to be written or read for a given lap
+typedef struct
+{
+    _Atomic uint32_t sequence;
+    uint32_t item;
+} cpt_ring_mpmc_cell;
+
+/// @brief Bounded lock-free ring of 32 bits items for any number of producers and consumers (Dmitry Vyukov's
+/// design). Producers and consumers only contend among themselves, on their own index, with a compare and swap
+typedef struct
+{
+    CPT_RING_ALIGNED _Atomic uint32_t enqueue_position;
+    CPT_RING_ALIGNED _Atomic uint32_t dequeue_position;
+
+    // Read only after init
+    CPT_RING_ALIGNED uint32_t mask;
+    cpt_ring_mpmc_cell * cells;
+} cpt_ring_mpmc;
+
+/// @brief Initializes a ring, allocating its items
+/// @param capacity the maximum number of items in the ring, must be a power of 2
+esp_err_t cpt_ring_spsc_init(cpt_ring_spsc * ring, uint32_t capacity);
+void cpt_ring_spsc_uninit(cpt_ring_spsc * ring);
+
+/// @brief Adds an item to the ring. To be called by the producer only
+/// @return false if the ring is full
+static inline bool cpt_ring_spsc_push(cpt_ring_spsc * ring, uint32_t item)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_relaxed);
+
+    if (head - ring->cached_tail > ring->mask)
+    {
+        ring->cached_tail = atomic_load_explicit(&ring->tail, memory_order_acquire);
+
+        if (head - ring->cached_tail > ring->mask)
+        {
+            return false;
+        }
+    }
+
+    ring->items[head & ring->mask] = item;
+    atomic_store_explicit(&ring->head, head + 1, memory_order_release);
+
+    return true;
+}
+
+/// @brief Takes the oldest item from the ring. To be called by the consumer only
+/// @return false if the ring is empty
+static inline bool cpt_ring_spsc_pop(cpt_ring_spsc * ring, uint32_t * item)
+{
+    uint32_t tail = atomic_load_explicit(&ring->tail, memory_order_relaxed);
+
+    if (tail == ring->cached_head)
+    {
+        ring->cached_head = atomic_load_explicit(&ring->head, memory_order_acquire);
+
+        if (tail == ring->cached_head)
+        {
+            return false;
+        }
+    }
+
+    * item = ring->items[tail & ring->mask];
+    atomic_store_explicit(&ring->tail, tail + 1, memory_order_release);
+
+    return true;
+}
+
+/// @brief Initializes a ring, allocating its cells
+/// @param capacity the maximum number of items in the ring, must be a power of 2
+esp_err_t cpt_ring_mpmc_init(cpt_ring_mpmc * ring, uint32_t capacity);
+void cpt_ring_mpmc_uninit(cpt_ring_mpmc * ring);
+
+/// @brief Adds an item to the ring. Thread safe
+/// @return false if the ring is full
+static inline bool cpt_ring_mpmc_push(cpt_ring_mpmc * ring, uint32_t item)
+{
+    uint32_t position = atomic_load_explicit(&ring->enqueue_position, memory_order_relaxed);
+    cpt_ring_mpmc_cell * cell;
+
+    while (true)
+    {
+        cell = &ring->cells[position & ring->mask];
+        int32_t lap = (int32_t)(atomic_load_explicit(&cell->sequence, memory_order_acquire) - position);
+
+        if (lap == 0)
+        {
+            // The cell is free for this lap, claim it. On failure position is updated with the current value
+            if (atomic_compare_exchange_weak_explicit(&ring->enqueue_position, &position, position + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (lap < 0)
+        {
+            // The cell still holds the item of the previous lap
+            return false;
+        }
+        else
+        {
+            // Another producer claimed the cell
+            position = atomic_load_explicit(&ring->enqueue_position, memory_order_relaxed);
+        }
+    }
+
+    cell->item = item;
+    atomic_store_explicit(&cell->sequence, position + 1, memory_order_release);
+
+    return true;
+}
+
+/// @brief Takes the oldest item from the ring. Thread safe
+/// @return false if the ring is empty
+static inline bool cpt_ring_mpmc_pop(cpt_ring_mpmc * ring, uint32_t * item)
+{
+    uint32_t position = atomic_load_explicit(&ring->dequeue_position, memory_order_relaxed);
+    cpt_ring_mpmc_cell * cell;
+
+    while (true)
+    {
+        cell = &ring->cells[position & ring->mask];
+        int32_t lap = (int32_t)(atomic_load_explicit(&cell->sequence, memory_order_acquire) - (position + 1));
+
+        if (lap == 0)
+        {
+            if (atomic_compare_exchange_weak_explicit(&ring->dequeue_position, &position, position + 1, memory_order_relaxed, memory_order_relaxed))
+            {
+                break;
+            }
+        }
+        else if (lap < 0)
+        {
+            // Nothing written in the cell for this lap yet
+            return false;
+        }
+        else
+        {
+            // Another consumer took the item
+            position = atomic_load_explicit(&ring->dequeue_position, memory_order_relaxed);
+        }
+    }
+
+    * item = cell->item;
+    // Ready to be written on the next lap
+    atomic_store_explicit(&cell->sequence, position + ring->mask + 1, memory_order_release);
+
+    return true;
+}
+
+#endif //__CPT_RING_H__
\ No newline at end of file
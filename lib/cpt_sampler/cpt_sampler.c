@@ -0,0 +1,303 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <string.h>
+
+#include "esp_check.h"
+#include "esp_log.h"
+
+#include "cpt_sampler.h"
+
+#define TAG "sampler"
+
+// Halves the time series, keeping the first sample, so that there's room for as many samples again
+static void cpt_sampler_decimate(cpt_sampler * sampler)
+{
+    for (uint16_t i = 1; 2 * i < sampler->sample_count; i ++)
+    {
+        sampler->samples[i] = sampler->samples[2 * i];
+    }
+
+    sampler->sample_count = (sampler->sample_count + 1) / 2;
+    sampler->interval_ms *= 2;
+}
+
+// Returns the index of a task in the followed ones, starting to follow it if there's room. -1 if there's none
+static int cpt_sampler_get_task_index(cpt_sampler * sampler, const cpt_platform_task_sample * status)
+{
+    for (int i = 0; i < sampler->task_count; i ++)
+    {
+        if (sampler->tasks[i].id == status->id)
+        {
+            return i;
+        }
+    }
+
+    if (sampler->task_count == CPT_SAMPLER_MAX_TASK_COUNT)
+    {
+        return -1;
+    }
+
+    cpt_sampler_task * task = &sampler->tasks[sampler->task_count];
+    task->id = status->id;
+    memcpy(task->name, status->name, sizeof(task->name));
+
+    // The task didn't run before this sample, as far as the series is concerned
+    for (uint16_t i = 0; i < sampler->sample_count; i ++)
+    {
+        sampler->samples[i].run_time[sampler->task_count] = status->run_time;
+    }
+
+    return sampler->task_count ++;
+}
+
+static void cpt_sampler_take_sample(cpt_sampler * sampler)
+{
+    size_t status_count = 0;
+    uint32_t time = 0;
+    cpt_platform_heap_stats heap_stats;
+
+    if (sampler->sample_count == CPT_SAMPLER_MAX_SAMPLE_COUNT)
+    {
+        cpt_sampler_decimate(sampler);
+    }
+
+    // Tasks missing from this sample (deleted since the last one) keep their run time, so they show as not running
+    cpt_sampler_sample * sample = &sampler->samples[sampler->sample_count];
+    * sample = sampler->sample_count > 0 ? sampler->samples[sampler->sample_count - 1] : (cpt_sampler_sample) {0};
+
+    if (! sampler->tasks_unavailable
+        && cpt_platform_task_sampler_sample(sampler->task_sampler, sampler->statuses, &status_count, &time) != ESP_OK)
+    {
+        // Not retried, the cause (configuration, too many tasks) won't go away during the run
+        sampler->tasks_unavailable = true;
+    }
+
+    sample->time = sampler->tasks_unavailable ? (uint32_t) cpt_platform_get_time_us() : time;
+
+    for (size_t i = 0; i < status_count && ! sampler->tasks_unavailable; i ++)
+    {
+        const cpt_platform_task_sample * status = &sampler->statuses[i];
+
+        if (status->idle && status->core < CPT_SAMPLER_MAX_CORE_COUNT)
+        {
+            sample->idle_time[status->core] = status->run_time;
+            sampler->core_count = status->core >= sampler->core_count ? status->core + 1 : sampler->core_count;
+        }
+        else if (! status->idle)
+        {
+            int task_index = cpt_sampler_get_task_index(sampler, status);
+
+            if (task_index >= 0)
+            {
+                sample->run_time[task_index] = status->run_time;
+            }
+        }
+    }
+
+    cpt_platform_get_heap_stats(&heap_stats);
+    sample->heap_free_bytes = heap_stats.free_bytes;
+    sample->heap_minimum_free_bytes = heap_stats.minimum_free_bytes;
+    sample->heap_allocated_bytes = heap_stats.allocated_bytes;
+
+    sampler->sample_count ++;
+}
+
+static void cpt_sampler_task_function(void * parameters)
+{
+    cpt_sampler * sampler = (cpt_sampler *) parameters;
+
+    while (! atomic_load(&sampler->stopping))
+    {
+        cpt_sampler_take_sample(sampler);
+
+        // Sleeps for the interval, unless woken up by stop
+        cpt_platform_notify_take(sampler->interval_ms);
+    }
+
+    cpt_sampler_take_sample(sampler);
+    cpt_platform_semaphore_give(sampler->stopped);
+
+    // Tasks can't return, this one waits to be deleted
+    while (true)
+    {
+        cpt_platform_notify_take(CPT_WAIT_FOREVER);
+    }
+}
+
+esp_err_t cpt_sampler_start(cpt_sampler * sampler, uint32_t interval_ms)
+{
+    esp_err_t ret = ESP_OK;
+
+    * sampler = (cpt_sampler) {0};
+    sampler->interval_ms = interval_ms;
+
+    // Internal memory: written by the sampling task, read by the caller, possibly from the other core
+    sampler->samples = cpt_platform_malloc(CPT_SAMPLER_MAX_SAMPLE_COUNT * sizeof(cpt_sampler_sample), 0, CPT_PLATFORM_MEMORY_INTERNAL);
+    ESP_GOTO_ON_FALSE(sampler->samples != NULL, ESP_ERR_NO_MEM, exit, TAG, "Unable to allocate the samples");
+
+    sampler->statuses = cpt_platform_malloc(CPT_SAMPLER_STATUS_CAPACITY * sizeof(cpt_platform_task_sample), 0, CPT_PLATFORM_MEMORY_INTERNAL);
+    ESP_GOTO_ON_FALSE(sampler->statuses != NULL, ESP_ERR_NO_MEM, exit, TAG, "Unable to allocate the status buffer");
+
+    sampler->task_sampler = cpt_platform_task_sampler_create(CPT_SAMPLER_STATUS_CAPACITY);
+    ESP_GOTO_ON_FALSE(sampler->task_sampler != NULL, ESP_ERR_NO_MEM, exit, TAG, "Unable to create the task sampler");
+
+    sampler->stopped = cpt_platform_semaphore_create_counting(1, 0);
+    ESP_GOTO_ON_FALSE(sampler->stopped != NULL, ESP_ERR_NO_MEM, exit, TAG, "Unable to create the stop semaphore");
+
+    ret = cpt_platform_task_create(cpt_sampler_task_function, "sampler", CPT_SAMPLER_STACK_SIZE, sampler,
+        CPT_SAMPLER_PRIORITY, CPT_PLATFORM_NO_AFFINITY, &sampler->task);
+    ESP_GOTO_ON_ERROR(ret, exit, TAG, "Unable to create the sampling task");
+
+    exit:
+    if (ret != ESP_OK)
+    {
+        cpt_sampler_uninit(sampler);
+    }
+
+    return ret;
+}
+
+void cpt_sampler_stop(cpt_sampler * sampler)
+{
+    if (sampler->task == NULL)
+    {
+        return;
+    }
+
+    atomic_store(&sampler->stopping, true);
+    cpt_platform_notify_give(sampler->task);
+    cpt_platform_semaphore_take(sampler->stopped, CPT_WAIT_FOREVER);
+
+    cpt_platform_task_delete(sampler->task);
+    sampler->task = NULL;
+}
+
+void cpt_sampler_uninit(cpt_sampler * sampler)
+{
+    cpt_sampler_stop(sampler);
+
+    if (sampler->stopped != NULL)
+    {
+        cpt_platform_semaphore_delete(sampler->stopped);
+    }
+
+    if (sampler->task_sampler != NULL)
+    {
+        cpt_platform_task_sampler_delete(sampler->task_sampler);
+    }
+
+    if (sampler->statuses != NULL)
+    {
+        cpt_platform_free(sampler->statuses);
+    }
+
+    if (sampler->samples != NULL)
+    {
+        cpt_platform_free(sampler->samples);
+    }
+
+    * sampler = (cpt_sampler) {0};
+}
+
+void cpt_sampler_log_report(const cpt_sampler * sampler)
+{
+    bool shown[CPT_SAMPLER_MAX_TASK_COUNT] = {0};
+    char line[48 + CPT_SAMPLER_MAX_CORE_COUNT * 8 + CPT_SAMPLER_MAX_TASK_COUNT * 9];
+    int line_length = 0;
+
+    ESP_LOGI(TAG, "==== CPU usage (%% of a core) and heap, %d samples ====", sampler->sample_count);
+
+    if (sampler->sample_count < 2)
+    {
+        return;
+    }
+
+    const cpt_sampler_sample * first = &sampler->samples[0];
+    const cpt_sampler_sample * last = &sampler->samples[sampler->sample_count - 1];
+
+    if (sampler->tasks_unavailable)
+    {
+        ESP_LOGW(TAG, "Run times unavailable, heap only. See cpt_log_system_status for the build options");
+    }
+
+    line_length += snprintf(line + line_length, sizeof(line) - line_length, "Time ms");
+
+    for (int core = 0; core < sampler->core_count; core ++)
+    {
+        line_length += snprintf(line + line_length, sizeof(line) - line_length, " Core %d", core);
+    }
+
+    line_length += snprintf(line + line_length, sizeof(line) - line_length, "   Free heap    Min free   Allocated");
+
+    // Only tasks that ran during the test get a column
+    for (int i = 0; i < sampler->task_count; i ++)
+    {
+        shown[i] = last->run_time[i] != first->run_time[i];
+
+        if (shown[i])
+        {
+            line_length += snprintf(line + line_length, sizeof(line) - line_length, " %8.8s", sampler->tasks[i].name);
+        }
+    }
+
+    ESP_LOGI(TAG, "%s", line);
+
+    for (uint16_t sample_index = 1; sample_index < sampler->sample_count; sample_index ++)
+    {
+        const cpt_sampler_sample * sample = &sampler->samples[sample_index];
+        const cpt_sampler_sample * previous = &sampler->samples[sample_index - 1];
+        double interval = sample->time - previous->time;
+
+        if (interval == 0)
+        {
+            continue;
+        }
+
+        // Run time clock ticks are us by default
+        line_length = snprintf(line, sizeof(line), "%7"PRIu32, (sample->time - first->time) / 1000);
+
+        for (int core = 0; core < sampler->core_count; core ++)
+        {
+            double busy = 100 * (1 - (sample->idle_time[core] - previous->idle_time[core]) / interval);
+
+            line_length += snprintf(line + line_length, sizeof(line) - line_length, " %5.1f%%", busy > 0 ? busy : 0);
+        }
+
+        line_length += snprintf(line + line_length, sizeof(line) - line_length, " %11zu %11zu %11zu",
+            sample->heap_free_bytes,
+            sample->heap_minimum_free_bytes,
+            sample->heap_allocated_bytes);
+
+        for (int i = 0; i < sampler->task_count; i ++)
+        {
+            if (shown[i])
+            {
+                line_length += snprintf(line + line_length, sizeof(line) - line_length, " %7.1f%%",
+                    100 * (sample->run_time[i] - previous->run_time[i]) / interval);
+            }
+        }
+
+        ESP_LOGI(TAG, "%s", line);
+    }
+}
\ No newline at end of file
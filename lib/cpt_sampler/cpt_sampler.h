@@ -0,0 +1,103 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __CPT_SAMPLER_H__
+#define __CPT_SAMPLER_H__
+
+#include "esp_err.h"
+#include "stdatomic.h"
+
+#include "cpt_globals.h"
+#include "cpt_platform.h"
+
+// Default time between two samples. The first sample is taken at start, the last one at stop
+#define CPT_SAMPLER_INTERVAL_MS (100)
+
+// Samples kept per run. When the series is full every other sample is dropped and the interval doubles, so that a
+// run of any length is covered with up to this many points
+#define CPT_SAMPLER_MAX_SAMPLE_COUNT (64)
+
+// Tasks whose CPU usage is followed, the first ones seen. Cores beyond CPT_SAMPLER_MAX_CORE_COUNT aren't reported
+#define CPT_SAMPLER_MAX_TASK_COUNT (16)
+#define CPT_SAMPLER_MAX_CORE_COUNT (8)
+
+// Tasks in the system the status buffer has room for (plus the CPUs on the host)
+#define CPT_SAMPLER_STATUS_CAPACITY (48)
+
+// Above the workers, so that samples are taken on time even when the workers saturate the cores, but below the
+// ESP-IDF system tasks. Taking a sample is short compared to the interval
+#define CPT_SAMPLER_PRIORITY (CPT_TASK_PRIO + 1)
+#define CPT_SAMPLER_STACK_SIZE (3072)
+
+/// @brief A point of the time series. Run times are cumulative, usage is computed from the differences when logging
+typedef struct
+{
+    uint32_t time; // Run time clock
+    uint32_t idle_time[CPT_SAMPLER_MAX_CORE_COUNT]; // Run time of the idle task of each core
+    uint32_t run_time[CPT_SAMPLER_MAX_TASK_COUNT]; // Run time of the followed tasks
+    size_t heap_free_bytes;
+    size_t heap_minimum_free_bytes;
+    size_t heap_allocated_bytes;
+} cpt_sampler_sample;
+
+/// @brief A task followed by the sampler
+typedef struct
+{
+    uint32_t id;
+    char name[CPT_PLATFORM_TASK_NAME_LENGTH];
+} cpt_sampler_task;
+
+/// @brief Low priority task recording the CPU usage of each core and task, and the heap, while a test runs
+/// @details All memory is allocated at start, so that sampling doesn't change the heap it measures
+typedef struct
+{
+    cpt_platform_task task;
+    cpt_platform_task_sampler task_sampler;
+    cpt_platform_task_sample * statuses; // Status buffer, reused by every sample
+    cpt_platform_semaphore stopped; // Given by the task after its last sample
+
+    cpt_sampler_task tasks[CPT_SAMPLER_MAX_TASK_COUNT];
+    uint8_t task_count;
+    uint8_t core_count; // Cores for which an idle task was seen
+    cpt_sampler_sample * samples;
+    uint16_t sample_count;
+    uint32_t interval_ms; // Current interval, doubled at each decimation
+    bool tasks_unavailable; // Run times can't be sampled (e.g. run time stats disabled), only the heap is recorded
+
+    atomic_bool stopping;
+} cpt_sampler;
+
+/// @brief Allocates the buffers and starts the sampling task, which takes a first sample right away
+/// @param interval_ms the time between samples, e.g. CPT_SAMPLER_INTERVAL_MS
+esp_err_t cpt_sampler_start(cpt_sampler * sampler, uint32_t interval_ms);
+
+/// @brief Takes a last sample and stops the sampling task. The samples are kept until uninit
+void cpt_sampler_stop(cpt_sampler * sampler);
+
+/// @brief Stops the sampler if needed and frees its buffers
+void cpt_sampler_uninit(cpt_sampler * sampler);
+
+/// @brief Logs the time series: CPU usage per core and per task (in % of a core) over each interval, and the heap
+void cpt_sampler_log_report(const cpt_sampler * sampler);
+
+#endif //__CPT_SAMPLER_H__
\ No newline at end of file
@@ -0,0 +1,227 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <math.h>
+#include <stdlib.h>
+
+#include "cpt_stats.h"
+
+double cpt_stats_get_mean(const double * values, size_t count)
+{
+    double sum = 0;
+
+    for (size_t i = 0; i < count; i ++)
+    {
+        sum += values[i];
+    }
+
+    return count > 0 ? sum / count : 0;
+}
+
+double cpt_stats_get_stddev(const double * values, size_t count)
+{
+    double mean = cpt_stats_get_mean(values, count);
+    double sum_of_squares = 0;
+
+    for (size_t i = 0; i < count; i ++)
+    {
+        sum_of_squares += (values[i] - mean) * (values[i] - mean);
+    }
+
+    return count > 0 ? sqrt(sum_of_squares / count) : 0;
+}
+
+static int cpt_stats_compare(const void * a, const void * b)
+{
+    double difference = * (const double *) a - * (const double *) b;
+
+    return difference < 0 ? -1 : (difference > 0 ? 1 : 0);
+}
+
+double cpt_stats_get_median(double * values, size_t count)
+{
+    if (count == 0)
+    {
+        return 0;
+    }
+
+    qsort(values, count, sizeof(double), cpt_stats_compare);
+
+    return count % 2 == 1 ? values[count / 2] : (values[count / 2 - 1] + values[count / 2]) / 2;
+}
+
+size_t cpt_stats_reject_outliers(double * values, size_t count, double threshold)
+{
+    double deviations[CPT_STATS_MAX_SAMPLE_COUNT];
+
+    if (count > CPT_STATS_MAX_SAMPLE_COUNT)
+    {
+        return count;
+    }
+
+    double median = cpt_stats_get_median(values, count);
+
+    for (size_t i = 0; i < count; i ++)
+    {
+        deviations[i] = fabs(values[i] - median);
+    }
+
+    double mad = cpt_stats_get_median(deviations, count);
+
+    // All values but a few identical: any scale would be arbitrary
+    if (mad <= 0)
+    {
+        return count;
+    }
+
+    size_t kept_count = 0;
+
+    for (size_t i = 0; i < count; i ++)
+    {
+        if (0.6745 * fabs(values[i] - median) / mad <= threshold)
+        {
+            values[kept_count ++] = values[i];
+        }
+    }
+
+    return kept_count;
+}
+
+// Two-sided 95% quantiles of Student's t distribution by degrees of freedom, the normal one is close enough past 30
+static double cpt_stats_get_t95(size_t degrees_of_freedom)
+{
+    static const double quantiles[] = {
+        12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+        2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+        2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+    };
+
+    if (degrees_of_freedom == 0)
+    {
+        return INFINITY;
+    }
+
+    return degrees_of_freedom <= sizeof(quantiles) / sizeof(quantiles[0]) ? quantiles[degrees_of_freedom - 1] : 1.960;
+}
+
+void cpt_stats_summarize(double * values, size_t count, cpt_stats_summary * summary)
+{
+    double mean = cpt_stats_get_mean(values, count);
+    double sum_of_squares = 0;
+
+    for (size_t i = 0; i < count; i ++)
+    {
+        sum_of_squares += (values[i] - mean) * (values[i] - mean);
+    }
+
+    double stddev = count > 1 ? sqrt(sum_of_squares / (count - 1)) : 0;
+
+    * summary = (cpt_stats_summary) {
+        .count = count,
+        .median = cpt_stats_get_median(values, count),
+        .mean = mean,
+        .stddev = stddev,
+        .ci95_half_width = count > 1 ? cpt_stats_get_t95(count - 1) * stddev / sqrt(count) : INFINITY,
+    };
+}
+
+void cpt_stats_get_fairness(const double * shares, size_t count, cpt_stats_fairness * fairness)
+{
+    double sum = 0;
+    double sum_of_squares = 0;
+    double min = count > 0 ? shares[0] : 0;
+    double max = min;
+
+    for (size_t i = 0; i < count; i ++)
+    {
+        sum += shares[i];
+        sum_of_squares += shares[i] * shares[i];
+        min = shares[i] < min ? shares[i] : min;
+        max = shares[i] > max ? shares[i] : max;
+    }
+
+    double mean = count > 0 ? sum / count : 0;
+
+    * fairness = (cpt_stats_fairness) {
+        .jain_index = sum_of_squares > 0 ? sum * sum / (count * sum_of_squares) : 1,
+        .min_max_ratio = max > 0 ? min / max : 1,
+        .coefficient_of_variation = mean > 0 ? cpt_stats_get_stddev(shares, count) / mean : 0,
+    };
+}
+
+// Both models are linear once rewritten as N / speedup - 1 = sigma * (N - 1) + kappa * N * (N - 1), so they're
+// fitted with ordinary least squares through the origin: one regressor for Amdahl, two for the USL
+void cpt_stats_fit_scalability(const double * concurrencies, const double * speedups, size_t count, cpt_stats_scalability * scalability)
+{
+    double s11 = 0, s12 = 0, s22 = 0, s1y = 0, s2y = 0;
+
+    for (size_t i = 0; i < count; i ++)
+    {
+        if (speedups[i] <= 0)
+        {
+            continue;
+        }
+
+        double x1 = concurrencies[i] - 1;
+        double x2 = concurrencies[i] * (concurrencies[i] - 1);
+        double y = concurrencies[i] / speedups[i] - 1;
+
+        s11 += x1 * x1;
+        s12 += x1 * x2;
+        s22 += x2 * x2;
+        s1y += x1 * y;
+        s2y += x2 * y;
+    }
+
+    * scalability = (cpt_stats_scalability) {
+        .amdahl_sigma = s11 > 0 ? s1y / s11 : 0,
+        .usl_peak_concurrency = INFINITY,
+    };
+
+    // With fewer than two distinct concurrencies besides 1 the USL is underdetermined, fall back to Amdahl
+    double determinant = s11 * s22 - s12 * s12;
+    if (fabs(determinant) > 1e-9 * s11 * s22)
+    {
+        scalability->usl_sigma = (s1y * s22 - s2y * s12) / determinant;
+        scalability->usl_kappa = (s2y * s11 - s1y * s12) / determinant;
+    }
+    else
+    {
+        scalability->usl_sigma = scalability->amdahl_sigma;
+    }
+
+    if (scalability->usl_kappa > 0 && scalability->usl_sigma < 1)
+    {
+        scalability->usl_peak_concurrency = sqrt((1 - scalability->usl_sigma) / scalability->usl_kappa);
+    }
+}
+
+double cpt_stats_get_amdahl_speedup(const cpt_stats_scalability * scalability, double concurrency)
+{
+    return concurrency / (1 + scalability->amdahl_sigma * (concurrency - 1));
+}
+
+double cpt_stats_get_usl_speedup(const cpt_stats_scalability * scalability, double concurrency)
+{
+    return concurrency / (1 + scalability->usl_sigma * (concurrency - 1) + scalability->usl_kappa * concurrency * (concurrency - 1));
+}
\ No newline at end of file
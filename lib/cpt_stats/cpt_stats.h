@@ -0,0 +1,98 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __CPT_STATS_H__
+#define __CPT_STATS_H__
+
+#include <stddef.h>
+
+// Most values cpt_stats_reject_outliers can work on, its scratch space is on the stack
+#define CPT_STATS_MAX_SAMPLE_COUNT (64)
+
+// Modified z-score (0.6745 * deviation from the median / MAD) above which a value is an outlier, as suggested by
+// Iglewicz and Hoaglin
+#define CPT_STATS_OUTLIER_THRESHOLD (3.5)
+
+/// @brief How evenly some work was shared across workers
+typedef struct
+{
+    double jain_index; // Jain's fairness index: 1 when perfectly fair, 1/n when a single worker did everything
+    double min_max_ratio; // Smallest share over the largest one: 1 when perfectly fair, 0 if a worker was starved
+    double coefficient_of_variation; // Standard deviation over mean: 0 when perfectly fair
+} cpt_stats_fairness;
+
+/// @brief Coefficients of the scalability models fitted over speedups measured at several concurrencies. Speedup
+/// with Amdahl's law is N / (1 + sigma * (N - 1)), with the Universal Scalability Law N / (1 + sigma * (N - 1) +
+/// kappa * N * (N - 1))
+typedef struct
+{
+    double amdahl_sigma; // Serial fraction according to Amdahl's law
+    double usl_sigma; // Contention coefficient: cost of queueing on shared resources
+    double usl_kappa; // Coherency coefficient: cost of keeping shared data consistent, makes throughput go down
+    double usl_peak_concurrency; // Concurrency at which the USL throughput peaks, INFINITY if it never does
+} cpt_stats_scalability;
+
+/// @brief Summary of repeated measures of the same quantity
+typedef struct
+{
+    size_t count; // Number of values summarized
+    double median;
+    double mean;
+    double stddev; // Sample standard deviation
+    double ci95_half_width; // Half width of the 95% confidence interval of the mean, from Student's t distribution
+} cpt_stats_summary;
+
+/// @brief gets the mean of count values
+double cpt_stats_get_mean(const double * values, size_t count);
+
+/// @brief gets the population standard deviation of count values
+double cpt_stats_get_stddev(const double * values, size_t count);
+
+/// @brief gets the median of count values, sorting them in place
+double cpt_stats_get_median(double * values, size_t count);
+
+/// @brief removes the outliers from values, using the median absolute deviation (MAD) as it isn't skewed by the
+/// outliers themselves. Kept values are moved to the front of the array, their order is not preserved
+/// @param threshold the modified z-score above which a value is rejected, see CPT_STATS_OUTLIER_THRESHOLD
+/// @return the number of values kept. Nothing is rejected when the MAD is 0 or count exceeds CPT_STATS_MAX_SAMPLE_COUNT
+size_t cpt_stats_reject_outliers(double * values, size_t count, double threshold);
+
+/// @brief computes the summary of count values, sorting them in place
+void cpt_stats_summarize(double * values, size_t count, cpt_stats_summary * summary);
+
+/// @brief computes fairness metrics over the shares of work done by count workers
+void cpt_stats_get_fairness(const double * shares, size_t count, cpt_stats_fairness * fairness);
+
+/// @brief fits Amdahl's law and the Universal Scalability Law with least squares
+/// @param concurrencies the number of workers for each measure
+/// @param speedups the throughput of each measure, relative to the throughput of a single worker
+void cpt_stats_fit_scalability(const double * concurrencies, const double * speedups, size_t count, cpt_stats_scalability * scalability);
+
+/// @brief gets the speedup predicted by Amdahl's law for a concurrency
+double cpt_stats_get_amdahl_speedup(const cpt_stats_scalability * scalability, double concurrency);
+
+/// @brief gets the speedup predicted by the Universal Scalability Law for a concurrency
+double cpt_stats_get_usl_speedup(const cpt_stats_scalability * scalability, double concurrency);
+
+#endif //__CPT_STATS_H__
+
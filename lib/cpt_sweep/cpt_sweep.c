@@ -0,0 +1,299 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <stdlib.h>
+
+#include "esp_check.h"
+#include "esp_log.h"
+
+#include "cpt_sweep.h"
+#include "cpt_lock.h"
+#include "cpt_backoff.h"
+#include "cpt_job.h"
+#include "cpt_stats.h"
+#include "cpt_utils.h"
+
+#define TAG "sweep"
+
+// Used when the sweep doesn't set repeat: no warm-up, a single measured run
+static const cpt_repeat_params cpt_sweep_single_run = {
+    .warmup_count = 0,
+    .min_count = 1,
+    .max_count = 1,
+    .outlier_threshold = CPT_STATS_OUTLIER_THRESHOLD,
+};
+
+// An empty dimension counts as one value, the one from the base configuration
+#define CPT_SWEEP_DIMENSION_SIZE(count) ((count) > 0 ? (count) : 1)
+
+static double cpt_sweep_get_throughput(const cpt_engine_result * result)
+{
+    return result->duration_us > 0 ? (double)CPT_JOB_MAX_COUNT * 1000000 / result->duration_us : 0;
+}
+
+static void cpt_sweep_log_table(const cpt_engine * engine, const cpt_sweep_cell * cells, size_t cells_count)
+{
+    ESP_LOGI(TAG, "==== Sweep results for %s ====", engine->name);
+    ESP_LOGI(TAG, "------- --------- ---- ----------- ------------------ --------------- -------- ------ --------- ----------- ------ --------- ----- ----------- -------------- ----------- ------------ ------ -------");
+    ESP_LOGI(TAG, "Workers Scenario  Prio Affinity   Lock               Yield           Backend   Batch Workload  Crit/Priv   Layout Channel   Sched Duration us Iterations/s   Max wait us Bytes/worker  CI +%% Runs/Out");
+    ESP_LOGI(TAG, "------- --------- ---- ----------- ------------------ --------------- -------- ------ --------- ----------- ------ --------- ----- ----------- -------------- ----------- ------------ ------ -------");
+
+    for (size_t i = 0; i < cells_count; i ++)
+    {
+        const cpt_config * config = &cells[i].config;
+        const cpt_engine_result * result = &cells[i].result;
+        const cpt_repeat_result * repeat = &cells[i].repeat;
+        char batch[8];
+        char work[12];
+        char runs[12];
+        char schedulers[8];
+
+        // Adaptive batch sizes are marked with an 'a'
+        snprintf(batch, sizeof(batch), "%d%s", config->batch_size, config->adaptive_batch ? "a" : "");
+        snprintf(work, sizeof(work), "%d/%d", config->critical_size, config->private_size);
+
+        // One scheduler per core is marked with a 'c'
+        snprintf(schedulers, sizeof(schedulers), "%d%s", cpt_config_get_scheduler_count(config), config->scheduler_count == 0 ? "c" : "");
+
+        // Runs not converged to the target confidence interval are marked with a '*', if there was a target
+        snprintf(runs, sizeof(runs), "%d/%d%s", repeat->run_count, repeat->outlier_count,
+            repeat->convergence_requested && ! repeat->converged ? "*" : "");
+
+        if (result->ret != ESP_OK)
+        {
+            ESP_LOGI(TAG, "%7d %-9s %4d %-11s %-18s %-15s %-8s %6s %-9s %-11s %-6s %-9s %5s failed: %s",
+                config->concurrency,
+                cpt_scenario_to_name(config->scenario),
+                config->priority,
+                cpt_affinity_to_name(config->affinity),
+                cpt_lock_type_to_name(config->lock_type),
+                cpt_yield_policy_to_name(config->yield_policy),
+                cpt_job_backend_to_name(config->job_backend),
+                batch,
+                cpt_job_workload_to_name(config->workload),
+                work,
+                cpt_layout_to_name(config->layout),
+                cpt_channel_to_name(config->channel),
+                schedulers,
+                esp_err_to_name(result->ret));
+            continue;
+        }
+
+        ESP_LOGI(TAG, "%7d %-9s %4d %-11s %-18s %-15s %-8s %6s %-9s %-11s %-6s %-9s %5s %11"PRIu64" %14"PRIu64" %11"PRIu32" %12.1f %6.2f %7s",
+            config->concurrency,
+            cpt_scenario_to_name(config->scenario),
+            config->priority,
+            cpt_affinity_to_name(config->affinity),
+            cpt_lock_type_to_name(config->lock_type),
+            cpt_yield_policy_to_name(config->yield_policy),
+            cpt_job_backend_to_name(config->job_backend),
+            batch,
+            cpt_job_workload_to_name(config->workload),
+            work,
+            cpt_layout_to_name(config->layout),
+            cpt_channel_to_name(config->channel),
+            schedulers,
+            result->duration_us,
+            (uint64_t)cpt_sweep_get_throughput(result),
+            result->max_lock_wait_us,
+            result->footprint.bytes_per_worker,
+            repeat->duration_us.mean > 0 ? 100 * repeat->duration_us.ci95_half_width / repeat->duration_us.mean : 0,
+            runs);
+    }
+}
+
+// Logs the speedup of a group of cells that only differ by their concurrency, and the scalability models fitted on it.
+// The first cell of the group is at first_index, the next ones stride cells apart
+static void cpt_sweep_log_scalability(const cpt_sweep_cell * cells, size_t first_index, size_t stride, size_t count)
+{
+    double concurrencies[CPT_MAX_CONCURRENCY_COUNT];
+    double speedups[CPT_MAX_CONCURRENCY_COUNT];
+    double baseline = 0;
+    size_t points_count = 0;
+
+    for (size_t i = 0; i < count && points_count < CPT_MAX_CONCURRENCY_COUNT; i ++)
+    {
+        const cpt_sweep_cell * cell = &cells[first_index + i * stride];
+
+        if (cell->result.ret != ESP_OK)
+        {
+            continue;
+        }
+
+        if (cell->config.concurrency == 1)
+        {
+            baseline = cpt_sweep_get_throughput(&cell->result);
+        }
+
+        concurrencies[points_count] = cell->config.concurrency;
+        speedups[points_count] = cpt_sweep_get_throughput(&cell->result);
+        points_count ++;
+    }
+
+    // Speedups are relative to a single worker, without it there's nothing to fit
+    if (baseline <= 0 || points_count < 2)
+    {
+        return;
+    }
+
+    for (size_t i = 0; i < points_count; i ++)
+    {
+        speedups[i] /= baseline;
+    }
+
+    cpt_stats_scalability scalability;
+    cpt_stats_fit_scalability(concurrencies, speedups, points_count, &scalability);
+
+    const cpt_config * config = &cells[first_index].config;
+    ESP_LOGI(TAG, "Scalability: scenario %s prio %d affinity %s lock %s yield %s batch %d%s workload %s crit/priv %d/%d layout %s channel %s schedulers %d",
+        cpt_scenario_to_name(config->scenario),
+        config->priority,
+        cpt_affinity_to_name(config->affinity),
+        cpt_lock_type_to_name(config->lock_type),
+        cpt_yield_policy_to_name(config->yield_policy),
+        config->batch_size,
+        config->adaptive_batch ? "a" : "",
+        cpt_job_workload_to_name(config->workload),
+        config->critical_size,
+        config->private_size,
+        cpt_layout_to_name(config->layout),
+        cpt_channel_to_name(config->channel),
+        cpt_config_get_scheduler_count(config));
+    ESP_LOGI(TAG, "------- ------- ------- -------");
+    ESP_LOGI(TAG, "Workers Speedup Amdahl  USL");
+    ESP_LOGI(TAG, "------- ------- ------- -------");
+
+    for (size_t i = 0; i < points_count; i ++)
+    {
+        ESP_LOGI(TAG, "%7.0f %7.2f %7.2f %7.2f",
+            concurrencies[i],
+            speedups[i],
+            cpt_stats_get_amdahl_speedup(&scalability, concurrencies[i]),
+            cpt_stats_get_usl_speedup(&scalability, concurrencies[i]));
+    }
+
+    ESP_LOGI(TAG, "Amdahl sigma: %.4f USL sigma (contention): %.4f kappa (coherency): %.5f peak workers: %.1f",
+        scalability.amdahl_sigma,
+        scalability.usl_sigma,
+        scalability.usl_kappa,
+        scalability.usl_peak_concurrency);
+}
+
+// Builds the configuration for a cell: the cell index is decoded as a mixed radix number, one digit per dimension
+static void cpt_sweep_get_cell_config(const cpt_sweep * sweep, const cpt_config * base_config, size_t cell_index, cpt_config * config)
+{
+    * config = * base_config;
+
+#define CPT_SWEEP_APPLY_DIMENSION(field, values, count) \
+    if ((count) > 0) \
+    { \
+        config->field = (values)[cell_index % (count)]; \
+    } \
+    cell_index /= CPT_SWEEP_DIMENSION_SIZE(count)
+
+    // The last dimension applied varies the slowest
+    CPT_SWEEP_APPLY_DIMENSION(layout, sweep->layouts, sweep->layouts_count);
+    CPT_SWEEP_APPLY_DIMENSION(scheduler_count, sweep->scheduler_counts, sweep->scheduler_counts_count);
+    CPT_SWEEP_APPLY_DIMENSION(lock_type, sweep->lock_types, sweep->lock_types_count);
+    CPT_SWEEP_APPLY_DIMENSION(yield_policy, sweep->yield_policies, sweep->yield_policies_count);
+    CPT_SWEEP_APPLY_DIMENSION(channel, sweep->channels, sweep->channels_count);
+    CPT_SWEEP_APPLY_DIMENSION(adaptive_batch, sweep->adaptive_batches, sweep->adaptive_batches_count);
+    CPT_SWEEP_APPLY_DIMENSION(batch_size, sweep->batch_sizes, sweep->batch_sizes_count);
+    CPT_SWEEP_APPLY_DIMENSION(affinity, sweep->affinities, sweep->affinities_count);
+    CPT_SWEEP_APPLY_DIMENSION(priority, sweep->priorities, sweep->priorities_count);
+    CPT_SWEEP_APPLY_DIMENSION(scenario, sweep->scenarios, sweep->scenarios_count);
+    CPT_SWEEP_APPLY_DIMENSION(critical_size, sweep->critical_sizes, sweep->critical_sizes_count);
+    CPT_SWEEP_APPLY_DIMENSION(private_size, sweep->private_sizes, sweep->private_sizes_count);
+    CPT_SWEEP_APPLY_DIMENSION(concurrency, sweep->concurrencies, sweep->concurrencies_count);
+    CPT_SWEEP_APPLY_DIMENSION(workload, sweep->workloads, sweep->workloads_count);
+
+#undef CPT_SWEEP_APPLY_DIMENSION
+}
+
+esp_err_t cpt_sweep_run(const cpt_engine * engine, const cpt_config * base_config, const cpt_sweep * sweep)
+{
+    esp_err_t ret = ESP_OK;
+    size_t cells_count =
+        CPT_SWEEP_DIMENSION_SIZE(sweep->concurrencies_count) *
+        CPT_SWEEP_DIMENSION_SIZE(sweep->priorities_count) *
+        CPT_SWEEP_DIMENSION_SIZE(sweep->affinities_count) *
+        CPT_SWEEP_DIMENSION_SIZE(sweep->scenarios_count) *
+        CPT_SWEEP_DIMENSION_SIZE(sweep->lock_types_count) *
+        CPT_SWEEP_DIMENSION_SIZE(sweep->yield_policies_count) *
+        CPT_SWEEP_DIMENSION_SIZE(sweep->batch_sizes_count) *
+        CPT_SWEEP_DIMENSION_SIZE(sweep->adaptive_batches_count) *
+        CPT_SWEEP_DIMENSION_SIZE(sweep->workloads_count) *
+        CPT_SWEEP_DIMENSION_SIZE(sweep->critical_sizes_count) *
+        CPT_SWEEP_DIMENSION_SIZE(sweep->private_sizes_count) *
+        CPT_SWEEP_DIMENSION_SIZE(sweep->layouts_count) *
+        CPT_SWEEP_DIMENSION_SIZE(sweep->scheduler_counts_count) *
+        CPT_SWEEP_DIMENSION_SIZE(sweep->channels_count);
+
+    // Cells only differing by their concurrency are concurrency_stride apart, as it's applied after all the other
+    // dimensions but the workload
+    size_t concurrencies_count = CPT_SWEEP_DIMENSION_SIZE(sweep->concurrencies_count);
+    size_t concurrency_stride = cells_count / concurrencies_count / CPT_SWEEP_DIMENSION_SIZE(sweep->workloads_count);
+
+    // Results are kept until the end, so that the table isn't interleaved with the logs of the runs
+    cpt_sweep_cell * cells = calloc(cells_count, sizeof(cpt_sweep_cell));
+    ESP_RETURN_ON_FALSE(cells != NULL, ESP_ERR_NO_MEM, TAG, "Unable to allocate %zu sweep cells", cells_count);
+
+    for (size_t i = 0; i < cells_count; i ++)
+    {
+        cpt_sweep_cell * cell = &cells[i];
+
+        cpt_sweep_get_cell_config(sweep, base_config, i, &cell->config);
+
+        ESP_LOGI(TAG, "Cell %zu/%zu", i + 1, cells_count);
+
+        if (cpt_repeat_run(engine, &cell->config, sweep->repeat != NULL ? sweep->repeat : &cpt_sweep_single_run, &cell->repeat) != ESP_OK)
+        {
+            ret = cell->repeat.result.ret;
+        }
+        else if (sweep->repeat != NULL)
+        {
+            cpt_repeat_log_result(engine, &cell->repeat);
+        }
+
+        cell->result = cell->repeat.result;
+    }
+
+    cpt_sweep_log_table(engine, cells, cells_count);
+
+    if (concurrencies_count > 1)
+    {
+        ESP_LOGI(TAG, "==== Scalability for %s ====", engine->name);
+
+        for (size_t i = 0; i < cells_count; i ++)
+        {
+            // Only the first cell of each group starts one
+            if ((i / concurrency_stride) % concurrencies_count == 0)
+            {
+                cpt_sweep_log_scalability(cells, i, concurrency_stride, concurrencies_count);
+            }
+        }
+    }
+    free(cells);
+
+    return ret;
+}
\ No newline at end of file
@@ -0,0 +1,104 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __CPT_SWEEP_H__
+#define __CPT_SWEEP_H__
+
+#include "esp_err.h"
+
+#include "cpt_globals.h"
+#include "cpt_engine.h"
+#include "cpt_repeat.h"
+
+/// @brief A matrix of configurations to run an engine on. Each array lists the values to try for a config field,
+/// every combination (cell) is run, repeatedly if repeat is set. Empty arrays (count of 0) keep the value of the base
+/// configuration.
+typedef struct
+{
+    const uint8_t * concurrencies;
+    size_t concurrencies_count;
+
+    const uint8_t * priorities;
+    size_t priorities_count;
+
+    const cpt_affinity * affinities;
+    size_t affinities_count;
+
+    const cpt_scenario * scenarios;
+    size_t scenarios_count;
+
+    // Varies fast, after the layout: the locks of a configuration are logged on neighbouring rows
+    const cpt_lock_type * lock_types;
+    size_t lock_types_count;
+
+    const cpt_yield_policy * yield_policies;
+    size_t yield_policies_count;
+
+    const uint16_t * batch_sizes;
+    size_t batch_sizes_count;
+
+    const bool * adaptive_batches;
+    size_t adaptive_batches_count;
+
+    const cpt_workload * workloads;
+    size_t workloads_count;
+
+    // Work units inside (Y) and outside (X) the critical section, swept to see how the X/Y ratio affects scalability
+    const uint16_t * critical_sizes;
+    size_t critical_sizes_count;
+
+    const uint16_t * private_sizes;
+    size_t private_sizes_count;
+
+    const cpt_channel * channels;
+    size_t channels_count;
+
+    // Varies the fastest, so that the layouts of a configuration are logged on consecutive rows
+    const cpt_layout * layouts;
+    size_t layouts_count;
+
+    // Varies fast, after the layout: a single scheduler and stealing ones are logged on neighbouring rows
+    const uint8_t * scheduler_counts;
+    size_t scheduler_counts_count;
+
+    // How each cell is repeated, NULL to run each cell once
+    const cpt_repeat_params * repeat;
+} cpt_sweep;
+
+/// @brief Outcome of a cell of the sweep
+typedef struct
+{
+    cpt_config config;
+    cpt_engine_result result; // Duration is the median of the repetitions
+    cpt_repeat_result repeat;
+} cpt_sweep_cell;
+
+/// @brief Runs engine on every cell of the sweep matrix, then logs a table with the results. When concurrencies
+/// include 1 and some larger values, the speedup against the concurrency is also logged for each combination of the
+/// other dimensions, fitted against Amdahl's law and the Universal Scalability Law
+/// @param base_config the configuration to use for the fields not swept
+/// @return ESP_OK if all cells ran successfully, otherwise the error of the last cell that failed
+esp_err_t cpt_sweep_run(const cpt_engine * engine, const cpt_config * base_config, const cpt_sweep * sweep);
+
+#endif //__CPT_SWEEP_H__
+
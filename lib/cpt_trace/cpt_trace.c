@@ -0,0 +1,244 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#include <string.h>
+#include "esp_log.h"
+
+#include "cpt_trace.h"
+#include "cpt_utils.h"
+
+#define TAG "trace"
+
+static const char * cpt_trace_type_names[CPT_TRACE_TYPE_COUNT] = {
+    "lock_request",
+    "lock_acquire",
+    "lock_release",
+    "yield",
+    "state_change",
+    "job_done",
+};
+
+/// @brief Slice currently open on a track, B and E events must match in Chrome traces
+typedef enum
+{
+    CPT_TRACE_SLICE_NONE,
+    CPT_TRACE_SLICE_WAIT,
+    CPT_TRACE_SLICE_HOLD,
+} cpt_trace_slice;
+
+cpt_trace_buffer * cpt_trace_buffer_create()
+{
+    // Internal memory only: the buffers of tasks on both cores are read after the run
+    cpt_trace_buffer * buffer = cpt_platform_malloc(sizeof(cpt_trace_buffer), 0, CPT_PLATFORM_MEMORY_INTERNAL);
+
+    if (buffer != NULL)
+    {
+        memset(buffer, 0, sizeof(cpt_trace_buffer));
+    }
+
+    return buffer;
+}
+
+void cpt_trace_clock_synchronize(cpt_trace_clock * clock)
+{
+    int32_t core = cpt_platform_get_core_id();
+
+    if (core < 0 || core >= CPT_TRACE_MAX_CORES || atomic_load(&clock->synchronized[core]))
+    {
+        return;
+    }
+
+    // Set once per core: a race between two tasks on the same core only keeps one of two equivalent anchors
+    clock->cycles[core] = cpt_platform_get_cycle_count();
+    clock->time_us[core] = cpt_platform_get_time_us();
+    atomic_store(&clock->synchronized[core], true);
+}
+
+// Index of the oldest event still in the buffer
+static inline uint32_t cpt_trace_get_first(const cpt_trace_buffer * buffer)
+{
+    uint32_t head = atomic_load(&buffer->head);
+
+    return head > CPT_TRACE_EVENT_COUNT ? head - CPT_TRACE_EVENT_COUNT : 0;
+}
+
+void cpt_trace_log_summary(const char * name, const cpt_trace_buffer * buffer)
+{
+    uint32_t counts[CPT_TRACE_TYPE_COUNT] = {0};
+    uint32_t head = atomic_load(&buffer->head);
+    uint32_t first = cpt_trace_get_first(buffer); // Also the number of events overwritten
+    char line[CPT_TRACE_TYPE_COUNT * 24];
+    int line_length = 0;
+
+    for (uint32_t i = first; i != head; i ++)
+    {
+        uint8_t type = buffer->events[i & (CPT_TRACE_EVENT_COUNT - 1)].type;
+
+        if (type < CPT_TRACE_TYPE_COUNT)
+        {
+            counts[type] ++;
+        }
+    }
+
+    line[0] = '\0';
+    for (int type = 0; type < CPT_TRACE_TYPE_COUNT; type ++)
+    {
+        line_length += snprintf(line + line_length, sizeof(line) - line_length, " %s: %"PRIu32, cpt_trace_type_names[type], counts[type]);
+    }
+
+    ESP_LOGI(TAG, "%s:%s overwritten: %"PRIu32, name, line, first);
+}
+
+// Converts a timestamp to microseconds since start_time_us, with the anchor of the core the event was recorded on
+static double cpt_trace_get_timestamp(const cpt_trace_clock * clock, const cpt_trace_event * event, uint64_t start_time_us)
+{
+    int32_t core = event->core;
+
+    if (core >= CPT_TRACE_MAX_CORES || ! atomic_load(&clock->synchronized[core]))
+    {
+        // Best effort for a core nobody synchronized on: any anchor is better than none
+        for (core = 0; core < CPT_TRACE_MAX_CORES && ! atomic_load(&clock->synchronized[core]); core ++)
+        {
+        }
+
+        if (core == CPT_TRACE_MAX_CORES)
+        {
+            return 0;
+        }
+    }
+
+    // Signed difference, so that events a little before the anchor and counter wraps are handled
+    int32_t cycles = (int32_t)(event->cycles - clock->cycles[core]);
+
+    return (double)(int64_t)(clock->time_us[core] - start_time_us) + (double) cycles / cpt_platform_get_cycles_per_us();
+}
+
+static void cpt_trace_write_event(FILE * file, bool * first, const char * name, char phase, double timestamp, uint8_t track, const char * args)
+{
+    fprintf(file, "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":0,\"tid\":%d%s%s}",
+        * first ? "" : ",",
+        name,
+        phase,
+        timestamp,
+        track,
+        phase == 'i' ? ",\"s\":\"t\"" : "",
+        args);
+
+    * first = false;
+}
+
+static void cpt_trace_write_buffer(FILE * file, bool * first, const cpt_trace_clock * clock, const cpt_trace_buffer * buffer,
+    uint8_t track, uint64_t start_time_us)
+{
+    cpt_trace_slice open_slice = CPT_TRACE_SLICE_NONE;
+    uint32_t head = atomic_load(&buffer->head);
+    double timestamp = 0;
+    char args[48];
+
+    for (uint32_t i = cpt_trace_get_first(buffer); i != head; i ++)
+    {
+        const cpt_trace_event * event = &buffer->events[i & (CPT_TRACE_EVENT_COUNT - 1)];
+
+        timestamp = cpt_trace_get_timestamp(clock, event, start_time_us);
+        snprintf(args, sizeof(args), ",\"args\":{\"core\":%d}", event->core);
+
+        switch (event->type)
+        {
+            case CPT_TRACE_LOCK_REQUEST:
+                cpt_trace_write_event(file, first, "wait", 'B', timestamp, track, args);
+                open_slice = CPT_TRACE_SLICE_WAIT;
+                break;
+
+            case CPT_TRACE_LOCK_ACQUIRE:
+                // The request may have been overwritten, in which case the wait is dropped
+                if (open_slice == CPT_TRACE_SLICE_WAIT)
+                {
+                    cpt_trace_write_event(file, first, "wait", 'E', timestamp, track, "");
+                }
+
+                snprintf(args, sizeof(args), ",\"args\":{\"core\":%d,\"iterations\":%d}", event->core, event->argument);
+                cpt_trace_write_event(file, first, "hold", 'B', timestamp, track, args);
+                open_slice = CPT_TRACE_SLICE_HOLD;
+                break;
+
+            case CPT_TRACE_LOCK_RELEASE:
+                if (open_slice == CPT_TRACE_SLICE_HOLD)
+                {
+                    cpt_trace_write_event(file, first, "hold", 'E', timestamp, track, "");
+                }
+
+                open_slice = CPT_TRACE_SLICE_NONE;
+                break;
+
+            case CPT_TRACE_STATE_CHANGE:
+                cpt_trace_write_event(file, first, cpt_state_to_name(event->argument), 'i', timestamp, track, args);
+                break;
+
+            case CPT_TRACE_YIELD:
+            case CPT_TRACE_JOB_DONE:
+                cpt_trace_write_event(file, first, cpt_trace_type_names[event->type], 'i', timestamp, track, args);
+                break;
+
+            default:
+                break;
+        }
+    }
+
+    // Close a slice cut by the end of the trace, at the last event
+    if (open_slice != CPT_TRACE_SLICE_NONE)
+    {
+        cpt_trace_write_event(file, first, open_slice == CPT_TRACE_SLICE_WAIT ? "wait" : "hold", 'E', timestamp, track, "");
+    }
+}
+
+void cpt_trace_write_chrome(FILE * file, const cpt_trace_clock * clock, const cpt_trace_buffer * const * buffers, const uint8_t * tracks,
+    size_t buffers_count, uint64_t start_time_us)
+{
+    bool first = true;
+    char args[48];
+
+    fprintf(file, "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[");
+
+    for (size_t i = 0; i < buffers_count; i ++)
+    {
+        if (buffers[i] == NULL)
+        {
+            continue;
+        }
+
+        if (tracks[i] == CPT_TRACE_ENGINE_TRACK)
+        {
+            snprintf(args, sizeof(args), ",\"args\":{\"name\":\"engine\"}");
+        }
+        else
+        {
+            snprintf(args, sizeof(args), ",\"args\":{\"name\":\"task %d\"}", tracks[i]);
+        }
+
+        cpt_trace_write_event(file, &first, "thread_name", 'M', 0, tracks[i], args);
+        cpt_trace_write_buffer(file, &first, clock, buffers[i], tracks[i], start_time_us);
+    }
+
+    fprintf(file, "\n]}\n");
+    fflush(file);
+}
\ No newline at end of file
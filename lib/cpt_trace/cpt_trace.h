@@ -0,0 +1,127 @@
+/*
+Copyright (c) 2023 Quantumboar <quantum@quantumboar.net>
+
+Permission is hereby granted, free of charge, to any person obtaining
+a copy of this software and associated documentation files (the
+"Software"), to deal in the Software without restriction, including
+without limitation the rights to use, copy, modify, merge, publish,
+distribute, sublicense, and/or sell copies of the Software, and to
+permit persons to whom the Software is furnished to do so, subject to
+the following conditions:
+
+The above copyright notice and this permission notice shall be
+included in all copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+*/
+
+#ifndef __CPT_TRACE_H__
+#define __CPT_TRACE_H__
+
+#include <stdbool.h>
+#include <stdio.h>
+#include "esp_err.h"
+#include "stdatomic.h"
+
+#include "cpt_globals.h"
+#include "cpt_platform.h"
+
+// Events kept per buffer, a power of 2. When full, the oldest events are overwritten. 8 bytes each, in internal RAM
+#define CPT_TRACE_EVENT_COUNT (512)
+
+// Cores the clock can be synchronized on
+#define CPT_TRACE_MAX_CORES (8)
+
+// Track number used for events that aren't recorded by a worker (e.g. state changes)
+#define CPT_TRACE_ENGINE_TRACK (0xFF)
+
+_Static_assert((CPT_TRACE_EVENT_COUNT & (CPT_TRACE_EVENT_COUNT - 1)) == 0, "CPT_TRACE_EVENT_COUNT must be a power of 2");
+
+typedef enum
+{
+    CPT_TRACE_LOCK_REQUEST,
+    CPT_TRACE_LOCK_ACQUIRE, // argument: the number of job iterations about to be run
+    CPT_TRACE_LOCK_RELEASE,
+    CPT_TRACE_YIELD,
+    CPT_TRACE_STATE_CHANGE, // argument: the new cpt_state
+    CPT_TRACE_JOB_DONE,
+    CPT_TRACE_TYPE_COUNT,
+} cpt_trace_type;
+
+/// @brief A compact event: 8 bytes, cheap enough to record from the hot path
+typedef struct
+{
+    uint32_t cycles; // Cycle counter of the core the event was recorded on
+    uint8_t type; // cpt_trace_type
+    uint8_t core;
+    uint16_t argument;
+} cpt_trace_event;
+
+/// @brief Ring of events. cpt_trace_record is for buffers with a single writer, cpt_trace_record_shared for
+/// buffers written by several tasks. Neither takes a lock
+typedef struct
+{
+    volatile _Atomic uint32_t head; // Events ever recorded, the next one goes at head % CPT_TRACE_EVENT_COUNT
+    cpt_trace_event events[CPT_TRACE_EVENT_COUNT];
+} cpt_trace_buffer;
+
+/// @brief Cycle counters of different cores aren't synchronized. The clock keeps, for each core, a cycle count
+/// read together with the time, which converts the timestamps of the events recorded on that core
+typedef struct
+{
+    volatile atomic_bool synchronized[CPT_TRACE_MAX_CORES];
+    uint32_t cycles[CPT_TRACE_MAX_CORES];
+    uint64_t time_us[CPT_TRACE_MAX_CORES];
+} cpt_trace_clock;
+
+static inline void cpt_trace_write(cpt_trace_buffer * buffer, uint32_t position, cpt_trace_type type, uint16_t argument)
+{
+    cpt_trace_event * event = &buffer->events[position & (CPT_TRACE_EVENT_COUNT - 1)];
+
+    event->cycles = cpt_platform_get_cycle_count();
+    event->type = type;
+    event->core = cpt_platform_get_core_id();
+    event->argument = argument;
+}
+
+/// @brief Records an event in a buffer only written by the caller
+static inline void cpt_trace_record(cpt_trace_buffer * buffer, cpt_trace_type type, uint16_t argument)
+{
+    uint32_t position = atomic_load_explicit(&buffer->head, memory_order_relaxed);
+
+    cpt_trace_write(buffer, position, type, argument);
+    atomic_store_explicit(&buffer->head, position + 1, memory_order_relaxed);
+}
+
+/// @brief Records an event in a buffer written by several tasks. Events are in the order their slot was reserved
+static inline void cpt_trace_record_shared(cpt_trace_buffer * buffer, cpt_trace_type type, uint16_t argument)
+{
+    cpt_trace_write(buffer, atomic_fetch_add_explicit(&buffer->head, 1, memory_order_relaxed), type, argument);
+}
+
+/// @brief Allocates a buffer in internal memory
+/// @return the buffer, to be freed with cpt_platform_free, or NULL
+cpt_trace_buffer * cpt_trace_buffer_create();
+
+/// @brief Records the cycle counter of the calling core against the time, unless already done for that core. To
+/// be called from each worker before recording, so that all cores it runs on are covered
+void cpt_trace_clock_synchronize(cpt_trace_clock * clock);
+
+/// @brief Logs how many events of each type a buffer holds, and how many were overwritten
+void cpt_trace_log_summary(const char * name, const cpt_trace_buffer * buffer);
+
+/// @brief Writes buffers as Chrome trace JSON, which Perfetto (ui.perfetto.dev) and chrome://tracing open. Each
+/// buffer is a track, lock waits and holds are slices, other events are instants
+/// @param buffers the buffers, NULL entries are skipped
+/// @param tracks the track number of each buffer, CPT_TRACE_ENGINE_TRACK for the engine's
+/// @param start_time_us the time the trace starts at, usually the start of the run
+void cpt_trace_write_chrome(FILE * file, const cpt_trace_clock * clock, const cpt_trace_buffer * const * buffers, const uint8_t * tracks,
+    size_t buffers_count, uint64_t start_time_us);
+
+#endif //__CPT_TRACE_H__
\ No newline at end of file
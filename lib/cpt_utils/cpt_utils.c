@@ -21,98 +21,191 @@ OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
 WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 */
 
-#include <sys/time.h>
 #include <inttypes.h>
 
 #include "esp_check.h"
-#include "esp_heap_caps.h"
 #include "esp_log.h"
 
-#include "freertos/FreeRTOS.h"
-#include "freertos/task.h"
-
 #include "cpt_utils.h"
 
 #define TAG "utils"
 
 uint64_t cpt_get_current_time_ms()
 {
-    struct timeval tv;
-    gettimeofday(&tv, NULL);
-    return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+    return cpt_get_current_time_us() / 1000;
+}
+
+uint64_t cpt_get_current_time_us()
+{
+    return cpt_platform_get_time_us();
+}
+
+uint32_t cpt_cycles_to_ns(uint32_t cycles)
+{
+    return (uint32_t)((uint64_t) cycles * 1000 / cpt_platform_get_cycles_per_us());
+}
+
+uint64_t cpt_cycles_to_us(uint64_t cycles)
+{
+    return cycles / cpt_platform_get_cycles_per_us();
 }
 
 void cpt_log_memory()
 {
-    multi_heap_info_t heap_info = (multi_heap_info_t) {0};
-    heap_caps_get_info(&heap_info, 0); // 0 matches all heaps, stats will be totalled across them
+    cpt_platform_heap_stats heap_stats;
+    cpt_platform_get_heap_stats(&heap_stats);
 
     ESP_LOGI(TAG, "==== Memory stats ====");
-    ESP_LOGI(TAG, "Current free: %d minimum free: %d current allocated: %d",
-        heap_info.total_free_bytes,
-        heap_info.minimum_free_bytes,
-        heap_info.total_allocated_bytes);
+    ESP_LOGI(TAG, "Current free: %zu minimum free: %zu current allocated: %zu",
+        heap_stats.free_bytes,
+        heap_stats.minimum_free_bytes,
+        heap_stats.allocated_bytes);
 }
 
-// Method to log tasks in the system and their relative CPU usage
-esp_err_t cpt_log_tasks()
+// Logs the system status together with an informative tag
+esp_err_t cpt_log_system_status(const char * label)
 {
-    TaskStatus_t * task_statuses = NULL;
-
-    volatile UBaseType_t task_count;
     esp_err_t ret = ESP_OK;
 
-    task_count = uxTaskGetNumberOfTasks();
-    ESP_LOGI(TAG, "==== Tasks stats ====");
-    ESP_LOGI(TAG, "%d tasks in system", task_count);
-    ESP_GOTO_ON_FALSE(task_count > 0, ESP_ERR_INVALID_STATE, exit, TAG, "No tasks in system");
+    ESP_LOGI(TAG, "====== %s ======", label);
+    ret = cpt_platform_log_tasks();
+    ESP_LOGI(TAG,"");
+    cpt_log_memory();
+    ESP_LOGI(TAG,"");
 
-    task_statuses = pvPortMalloc(task_count * sizeof(TaskStatus_t));
-    ESP_GOTO_ON_FALSE(task_statuses != NULL, ESP_ERR_NO_MEM, exit, TAG, "Unable to allocate task info structures");
+    return ret;
+}
 
-    uint32_t total_run_time = 0;
-    float percentage_run_time;
-    float total_run_time_float;
+esp_err_t cpt_config_validate(const cpt_config * config)
+{
+    ESP_RETURN_ON_FALSE(config->concurrency > 0 && config->concurrency <= CPT_MAX_CONCURRENCY_COUNT, ESP_ERR_INVALID_ARG, TAG,
+        "Invalid concurrency %d, max is %d", config->concurrency, CPT_MAX_CONCURRENCY_COUNT);
+    ESP_RETURN_ON_FALSE(config->priority < CPT_PLATFORM_MAX_PRIORITIES, ESP_ERR_INVALID_ARG, TAG, "Invalid priority %d", config->priority);
+    ESP_RETURN_ON_FALSE(config->affinity < CPT_AFFINITY_COUNT, ESP_ERR_INVALID_ARG, TAG, "Invalid affinity %d", config->affinity);
+    ESP_RETURN_ON_FALSE(config->lock_type < CPT_LOCK_TYPE_COUNT, ESP_ERR_INVALID_ARG, TAG, "Invalid lock type %d", config->lock_type);
+    ESP_RETURN_ON_FALSE(config->job_backend < CPT_JOB_BACKEND_COUNT, ESP_ERR_INVALID_ARG, TAG, "Invalid job backend %d", config->job_backend);
+    ESP_RETURN_ON_FALSE(config->batch_size > 0, ESP_ERR_INVALID_ARG, TAG, "Invalid batch size %d", config->batch_size);
+    ESP_RETURN_ON_FALSE(config->workload < CPT_WORKLOAD_COUNT, ESP_ERR_INVALID_ARG, TAG, "Invalid workload %d", config->workload);
+    ESP_RETURN_ON_FALSE(config->layout < CPT_LAYOUT_COUNT, ESP_ERR_INVALID_ARG, TAG, "Invalid layout %d", config->layout);
+    ESP_RETURN_ON_FALSE(config->transport < CPT_TRANSPORT_COUNT, ESP_ERR_INVALID_ARG, TAG, "Invalid transport %d", config->transport);
+    ESP_RETURN_ON_FALSE(config->channel < CPT_CHANNEL_COUNT, ESP_ERR_INVALID_ARG, TAG, "Invalid channel %d", config->channel);
+    ESP_RETURN_ON_FALSE(config->scenario < CPT_SCENARIO_COUNT, ESP_ERR_INVALID_ARG, TAG, "Invalid scenario %d", config->scenario);
+    ESP_RETURN_ON_FALSE(config->yield_policy < CPT_YIELD_POLICY_COUNT, ESP_ERR_INVALID_ARG, TAG, "Invalid yield policy %d", config->yield_policy);
+    ESP_RETURN_ON_FALSE(config->scheduler_count <= CPT_MAX_SCHEDULER_COUNT, ESP_ERR_INVALID_ARG, TAG, "Invalid scheduler count %d, max is %d",
+        config->scheduler_count, CPT_MAX_SCHEDULER_COUNT);
+
+    return ESP_OK;
+}
 
-    task_count = uxTaskGetSystemState(task_statuses, task_count, &total_run_time);
-    ESP_GOTO_ON_FALSE(task_count > 0, ESP_ERR_INVALID_STATE, exit, TAG, "Unable to get tasks");
-    ESP_GOTO_ON_FALSE(total_run_time > 0, ESP_ERR_INVALID_STATE, exit, TAG, "Unable to get runtime");
+uint8_t cpt_config_get_scheduler_count(const cpt_config * config)
+{
+    if (config->scheduler_count > 0)
+    {
+        return config->scheduler_count;
+    }
 
-    total_run_time_float = (float)total_run_time / 100;
+    return cpt_platform_get_core_count() < CPT_MAX_SCHEDULER_COUNT ? cpt_platform_get_core_count() : CPT_MAX_SCHEDULER_COUNT;
+}
 
-    ESP_LOGI(TAG, "-------------- --------- ---- ----------------");
-    ESP_LOGI(TAG, "Name           CPU usage Prio Stack high water");
-    ESP_LOGI(TAG, "-------------- --------- ---- ----------------");
+int32_t cpt_affinity_get_core(cpt_affinity affinity, uint8_t worker_index)
+{
+    switch (affinity)
+    {
+        case CPT_AFFINITY_ROUND_ROBIN:
+            return worker_index % cpt_platform_get_core_count();
+        case CPT_AFFINITY_NONE:
+            return CPT_PLATFORM_NO_AFFINITY;
+        default:
+            return 0;
+    }
+}
 
-    for (int i = 0; i < task_count; i ++)
+const char * cpt_affinity_to_name(cpt_affinity affinity)
+{
+    switch (affinity)
     {
-        percentage_run_time = (float)task_statuses[i].ulRunTimeCounter / total_run_time_float;
-        ESP_LOGI(TAG, "%-16s %6.2f%% %4d %16lu",
-            task_statuses[i].pcTaskName, 
-            percentage_run_time,
-            task_statuses[i].uxCurrentPriority,
-            task_statuses[i].usStackHighWaterMark);
+        case CPT_AFFINITY_CORE_0:
+            return "core_0";
+        case CPT_AFFINITY_ROUND_ROBIN:
+            return "round_robin";
+        case CPT_AFFINITY_NONE:
+            return "none";
+        default:
+            return "invalid";
     }
+}
 
-    exit:
-    if (task_statuses)
+const char * cpt_layout_to_name(cpt_layout layout)
+{
+    switch (layout)
     {
-        vPortFree(task_statuses);
+        case CPT_LAYOUT_PACKED:
+            return "packed";
+        case CPT_LAYOUT_PADDED:
+            return "padded";
+        default:
+            return "invalid";
     }
+}
 
-    return ret;
+const char * cpt_transport_to_name(cpt_transport transport)
+{
+    switch (transport)
+    {
+        case CPT_TRANSPORT_QUEUE:
+            return "queue";
+        case CPT_TRANSPORT_STREAM_BUFFER:
+            return "stream_buffer";
+        case CPT_TRANSPORT_NOTIFICATION:
+            return "notification";
+        default:
+            return "invalid";
+    }
 }
 
-// Logs the system status together with an informative tag
-esp_err_t cpt_log_system_status(const char * label)
+const char * cpt_channel_to_name(cpt_channel channel)
 {
-    esp_err_t ret = ESP_OK;
+    switch (channel)
+    {
+        case CPT_CHANNEL_QUEUE:
+            return "queue";
+        case CPT_CHANNEL_RING_SPSC:
+            return "ring_spsc";
+        case CPT_CHANNEL_RING_MPMC:
+            return "ring_mpmc";
+        default:
+            return "invalid";
+    }
+}
 
-    ESP_LOGI(TAG, "====== %s ======", label);
-    ret = cpt_log_tasks();
-    ESP_LOGI(TAG,"");
-    cpt_log_memory();
-    ESP_LOGI(TAG,"");
+const char * cpt_scenario_to_name(cpt_scenario scenario)
+{
+    switch (scenario)
+    {
+        case CPT_SCENARIO_UNIFORM:
+            return "uniform";
+        case CPT_SCENARIO_PRIORITY_INVERSION:
+            return "inversion";
+        default:
+            return "invalid";
+    }
+}
 
-    return ret;
+const char * cpt_state_to_name(cpt_state state)
+{
+    switch (state)
+    {
+        case CPT_STATE_NONE:
+            return "none";
+        case CPT_STATE_INITIALIZING:
+            return "initializing";
+        case CPT_STATE_INITIALIZED:
+            return "initialized";
+        case CPT_STATE_RUNNING:
+            return "running";
+        case CPT_STATE_DONE:
+            return "done";
+        default:
+            return "invalid";
+    }
 }
\ No newline at end of file
@@ -27,9 +27,71 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 #include <inttypes.h>
 #include "esp_err.h"
 
+#include "cpt_globals.h"
+#include "cpt_platform.h"
+
 /// @brief get the current time in ms
 uint64_t cpt_get_current_time_ms();
 
+/// @brief get the current time in us, from the high resolution esp_timer (the monotonic clock on the host)
+uint64_t cpt_get_current_time_us();
+
+/// @brief get the cycle counter of the calling core. Cheap enough for hot paths, but counters aren't synchronized
+/// across cores, so only differences measured on the same core are meaningful. It wraps around in ~26s at 160MHz
+static inline uint32_t cpt_get_cycle_count()
+{
+    return cpt_platform_get_cycle_count();
+}
+
+/// @brief A cycle counter reading, along with the core it was taken on
+typedef struct
+{
+    uint32_t cycles;
+    int32_t core;
+} cpt_cycle_stamp;
+
+/// @brief get the cycle counter of the calling core, and which core that is. Use it rather than cpt_get_cycle_count
+/// to time anything that can block or be preempted: the task may resume on another core
+static inline cpt_cycle_stamp cpt_get_cycle_stamp()
+{
+    cpt_cycle_stamp stamp;
+
+#if CPT_PLATFORM_CYCLE_COUNT_PER_CORE
+    // The core is read again after the counter, in case the task moved in between
+    do
+    {
+        stamp.core = cpt_platform_get_core_id();
+        stamp.cycles = cpt_platform_get_cycle_count();
+    }
+    while (stamp.core != cpt_platform_get_core_id());
+#else
+    stamp.core = 0;
+    stamp.cycles = cpt_platform_get_cycle_count();
+#endif //CPT_PLATFORM_CYCLE_COUNT_PER_CORE
+
+    return stamp;
+}
+
+/// @brief get the cycles elapsed between two stamps
+/// @param elapsed set to the difference, unless the stamps were taken on different cores
+/// @return false if the stamps were taken on different cores, their counters can't be compared
+static inline bool cpt_cycle_stamp_get_elapsed(cpt_cycle_stamp start, cpt_cycle_stamp end, uint32_t * elapsed)
+{
+    if (start.core != end.core)
+    {
+        return false;
+    }
+
+    * elapsed = end.cycles - start.cycles;
+    return true;
+}
+
+/// @brief convert a number of CPU cycles to ns
+uint32_t cpt_cycles_to_ns(uint32_t cycles);
+
+/// @brief convert a (possibly accumulated) number of CPU cycles to us
+uint64_t cpt_cycles_to_us(uint64_t cycles);
+
 /// @brief log the system mamory status
 void cpt_log_memory();
 
@@ -37,9 +99,40 @@ void cpt_log_memory();
 /// @discussion to properyl log the task status (e.g. uxTaskGetSystemState) you'll need to enable the RTOS tracing features
 /// via setting the build option -DCONFIG_FREERTOS_USE_TRACE_FACILITY, f.e. for platformio.ini:
 /// build_flags = -DCONFIG_FREERTOS_USE_TRACE_FACILITY
-/// To generate thred stats, you'll also need GENERATE_RUN_TIME_STATS
+/// To generate thred stats, you'll also need GENERATE_RUN_TIME_STATS. Task stats aren't available on the host
 /// @param label A label to be show in the header of the system status log
 /// @return ESP_OK or an error code
 esp_err_t cpt_log_system_status(const char * label);
 
+/// @brief Checks the generic fields of a test configuration
+/// @return ESP_OK, ESP_ERR_INVALID_ARG if a field is out of range
+esp_err_t cpt_config_validate(const cpt_config * config);
+
+/// @brief gets the number of scheduler tasks of a configuration, resolving 0 to one per core
+/// @return 1 to CPT_MAX_SCHEDULER_COUNT
+uint8_t cpt_config_get_scheduler_count(const cpt_config * config);
+
+/// @brief gets the core a worker should be pinned to
+/// @param worker_index the index of the worker in its engine
+/// @return a core id, or CPT_PLATFORM_NO_AFFINITY
+int32_t cpt_affinity_get_core(cpt_affinity affinity, uint8_t worker_index);
+
+/// @brief gets a printable name for an affinity policy
+const char * cpt_affinity_to_name(cpt_affinity affinity);
+
+/// @brief gets a printable name for a layout
+const char * cpt_layout_to_name(cpt_layout layout);
+
+/// @brief gets a printable name for a transport
+const char * cpt_transport_to_name(cpt_transport transport);
+
+/// @brief gets a printable name for a channel
+const char * cpt_channel_to_name(cpt_channel channel);
+
+/// @brief gets a printable name for a scenario
+const char * cpt_scenario_to_name(cpt_scenario scenario);
+
+/// @brief gets a printable name for an engine state
+const char * cpt_state_to_name(cpt_state state);
+
 #endif // __CPT_UTILS_H__
\ No newline at end of file
@@ -24,40 +24,250 @@ WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
 /*Contention Perf Test (cpt for short)*/
 
 #include "esp_check.h"
+#include "cpt_platform.h"
+#include "cpt_engine.h"
 #include "cpt_preempt.h"
+#include "cpt_proto.h"
+#if CPT_PLATFORM_ESP_IDF
 #include "cpt_coop.h"
+#include "cpt_actor.h"
+#include "cpt_pipe.h"
+#endif //CPT_PLATFORM_ESP_IDF
+#include "cpt_sweep.h"
+#include "cpt_pool.h"
 
 #include "cpt_utils.h"
 
 #define TAG "cpt"
 
+// Each cell is warmed up then repeated until its duration is known within CPT_REPEAT_TARGET_RELATIVE_CI
+static const cpt_repeat_params cpt_repeat = CPT_REPEAT_PARAMS_DEFAULT;
+
+// Matrix of configurations each engine is run on. Leave an array out of the sweep to use the default configuration
+// value for it
+static const uint8_t cpt_sweep_concurrencies[] = {1, 2, 4, 8, 16};
+static const uint8_t cpt_sweep_priorities[] = {CPT_TASK_PRIO};
+static const cpt_affinity cpt_sweep_affinities[] = {CPT_AFFINITY_CORE_0, CPT_AFFINITY_ROUND_ROBIN, CPT_AFFINITY_NONE};
+static const uint16_t cpt_sweep_batch_sizes[] = {1, 4, 16, 64};
+static const cpt_layout cpt_sweep_layouts[] = {CPT_LAYOUT_PACKED, CPT_LAYOUT_PADDED};
+
+// Private work per iteration, against the units of critical work. Sizes only matter with a workload other than
+// CPT_WORKLOAD_COUNTER: the contention sweep only uses them when it's not the default, the Amdahl sweep always does
+static const uint16_t cpt_sweep_private_sizes[] = {0, 64, 256};
+
+static const cpt_sweep cpt_contention_sweep = {
+    .concurrencies = cpt_sweep_concurrencies,
+    .concurrencies_count = CPT_ARRAY_SIZE(cpt_sweep_concurrencies),
+    .priorities = cpt_sweep_priorities,
+    .priorities_count = CPT_ARRAY_SIZE(cpt_sweep_priorities),
+    .affinities = cpt_sweep_affinities,
+    .affinities_count = CPT_ARRAY_SIZE(cpt_sweep_affinities),
+    .batch_sizes = cpt_sweep_batch_sizes,
+    .batch_sizes_count = CPT_ARRAY_SIZE(cpt_sweep_batch_sizes),
+    .layouts = cpt_sweep_layouts,
+    .layouts_count = CPT_ARRAY_SIZE(cpt_sweep_layouts),
+    .private_sizes = CPT_WORKLOAD != CPT_WORKLOAD_COUNTER ? cpt_sweep_private_sizes : NULL,
+    .private_sizes_count = CPT_WORKLOAD != CPT_WORKLOAD_COUNTER ? CPT_ARRAY_SIZE(cpt_sweep_private_sizes) : 0,
+    .repeat = &cpt_repeat,
+};
+
+// Amdahl and USL fits against the ratio of private (X) to critical (Y) work per iteration, on a compute and a memory
+// bound workload. The serial fraction fitted for each X/Y tells how far the workers can scale with that much work done
+// outside of the job lock. On ESP32 the strided workload only misses a cache with CPT_JOB_BUFFER_IN_PSRAM, see cpt_job.h
+static const uint8_t cpt_amdahl_sweep_concurrencies[] = {1, 2, 4, 8};
+static const cpt_affinity cpt_amdahl_sweep_affinities[] = {CPT_AFFINITY_ROUND_ROBIN};
+static const cpt_workload cpt_amdahl_sweep_workloads[] = {CPT_WORKLOAD_CRC, CPT_WORKLOAD_STRIDED};
+static const uint16_t cpt_amdahl_sweep_critical_sizes[] = {16, 64};
+
+static const cpt_sweep cpt_amdahl_sweep = {
+    .concurrencies = cpt_amdahl_sweep_concurrencies,
+    .concurrencies_count = CPT_ARRAY_SIZE(cpt_amdahl_sweep_concurrencies),
+    .affinities = cpt_amdahl_sweep_affinities,
+    .affinities_count = CPT_ARRAY_SIZE(cpt_amdahl_sweep_affinities),
+    .workloads = cpt_amdahl_sweep_workloads,
+    .workloads_count = CPT_ARRAY_SIZE(cpt_amdahl_sweep_workloads),
+    .critical_sizes = cpt_amdahl_sweep_critical_sizes,
+    .critical_sizes_count = CPT_ARRAY_SIZE(cpt_amdahl_sweep_critical_sizes),
+    .private_sizes = cpt_sweep_private_sizes,
+    .private_sizes_count = CPT_ARRAY_SIZE(cpt_sweep_private_sizes),
+    .repeat = &cpt_repeat,
+};
+
+// Priority inversion: the worst case lock wait of the latency critical worker, for the lock without priority
+// inheritance and the ways around it. See CPT_SCENARIO_PRIORITY_INVERSION in cpt_preempt.h. With 3 round robin
+// workers the only hog is on the other core, which makes a baseline without inversion
+static const uint8_t cpt_inversion_sweep_concurrencies[] = {3, 5};
+static const cpt_scenario cpt_inversion_sweep_scenarios[] = {CPT_SCENARIO_PRIORITY_INVERSION};
+static const cpt_affinity cpt_inversion_sweep_affinities[] = {CPT_AFFINITY_CORE_0, CPT_AFFINITY_ROUND_ROBIN};
+static const cpt_lock_type cpt_inversion_sweep_lock_types[] = {
+    CPT_LOCK_COUNTING_SEMAPHORE,
+    CPT_LOCK_MUTEX,
+    CPT_LOCK_PRIORITY_CEILING,
+    CPT_LOCK_CRITICAL_SECTION,
+};
+
+// Worst cases need a few runs, but not the convergence of the mean duration: the hogs make it vary by design
+static const cpt_repeat_params cpt_inversion_repeat = {
+    .warmup_count = 0,
+    .min_count = 3,
+    .max_count = 3,
+    .target_relative_ci = 0,
+    .outlier_threshold = CPT_STATS_OUTLIER_THRESHOLD,
+};
+
+static const cpt_sweep cpt_inversion_sweep = {
+    .concurrencies = cpt_inversion_sweep_concurrencies,
+    .concurrencies_count = CPT_ARRAY_SIZE(cpt_inversion_sweep_concurrencies),
+    .scenarios = cpt_inversion_sweep_scenarios,
+    .scenarios_count = CPT_ARRAY_SIZE(cpt_inversion_sweep_scenarios),
+    .affinities = cpt_inversion_sweep_affinities,
+    .affinities_count = CPT_ARRAY_SIZE(cpt_inversion_sweep_affinities),
+    .lock_types = cpt_inversion_sweep_lock_types,
+    .lock_types_count = CPT_ARRAY_SIZE(cpt_inversion_sweep_lock_types),
+    .repeat = &cpt_inversion_repeat,
+};
+
+// Yield policies, on a blocking and a spinning lock, with workers sharing a core or not. Batches are large so that
+// the delay policy, which sleeps a tick per batch, still finishes in seconds. Job share and gaps in the reports tell
+// whether a policy starves the other tasks of its core
+static const uint8_t cpt_yield_sweep_concurrencies[] = {2, 4};
+static const cpt_affinity cpt_yield_sweep_affinities[] = {CPT_AFFINITY_CORE_0, CPT_AFFINITY_ROUND_ROBIN};
+static const uint16_t cpt_yield_sweep_batch_sizes[] = {256};
+static const cpt_lock_type cpt_yield_sweep_lock_types[] = {CPT_LOCK_COUNTING_SEMAPHORE, CPT_LOCK_TICKET};
+static const cpt_yield_policy cpt_yield_sweep_policies[] = {
+    CPT_YIELD_BASELINE,
+    CPT_YIELD_NEVER,
+    CPT_YIELD_EVERY_N,
+    CPT_YIELD_DELAY,
+    CPT_YIELD_BACKOFF,
+    CPT_YIELD_SPIN_THEN_BLOCK,
+};
+
+static const cpt_sweep cpt_yield_sweep = {
+    .concurrencies = cpt_yield_sweep_concurrencies,
+    .concurrencies_count = CPT_ARRAY_SIZE(cpt_yield_sweep_concurrencies),
+    .affinities = cpt_yield_sweep_affinities,
+    .affinities_count = CPT_ARRAY_SIZE(cpt_yield_sweep_affinities),
+    .batch_sizes = cpt_yield_sweep_batch_sizes,
+    .batch_sizes_count = CPT_ARRAY_SIZE(cpt_yield_sweep_batch_sizes),
+    .lock_types = cpt_yield_sweep_lock_types,
+    .lock_types_count = CPT_ARRAY_SIZE(cpt_yield_sweep_lock_types),
+    .yield_policies = cpt_yield_sweep_policies,
+    .yield_policies_count = CPT_ARRAY_SIZE(cpt_yield_sweep_policies),
+};
+
+// Coroutines: CPT_PROTO_WORKERS_PER_CONCURRENCY workers per unit of concurrency, up to 10240, on a scheduler per core.
+// Both schedulers on core 0 show what the second core adds
+static const cpt_affinity cpt_proto_sweep_affinities[] = {CPT_AFFINITY_CORE_0, CPT_AFFINITY_ROUND_ROBIN};
+
+static const cpt_sweep cpt_proto_sweep = {
+    .concurrencies = cpt_sweep_concurrencies,
+    .concurrencies_count = CPT_ARRAY_SIZE(cpt_sweep_concurrencies),
+    .affinities = cpt_proto_sweep_affinities,
+    .affinities_count = CPT_ARRAY_SIZE(cpt_proto_sweep_affinities),
+    .repeat = &cpt_repeat,
+};
+
+#if CPT_PLATFORM_ESP_IDF
+// The contention sweep on the cooperative engine, with a single scheduler and with one per core stealing fsms from
+// each other, side by side
+static const uint8_t cpt_coop_sweep_scheduler_counts[] = {1, 0};
+
+static const cpt_sweep cpt_coop_sweep = {
+    .concurrencies = cpt_sweep_concurrencies,
+    .concurrencies_count = CPT_ARRAY_SIZE(cpt_sweep_concurrencies),
+    .priorities = cpt_sweep_priorities,
+    .priorities_count = CPT_ARRAY_SIZE(cpt_sweep_priorities),
+    .affinities = cpt_sweep_affinities,
+    .affinities_count = CPT_ARRAY_SIZE(cpt_sweep_affinities),
+    .batch_sizes = cpt_sweep_batch_sizes,
+    .batch_sizes_count = CPT_ARRAY_SIZE(cpt_sweep_batch_sizes),
+    .layouts = cpt_sweep_layouts,
+    .layouts_count = CPT_ARRAY_SIZE(cpt_sweep_layouts),
+    .private_sizes = CPT_WORKLOAD != CPT_WORKLOAD_COUNTER ? cpt_sweep_private_sizes : NULL,
+    .private_sizes_count = CPT_WORKLOAD != CPT_WORKLOAD_COUNTER ? CPT_ARRAY_SIZE(cpt_sweep_private_sizes) : 0,
+    .scheduler_counts = cpt_coop_sweep_scheduler_counts,
+    .scheduler_counts_count = CPT_ARRAY_SIZE(cpt_coop_sweep_scheduler_counts),
+    .repeat = &cpt_repeat,
+};
+
+// Producers and consumers: the lock-free rings against the FreeRTOS queue, on one core and across cores
+static const uint8_t cpt_pipe_sweep_concurrencies[] = {2, 4, 8};
+static const cpt_affinity cpt_pipe_sweep_affinities[] = {CPT_AFFINITY_CORE_0, CPT_AFFINITY_ROUND_ROBIN};
+static const cpt_channel cpt_pipe_sweep_channels[] = {CPT_CHANNEL_QUEUE, CPT_CHANNEL_RING_SPSC, CPT_CHANNEL_RING_MPMC};
+
+static const cpt_sweep cpt_pipe_sweep = {
+    .concurrencies = cpt_pipe_sweep_concurrencies,
+    .concurrencies_count = CPT_ARRAY_SIZE(cpt_pipe_sweep_concurrencies),
+    .affinities = cpt_pipe_sweep_affinities,
+    .affinities_count = CPT_ARRAY_SIZE(cpt_pipe_sweep_affinities),
+    .channels = cpt_pipe_sweep_channels,
+    .channels_count = CPT_ARRAY_SIZE(cpt_pipe_sweep_channels),
+    .repeat = &cpt_repeat,
+};
+#endif //CPT_PLATFORM_ESP_IDF
+
+// Engines to run, in order, and the sweep each is run on. Only the preemptive and coroutine engines are ported to the
+// host, the others still use FreeRTOS queues, stream buffers and task notifications directly
+static const struct
+{
+    const char * engine_name;
+    const cpt_sweep * sweep;
+} cpt_runs[] = {
+    {"preempt", &cpt_contention_sweep},
+    {"preempt", &cpt_amdahl_sweep},
+    {"preempt", &cpt_inversion_sweep},
+    {"preempt", &cpt_yield_sweep},
+    {"proto", &cpt_proto_sweep},
+#if CPT_PLATFORM_ESP_IDF
+    {"coop", &cpt_coop_sweep},
+    {"actor", &cpt_contention_sweep},
+    {"pipe", &cpt_pipe_sweep},
+#endif //CPT_PLATFORM_ESP_IDF
+};
+
 void app_main() {
-    cpt_job job;
-    cpt_type test;
-    esp_err_t ret = ESP_ERR_TIMEOUT;
+    cpt_config config = CPT_CONFIG_DEFAULT;
 
 #if CPT_FREQUENT_SYSTEM_STATUS_REPORT
     cpt_log_system_status("Initial status");
 #endif //CPT_FREQUENT_SYSTEM_STATUS_REPORT
 
-    cpt_job_init(&job);
-    cpt_init(&test, &job);
-    cpt_run_job(&test);
+    cpt_preempt_register();
+    cpt_proto_register();
+#if CPT_PLATFORM_ESP_IDF
+    cpt_coop_register();
+    cpt_actor_register();
+    cpt_pipe_register();
+#endif //CPT_PLATFORM_ESP_IDF
 
-#if CPT_FREQUENT_SYSTEM_STATUS_REPORT
-    cpt_log_system_status("Status prior starting test");
-#endif //CPT_FREQUENT_SYSTEM_STATUS_REPORT
+    // Run all engines back to back, so that they're compared within the same boot
+    for (size_t i = 0; i < CPT_ARRAY_SIZE(cpt_runs); i ++)
+    {
+        const cpt_engine * engine = cpt_engine_find(cpt_runs[i].engine_name);
+        if (engine == NULL)
+        {
+            ESP_LOGE(TAG, "Engine %s not registered", cpt_runs[i].engine_name);
+            continue;
+        }
+
+        esp_err_t ret = cpt_sweep_run(engine, &config, cpt_runs[i].sweep);
+        ESP_LOGI(TAG, "engine: %s sweep return value: %s", engine->name, esp_err_to_name(ret));
+    }
 
-    ESP_LOGI(TAG, "Starting test");
+    // Worker tasks are reused across runs: this shows how many were needed and how often each ran
+    cpt_pool_log_status();
 
-    uint64_t start_time = cpt_get_current_time_ms();
-    ret = cpt_wait_for_state_change(&test, CPT_WAIT_FOREVER, CPT_STATE_DONE);
-    uint64_t duration_ms = cpt_get_current_time_ms() - start_time;
+    // Once all sweeps are done, rather than after each run, so that the status doesn't bury the results
+    cpt_log_system_status("All sweeps completed");
+}
 
-    cpt_log_system_status("Test completed");
-    ESP_LOGI(TAG, "return value: %s duration: %"PRIu64" ms", esp_err_to_name(ret), duration_ms);
-    cpt_uninit(&test);
-    ESP_LOGI(TAG, "return status: %s", esp_err_to_name(ret));
+#if CPT_PLATFORM_LINUX
+// On the host there's no ESP-IDF startup code to call app_main
+int main()
+{
+    app_main();
 
-    cpt_job_uninit(&job);
-}
\ No newline at end of file
+    return 0;
+}
+#endif //CPT_PLATFORM_LINUX
\ No newline at end of file